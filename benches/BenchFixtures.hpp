@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../src/random2.hpp"
+
+// The PRF and incomparable encoding of the benchmarked `SignatureScheme`, shared by the
+// benchmarks so that they all measure the same scheme shape.
+
+struct BenchPRF
+{
+      using Key = std::vector<uint8_t>;
+
+      Key key_gen() { return Random::generate_vector<uint8_t>(32); }
+
+      std::vector<uint8_t> apply(const Key &key, uint32_t epoch, uint64_t index)
+      {
+            std::vector<uint8_t> out(24);
+            for (size_t b = 0; b < out.size(); b++)
+            {
+                  out[b] = static_cast<uint8_t>(key[b] ^ (epoch >> (8 * (b % 4))) ^ (index >> (8 * (b % 8))));
+            }
+            return out;
+      }
+};
+
+// 64 chains of length 8, the shape of the target sum instantiations; every chain is
+// completed from the middle on average
+template <typename TH>
+struct BenchEncoding
+{
+      using param = typename TH::Parameter;
+      using Randomness = int;
+
+      static constexpr uint DIMENSION = 64;
+      static constexpr uint BASE = 8;
+      static constexpr uint MAX_TRIES = 1;
+
+      static Randomness rand() { return 0; }
+
+      static std::vector<uint8_t> encode(param, std::vector<uint8_t> &message, Randomness, uint32_t epoch)
+      {
+            std::vector<uint8_t> x(DIMENSION);
+            for (uint i = 0; i < DIMENSION; i++)
+            {
+                  x[i] = static_cast<uint8_t>((message[i % message.size()] + i * epoch) % BASE);
+            }
+            return x;
+      }
+};
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/signature/generalized_xmss.hpp"
+#include "../src/symmetric/tweak_hash/sha.hpp"
+#include "../src/symmetric/tweak_hash/blake.hpp"
+#include "../src/random2.hpp"
+#include "BenchFixtures.hpp"
+
+// Key generation time with the BLAKE3 tweakable hashes against the SHA-256 one, for the
+// same parameter and hash lengths. BlakeTweakHashPadded advances many chains per
+// `hash_many` call, BlakeTweakHashFixed hashes one input at a time.
+// Build with
+//     g++ -std=c++23 -O2 -I../src/symmetric/tweak_hash key_gen_blake.cpp ../src/symmetric/Blake/c/{blake3,blake3_dispatch,blake3_portable}.c ../src/symmetric/Blake/c/blake3_*_x86-64_unix.S -lssl -lcrypto -o key_gen_blake
+
+constexpr uint LOG_LIFETIME = 18;
+constexpr uint32_t NUM_EPOCHS = 1 << 12;
+constexpr size_t RUNS = 5;
+
+// median key generation time in milliseconds
+template <typename TH>
+double measure()
+{
+      using Scheme = SignatureScheme<BenchPRF, BenchEncoding<TH>, TH, LOG_LIFETIME>;
+      Scheme scheme{TH(), BenchPRF(), BenchEncoding<TH>()};
+
+      std::vector<double> millis;
+      for (size_t run = 0; run < RUNS; run++)
+      {
+            auto start = std::chrono::steady_clock::now();
+            auto keys = scheme.key_gen(0, NUM_EPOCHS);
+            auto end = std::chrono::steady_clock::now();
+            millis.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+      }
+      std::sort(millis.begin(), millis.end());
+      return millis[millis.size() / 2];
+}
+
+int main()
+{
+      std::cout << "key_gen of " << NUM_EPOCHS << " epochs, " << BenchEncoding<ShaTweakHashFixed<16, 24>>::DIMENSION
+                << " chains of length " << BenchEncoding<ShaTweakHashFixed<16, 24>>::BASE << ", tree depth "
+                << LOG_LIFETIME << ", median of " << RUNS << " runs\n";
+
+      const double sha = measure<ShaTweakHashFixed<16, 24>>();
+      const double blake_fixed = measure<BlakeTweakHashFixed<16, 24>>();
+      const double blake_padded = measure<BlakeTweakHashPadded<16, 24>>();
+
+      auto print = [sha](const std::string &label, double millis)
+      {
+            std::cout << std::left << std::setw(32) << label << std::right << std::fixed << std::setprecision(1)
+                      << std::setw(10) << millis << " ms   " << std::setprecision(2) << sha / millis << "x SHA-256\n";
+      };
+      print("ShaTweakHashFixed<16, 24>", sha);
+      print("BlakeTweakHashFixed<16, 24>", blake_fixed);
+      print("BlakeTweakHashPadded<16, 24>", blake_padded);
+
+      return 0;
+}
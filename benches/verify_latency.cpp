@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/signature/generalized_xmss.hpp"
+#include "../src/symmetric/tweak_hash/sha.hpp"
+#include "../src/random2.hpp"
+#include "BenchFixtures.hpp"
+
+// Latency of a single `SignatureScheme::verify`, sequential and with its chains completed
+// in parallel parts (`verify_parallelism`), alone and next to a running key generation.
+// Build with
+//     g++ -std=c++23 -O2 -I../src/symmetric/tweak_hash verify_latency.cpp -lssl -lcrypto -o verify_latency
+
+using TH = ShaTweakHashFixed<16, 24>;
+
+int main()
+{
+      constexpr uint LOG_LIFETIME = 18;
+      constexpr uint32_t NUM_EPOCHS = 64;
+      constexpr size_t RUNS = 2000;
+      using Scheme = SignatureScheme<BenchPRF, BenchEncoding<TH>, TH, LOG_LIFETIME>;
+
+      Scheme scheme{TH(), BenchPRF(), BenchEncoding<TH>()};
+      auto [pk, sk] = scheme.key_gen(0, NUM_EPOCHS);
+
+      std::vector<std::vector<uint8_t>> messages;
+      std::vector<Scheme::Signature> signatures;
+      for (uint32_t epoch = 0; epoch < NUM_EPOCHS; epoch++)
+      {
+            messages.push_back(Random::generate_vector<uint8_t>(32));
+            signatures.push_back(scheme.sign(sk, epoch, messages.back()));
+      }
+
+      std::cout << "verify latency, " << BenchEncoding<TH>::DIMENSION << " chains of length " << BenchEncoding<TH>::BASE
+                << ", tree depth " << LOG_LIFETIME << ", " << scheme.executor->concurrency() << " workers\n";
+
+      std::vector<uint> parallelisms = {1, 2, 4};
+      if (scheme.executor->concurrency() > 4)
+      {
+            parallelisms.push_back(scheme.executor->concurrency());
+      }
+
+      // latency of one verify every 50 us, in microseconds, sorted
+      auto measure = [&]() -> std::vector<double>
+      {
+            std::vector<double> micros;
+            micros.reserve(RUNS);
+            for (size_t run = 0; run < RUNS + RUNS / 10; run++)
+            {
+                  const uint32_t epoch = static_cast<uint32_t>(run % NUM_EPOCHS);
+                  // gossip messages arrive one at a time, with the workers idle in between
+                  std::this_thread::sleep_for(std::chrono::microseconds(50));
+
+                  auto start = std::chrono::steady_clock::now();
+                  bool valid = scheme.verify(pk, epoch, messages[epoch], signatures[epoch]);
+                  auto end = std::chrono::steady_clock::now();
+
+                  if (!valid)
+                  {
+                        std::cerr << "verify failed at epoch " << epoch << "\n";
+                        std::exit(1);
+                  }
+                  // the first runs warm up caches and wake the pool
+                  if (run >= RUNS / 10)
+                  {
+                        micros.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+                  }
+            }
+            std::sort(micros.begin(), micros.end());
+            return micros;
+      };
+
+      auto print = [](const std::string &label, const std::vector<double> &micros)
+      {
+            std::cout << std::left << std::setw(40) << label << std::right << std::fixed << std::setprecision(1)
+                      << "   p50 " << std::setw(8) << micros[micros.size() / 2] << " us"
+                      << "   p99 " << std::setw(8) << micros[micros.size() * 99 / 100] << " us\n";
+      };
+
+      for (uint parallelism : parallelisms)
+      {
+            scheme.verify_parallelism = parallelism;
+            print("verify_parallelism " + std::to_string(parallelism), measure());
+      }
+
+      // the same while key generation keeps another pool busy, with the parts run on that pool
+      // and on a pool of their own; at least 4 workers, so that the parts are parallel even on
+      // small machines
+      const unsigned workers = std::max(4u, std::thread::hardware_concurrency());
+      auto key_gen_pool = std::make_shared<WorkStealingScheduler>(workers);
+      auto verify_pool = std::make_shared<WorkStealingScheduler>(workers);
+      std::atomic<bool> stop{false};
+      std::thread background([&]
+      {
+            Scheme key_gen_scheme{TH(), BenchPRF(), BenchEncoding<TH>()};
+            key_gen_scheme.executor = key_gen_pool;
+            while (!stop)
+            {
+                  key_gen_scheme.key_gen(0, 1024);
+            }
+      });
+
+      std::cout << "under a background key_gen, " << workers << " workers per pool\n";
+      scheme.verify_parallelism = workers;
+      scheme.verify_executor = key_gen_pool;
+      print("parts on the key_gen pool", measure());
+      scheme.verify_executor = verify_pool;
+      print("parts on their own pool", measure());
+
+      stop = true;
+      background.join();
+
+      return 0;
+}
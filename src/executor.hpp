@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+/// Where the library runs its parallel work (key generation, tree building, batch verification).
+///
+/// `parallel_for(n, fn)` calls `fn(task, worker)` once for every task in [0, n) and returns
+/// when all calls have returned. `worker` is in [0, concurrency()) and no two calls with the
+/// same `worker` run at the same time, so callers can keep per-worker scratch buffers.
+/// If a task throws, the executor may skip the remaining tasks and rethrows the exception.
+///
+/// The default is a process-wide work-stealing pool, `default_executor()` in work_stealing.hpp.
+/// Applications that run their own thread pool can pass a `SubmittingExecutor`, or any other
+/// implementation, so the library shares the application's cores instead of competing with them.
+class Executor {
+public:
+    using Task = std::function<void(size_t task, unsigned worker)>;
+
+    virtual ~Executor() = default;
+
+    virtual unsigned concurrency() const = 0;
+
+    virtual void parallel_for(size_t num_tasks, const Task &fn) = 0;
+};
+
+/// Runs every task on the calling thread, in order.
+class InlineExecutor final : public Executor {
+public:
+    unsigned concurrency() const override { return 1; }
+
+    void parallel_for(size_t num_tasks, const Task &fn) override {
+        for (size_t task = 0; task < num_tasks; task++) {
+            fn(task, 0);
+        }
+    }
+};
+
+/// Runs tasks on a thread pool owned by the application.
+///
+/// `submit(job)` must eventually run `job` on some pool thread. `parallel_for` submits
+/// `concurrency - 1` jobs, works on the tasks itself as worker 0, and returns once every task
+/// is done. Jobs that start late find no tasks left and return at once, so the calling thread
+/// never waits for a job that has not started, even if the pool is busy or the caller is one
+/// of its threads.
+class SubmittingExecutor final : public Executor {
+public:
+    using Submit = std::function<void(std::function<void()> job)>;
+
+    SubmittingExecutor(Submit _submit_, unsigned _concurrency_) :
+    submit(std::move(_submit_)), workers(_concurrency_ > 0 ? _concurrency_ : 1) {}
+
+    unsigned concurrency() const override { return workers; }
+
+    void parallel_for(size_t num_tasks, const Task &fn) override {
+        if (num_tasks == 0) {
+            return;
+        }
+
+        auto state = std::make_shared<State>(num_tasks, fn);
+        for (unsigned w = 1; w < workers && w < num_tasks; w++) {
+            submit([state, w] { state->work(w); });
+        }
+        state->work(0);
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->all_done.wait(lock, [&] { return state->done == state->num_tasks; });
+        if (state->error) {
+            std::rethrow_exception(state->error);
+        }
+    }
+
+private:
+    Submit submit;
+    unsigned workers;
+
+    /// shared with the submitted jobs, which may outlive `parallel_for`
+    struct State {
+        const size_t num_tasks;
+        const Task fn;
+        std::atomic<size_t> next{0};
+        std::atomic<bool> failed{false};
+        std::mutex mutex;
+        std::condition_variable all_done;
+        size_t done = 0;
+        std::exception_ptr error;
+
+        State(size_t _num_tasks_, const Task &_fn_) : num_tasks(_num_tasks_), fn(_fn_) {}
+
+        void work(unsigned worker) {
+            size_t task;
+            while ((task = next.fetch_add(1)) < num_tasks) {
+                std::exception_ptr failure;
+                if (!failed.load(std::memory_order_relaxed)) {
+                    try {
+                        fn(task, worker);
+                    } catch (...) {
+                        failure = std::current_exception();
+                        failed = true;
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                if (failure && !error) {
+                    error = failure;
+                }
+                if (++done == num_tasks) {
+                    all_done.notify_all();
+                }
+            }
+        }
+    };
+};
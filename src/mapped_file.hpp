@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// A whole file mapped read-only into memory.
+///
+/// The mapping is shared, so processes mapping the same file read the same page-cache pages,
+/// and pages are only read from disk when they are first touched.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd < 0) {
+            throw std::runtime_error("MappedFile: cannot open " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat info;
+        if(::fstat(fd, &info) != 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("MappedFile: cannot stat " + path + ": " + std::strerror(error));
+        }
+        size = static_cast<size_t>(info.st_size);
+        if(size == 0) {
+            ::close(fd);
+            throw std::runtime_error("MappedFile: " + path + " is empty");
+        }
+
+        void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        int error = errno;
+        // the mapping stays valid after the descriptor is closed
+        ::close(fd);
+        if(mapping == MAP_FAILED) {
+            throw std::runtime_error("MappedFile: cannot map " + path + ": " + std::strerror(error));
+        }
+        data = static_cast<const std::byte *>(mapping);
+    }
+
+    ~MappedFile() { ::munmap(const_cast<std::byte *>(data), size); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /// The file's contents; the first byte is page aligned.
+    std::span<const std::byte> bytes() const { return std::span<const std::byte>(data, size); }
+
+private:
+    const std::byte *data = nullptr;
+    size_t size = 0;
+};
@@ -1,6 +1,8 @@
+#pragma once
 #include <openssl/rand.h>
 #include <array>
 #include <stdexcept>
+#include <vector>
 
 
 template <typename T>
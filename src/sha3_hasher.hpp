@@ -1,6 +1,9 @@
-#include <sstream>
-#include <iomanip>
+#pragma once
+
 #include <openssl/evp.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
 #include <vector>
 #include <any>
 
@@ -22,7 +25,7 @@ public:
 
             if (!algo)
             {
-                  throw std::runtime_error("Failed to get SHA-356 algorithm");
+                  throw std::runtime_error("Failed to get SHA3-256 algorithm");
             }
             // Initialises digest context
             if (EVP_DigestInit_ex(ctx.get(), algo, nullptr) != 1)
@@ -75,25 +78,38 @@ public:
             };
       }
 
-      std::string finalize()
+      /// Returns the raw digest and resets the hasher, so it can be used for the next message.
+      /// The context stays owned by `ctx` and is freed once, when the hasher is destroyed.
+      std::vector<uint8_t> finalize()
       {
-            std::stringstream hex;
-            unsigned int digest_len = EVP_MD_size(algo);
-            unsigned char *digest = new unsigned char[digest_len];
-
-            EVP_DigestFinal_ex(ctx.get(), digest, &digest_len);
+            std::vector<uint8_t> digest(EVP_MD_size(algo));
+            unsigned int digest_len = 0;
 
-            hex << std::hex << std::setfill('0');
-            for (auto i = 0; i < digest_len; i++)
+            if (EVP_DigestFinal_ex(ctx.get(), digest.data(), &digest_len) != 1)
+            {
+                  throw std::runtime_error("EVP_DigestFinal_ex failed");
+            }
+            if (EVP_DigestInit_ex(ctx.get(), algo, nullptr) != 1)
             {
-                  hex << std::setw(2) << static_cast<int>(digest[i]);
+                  throw std::runtime_error("EVP_DigestInit_ex failed");
             }
 
-            auto output = hex.str();
+            digest.resize(digest_len);
+            return digest;
+      }
 
-            delete[] digest;
-            EVP_MD_CTX_free(ctx.get());
+      /// Lower-case hex encoding of the digest, for logging.
+      std::string finalize_hex()
+      {
+            static constexpr char HEX[] = "0123456789abcdef";
 
-            return output;
+            std::vector<uint8_t> digest = finalize();
+            std::string hex(2 * digest.size(), '0');
+            for (size_t i = 0; i < digest.size(); i++)
+            {
+                  hex[2 * i] = HEX[digest[i] >> 4];
+                  hex[2 * i + 1] = HEX[digest[i] & 0x0f];
+            }
+            return hex;
       }
-};
\ No newline at end of file
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "../symmetric/chain_states.hpp"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <algorithm>
+
+/// Intermediate chain values of a secret key, so that signing can start every chain at the
+/// nearest checkpoint below x[i] instead of at its PRF start.
+///
+/// For every cached epoch, chain i keeps its values at positions INTERVAL, 2 * INTERVAL, ...
+/// up to BASE - 1, i.e. DIMENSION * floor((BASE - 1) / INTERVAL) domain values per epoch, and
+/// signing walks fewer than INTERVAL steps per chain. An interval close to sqrt(BASE) keeps
+/// both the memory and the walk at about sqrt(BASE) per chain.
+///
+/// An epoch is signed at most once, so `take` hands its checkpoints out and forgets them.
+/// All members are safe to call from several threads.
+template <typename TH>
+class ChainCheckpoints {
+public:
+    using Domain = typename TH::Domain;
+
+    ChainCheckpoints(uint _interval_, uint _num_chains_, uint chain_length) :
+    interval(_interval_), num_chains(_num_chains_), per_chain((chain_length - 1) / _interval_) {}
+
+    const uint interval;
+    const uint num_chains;
+    /// checkpoints per chain
+    const uint per_chain;
+
+    /// Stores the values at position `k * interval`, 1 <= k <= per_chain, of chains
+    /// first_chain, first_chain + 1, ... of `epoch`.
+    void store(uint32_t epoch, uint k, uint first_chain, std::span<const Domain> values) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = epochs.find(epoch);
+        if (it == epochs.end()) {
+            it = epochs.emplace(epoch, ChainStates<TH>(per_chain * num_chains)).first;
+        }
+        std::copy(values.begin(), values.end(), it->second.data() + (k - 1) * num_chains + first_chain);
+    }
+
+    /// Removes and returns the checkpoints of `epoch`; checkpoint k of chain i is at
+    /// `(k - 1) * num_chains + i`.
+    std::optional<ChainStates<TH>> take(uint32_t epoch) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = epochs.find(epoch);
+        if (it == epochs.end()) {
+            return std::nullopt;
+        }
+        ChainStates<TH> states = std::move(it->second);
+        epochs.erase(it);
+        return states;
+    }
+
+    bool contains(uint32_t epoch) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return epochs.contains(epoch);
+    }
+
+    /// Number of epochs currently cached.
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return epochs.size();
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::map<uint32_t, ChainStates<TH>> epochs;
+};
@@ -1,13 +1,29 @@
+#pragma once
+
 #include <concepts>
 #include "../symmetric/prf.hpp"
 #include "../inc_encoding.hpp"
 #include "../symmetric/TweakHash.hpp"
 #include "../symmetric/tweak_hash_tree.hpp"
+#include "../symmetric/tree_hash.hpp"
+#include "../symmetric/split_hash_tree.hpp"
+#include "../symmetric/merkle_traversal.hpp"
+#include "chain_checkpoints.hpp"
+#include "../work_stealing.hpp"
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <optional>
+#include <stdexcept>
 #include <functional>
+#include <numeric>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include <iostream>
 
+/// The keys store TH::Parameter as is. Parameters that cache per-key hash state, like the
+/// SHA-256 midstate of ShaTweakHashMidstate, therefore keep it with the key.
 template <typename TH>
 struct GeneralizedXMSSPublicKey {
     const typename TH::Domain root;
@@ -16,36 +32,48 @@ struct GeneralizedXMSSPublicKey {
     GeneralizedXMSSPublicKey(typename TH::Domain _root_, typename TH::Parameter _parameter_) : root(_root_), parameter(_parameter_) {} 
 };
 
-template <typename PRF, typename TH>
+/// Holds the whole tree in `tree`, or, for keys generated with
+/// `SignatureScheme::bottom_tree_height`, the top and current bottom trees in `split_tree`
+/// and an empty `tree`. Split trees are binary, so only keys with ARITY 2 have them.
+template <typename PRF, typename TH, uint ARITY = 2>
 struct GeneralizedXMSSSecretKey {
     const typename PRF::Key prf_key;
-    const HashTree<TH> tree;
+    const HashTree<TH, ARITY> tree;
     const typename TH::Parameter parameter;
     const uint activation_epoch;
-    const uint num_active_epochs;
+    /// 64-bit, as a streaming key over a whole 2^32 lifetime has 2^32 active epochs.
+    const uint64_t num_active_epochs;
+    /// Optional intermediate chain values for signing, see `SignatureScheme::checkpoint_interval`.
+    /// Shared between copies of the key.
+    std::shared_ptr<ChainCheckpoints<TH>> checkpoints;
+    /// Top and bottom trees of a key without a full `tree`; shared between copies of the key.
+    std::shared_ptr<SplitHashTree<TH>> split_tree;
     
-    GeneralizedXMSSSecretKey(const typename PRF::Key _prf_key_, const HashTree<TH> _tree_, const typename TH::Parameter _parameter_,
-                const uint _activation_epoch_, const uint _num_active_epochs_) :
+    GeneralizedXMSSSecretKey(const typename PRF::Key _prf_key_, const HashTree<TH, ARITY> _tree_, const typename TH::Parameter _parameter_,
+                const uint _activation_epoch_, const uint64_t _num_active_epochs_,
+                std::shared_ptr<ChainCheckpoints<TH>> _checkpoints_ = nullptr,
+                std::shared_ptr<SplitHashTree<TH>> _split_tree_ = nullptr) :
     prf_key(_prf_key_), tree(_tree_), parameter(_parameter_), activation_epoch(_activation_epoch_), 
-    num_active_epochs(_num_active_epochs_) {}
+    num_active_epochs(_num_active_epochs_), checkpoints(std::move(_checkpoints_)), split_tree(std::move(_split_tree_)) {}
 };
 
-template <typename IE, typename TH>
+template <typename IE, typename TH, uint ARITY = 2>
 struct GeneralizedXMSSSignature {
-    const HashTreeOpening<TH> path;
+    const HashTreeOpening<TH, ARITY> path;
     const typename IE::Randomness rho;
     const std::vector<typename TH::Domain> hashes;
 
-    GeneralizedXMSSSignature(const HashTreeOpening<TH> _path_, const typename IE::Randomness _rho_,
+    GeneralizedXMSSSignature(const HashTreeOpening<TH, ARITY> _path_, const typename IE::Randomness _rho_,
         const std::vector<typename TH::Domain> _hashes_) :
     path(_path_), rho(_rho_), hashes(_hashes_) {}
 };
 
-template <typename IE, typename TH>
-struct GeneralizedXMSSErrorNoSignature : public GeneralizedXMSSSignature<IE, TH> {
+template <typename IE, typename TH, uint ARITY = 2>
+struct GeneralizedXMSSErrorNoSignature : public GeneralizedXMSSSignature<IE, TH, ARITY> {
     const uint attempts;
 
-    GeneralizedXMSSErrorNoSignature(uint attempts_t) : attempts(attempts_t) {}
+    GeneralizedXMSSErrorNoSignature(uint attempts_t) :
+    GeneralizedXMSSSignature<IE, TH, ARITY>(HashTreeOpening<TH, ARITY>({}), typename IE::Randomness{}, {}), attempts(attempts_t) {}
 };
 
 struct MultiSignatureVerification {
@@ -75,11 +103,20 @@ std::vector<uint8_t> &message, Signature &sig) {return obj.verify(pk, epoch, mes
 */
 
 
-template <typename PRF, typename IE, typename TH, uint LOG_LIFETIME>
+/// With TREE_ARITY 4 or 8 the epochs are the leaves of a 4- or 8-ary tree of depth
+/// LOG_LIFETIME / log2(TREE_ARITY): signatures carry TREE_ARITY - 1 siblings per level and
+/// verification hashes that many fewer, longer tree nodes.
+template <typename PRF, typename IE, typename TH, uint LOG_LIFETIME, uint TREE_ARITY = 2>
 struct SignatureScheme {
     using PublicKey = GeneralizedXMSSPublicKey<TH>;
-    using SecretKey = GeneralizedXMSSSecretKey<PRF,TH>;
-    using Signature = GeneralizedXMSSSignature<IE, TH>;
+    using SecretKey = GeneralizedXMSSSecretKey<PRF, TH, TREE_ARITY>;
+    using Signature = GeneralizedXMSSSignature<IE, TH, TREE_ARITY>;
+
+    static_assert(TREE_ARITY_BITS<TREE_ARITY> != 0 && LOG_LIFETIME % TREE_ARITY_BITS<TREE_ARITY> == 0,
+                  "Signature scheme: the tree arity must be 2, 4 or 8 and divide the lifetime into whole levels");
+
+    /// Levels of the tree over the epochs.
+    static constexpr uint TREE_DEPTH = LOG_LIFETIME / TREE_ARITY_BITS<TREE_ARITY>;
 
     using TH_domain = typename TH::Domain;
 
@@ -89,11 +126,71 @@ struct SignatureScheme {
 
     SignatureScheme(TH _th_, PRF _prf_, IE _ie_) : prf(_prf_), ie(_ie_), th(_th_) {};
 
-    uint64_t LIFETIME = 1 << LOG_LIFETIME;
+    uint64_t LIFETIME = uint64_t{1} << LOG_LIFETIME;
+
+    /// Number of chains one `key_gen` task walks together with `walk_chains`. The chains of
+    /// all active epochs are numbered epoch after epoch and cut into tasks of this size.
+    static constexpr uint KEY_GEN_CHAINS_PER_TASK = 256;
+
+    /// Where `key_gen`, `prepare_checkpoints` and tree building run their parallel work; the
+    /// process-wide work-stealing pool by default. Set it to an application's own executor,
+    /// e.g. a `SubmittingExecutor` over its thread pool, to share that pool's threads.
+    std::shared_ptr<Executor> executor = default_executor();
+
+    /// Spacing of the chain checkpoints kept for signing, see `ChainCheckpoints`; 0 disables them.
+    /// When set, `key_gen` keeps checkpoints for every active epoch, which costs
+    /// DIMENSION * floor((BASE - 1) / checkpoint_interval) domain values per epoch, and `sign`
+    /// then walks fewer than `checkpoint_interval` steps per chain. Keys generated without
+    /// checkpoints can get them for upcoming epochs with `prepare_checkpoints`.
+    uint checkpoint_interval = 0;
+
+    /// 0 keeps the tree of keys that hold it whole layer by layer. A height k > 0 stores it in
+    /// tiles of k levels instead, see `HashTree::to_tiled`, so a signature's co-path is read
+    /// from about TREE_DEPTH / k contiguous blocks (2^(k+1) - 2 nodes for a binary tree), which carries
+    /// over to a key mapped with `map_secret_key`. With 32-byte nodes, k = 4 gives 960-byte tiles.
+    uint tree_tile_height = 0;
+
+    /// 0 builds and keeps the whole tree. A height h > 0 generates keys in bounded memory:
+    /// the leaves are streamed into a `TreeHash` a window at a time, and the secret key keeps
+    /// a `SplitHashTree` of the levels from h up (about 2^(LOG_LIFETIME - h + 1) nodes) plus
+    /// the 2^h-leaf bottom trees of the current and next epochs, the next one built in the
+    /// background. h = LOG_LIFETIME / 2 balances the two. The active range is widened to whole
+    /// bottom trees, so `sk.activation_epoch` and `sk.num_active_epochs` are multiples of 2^h.
+    uint bottom_tree_height = 0;
+
+    /// With `bottom_tree_height`, keep a `MerkleTraversal` through the current bottom tree
+    /// instead of the bottom tree itself. The key then holds O(bottom_tree_height) bottom nodes,
+    /// and signing epochs in increasing order computes at most 2 * bottom_tree_height - 1
+    /// leaves each; signing an earlier epoch walks its whole bottom tree once. Validators sign
+    /// epoch after epoch, so a large bottom tree height keeps both the top tree and the
+    /// traversal at kilobytes.
+    bool bottom_tree_traversal = false;
+
+    /// 1 completes the chains of a signature in `verify` on the calling thread, all in lockstep
+    /// so that they share the lanes of a `BatchTweakableHash_c`. A value p > 1 cuts them into up
+    /// to p parts of at least `VERIFY_MIN_CHAINS_PER_PART` chains, walked in parallel on
+    /// `verify_executor`; the leaf and co-path are hashed as soon as the last part is done. This
+    /// lowers the latency of a single `verify`, e.g. for gossip validation, at the cost of waking
+    /// p - 1 workers; for throughput, `verify_batch` is cheaper.
+    uint verify_parallelism = 1;
+
+    /// Where a parallel `verify` runs its parts. A pool other than `executor`, so that a
+    /// verification never waits for a `key_gen` or background tree build to leave the pool.
+    std::shared_ptr<Executor> verify_executor = latency_executor();
+
+    /// Fewest chains in one part of a parallel `verify`, so that every part still fills the
+    /// eight lanes of an AVX2 hash kernel.
+    static constexpr uint VERIFY_MIN_CHAINS_PER_PART = 8;
+
+    /// Epochs whose leaves one streaming task computes, about `KEY_GEN_CHAINS_PER_TASK` chains.
+    static constexpr uint STREAM_EPOCHS_PER_TASK = std::max<uint>(1, KEY_GEN_CHAINS_PER_TASK / IE::DIMENSION);
+
+    /// Streaming tasks per executor worker in one window; bounds the leaves held at once.
+    static constexpr uint STREAM_TASKS_PER_WORKER = 16;
 
     std::tuple<PublicKey, SecretKey> key_gen(const uint activation_epoch, const uint num_active_epochs) {
         assert(
-            activation_epoch + num_active_epochs <= static_cast<uint>(LIFETIME) &&
+            static_cast<uint64_t>(activation_epoch) + num_active_epochs <= LIFETIME &&
             "Key gen: `activation_epoch` and `num_active_epochs` are invalid for this lifetime"
         );
 
@@ -101,49 +198,92 @@ struct SignatureScheme {
         
         auto prf_key = prf.key_gen();
 
+        if(bottom_tree_height > 0) {
+            if constexpr (TREE_ARITY == 2) {
+                return key_gen_streaming(prf_key, parameter, activation_epoch, num_active_epochs);
+            } else {
+                throw std::invalid_argument("Key gen: `bottom_tree_height` needs a binary tree");
+            }
+        }
+
         auto num_chains = IE::DIMENSION;
         auto chain_length = IE::BASE;
 
         
         std::vector<TH_domain> chain_ends_hashes(num_active_epochs);
 
-        #pragma omp parallel for
-        for(uint epoch = activation_epoch; epoch < activation_epoch + num_active_epochs; epoch++) {
-            std::vector<TH_domain> chain_ends(num_chains);
-            #pragma omp parallel for 
-            for(auto chain_index = 0; chain_index < num_chains; chain_index++) {
-                typename TH::Domain start = static_cast<TH::Domain>(prf.apply(&prf_key, 
-                    static_cast<uint32_t>(epoch), static_cast<uint64_t>(chain_index)));
-
-                TH_domain out = chain<TH>(th, parameter, static_cast<uint32_t>(epoch), 
-                                            static_cast<uint8_t>(chain_index), 0, chain_length - 1, start);
-                chain_ends[chain_index] = out;
-            }
-            TH_domain outApply = th.apply(parameter, th.tree_tweak(0, static_cast<uint32_t>(epoch)), chain_ends);
-            chain_ends_hashes[epoch - activation_epoch] = outApply;
+        std::shared_ptr<ChainCheckpoints<TH>> checkpoints;
+        if(checkpoint_interval > 0) {
+            checkpoints = std::make_shared<ChainCheckpoints<TH>>(checkpoint_interval, num_chains, chain_length);
+        }
+
+        // every chain runs from position 0 to the end. The chains of all epochs form one flat
+        // task space that the executor balances over its workers; each task walks its chains
+        // in the worker's scratch buffers and hands the ends to their epochs, and the task
+        // that completes an epoch hashes its leaf
+        const size_t total_chains = static_cast<size_t>(num_active_epochs) * num_chains;
+        const size_t num_tasks = (total_chains + KEY_GEN_CHAINS_PER_TASK - 1) / KEY_GEN_CHAINS_PER_TASK;
+
+        std::vector<EpochChainEnds> epoch_ends(num_active_epochs);
+        for(uint e = 0; e < num_active_epochs; e++) {
+            size_t first_task = static_cast<size_t>(e) * num_chains / KEY_GEN_CHAINS_PER_TASK;
+            size_t last_task = (static_cast<size_t>(e + 1) * num_chains - 1) / KEY_GEN_CHAINS_PER_TASK;
+            epoch_ends[e].remaining = static_cast<uint>(last_task - first_task + 1);
         }
 
-        HashTree<TH> tree = HashTree<TH>::NewHashTree(LOG_LIFETIME, activation_epoch, parameter, chain_ends_hashes); 
+        std::vector<WalkScratch> scratch(executor->concurrency());
+
+        executor->parallel_for(num_tasks, [&](size_t task, unsigned worker) {
+            const size_t begin = task * KEY_GEN_CHAINS_PER_TASK;
+            const size_t end = std::min(begin + KEY_GEN_CHAINS_PER_TASK, total_chains);
+            WalkScratch &walk = scratch[worker];
+            walk_chain_range(prf_key, parameter, activation_epoch, begin, end, walk, checkpoints.get());
+
+            for(size_t f = begin; f < end;) {
+                const uint e = static_cast<uint>(f / num_chains);
+                const size_t row_end = std::min(end, static_cast<size_t>(e + 1) * num_chains);
+
+                EpochChainEnds &ends = epoch_ends[e];
+                std::call_once(ends.allocated, [&] { ends.states.resize(num_chains); });
+                std::copy(walk.states.data() + (f - begin), walk.states.data() + (row_end - begin),
+                          ends.states.data() + f % num_chains);
+
+                if(ends.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    chain_ends_hashes[e] = th.apply(parameter, th.tree_tweak(0, static_cast<uint32_t>(activation_epoch + e)), ends.states.span());
+                    ends.states = ChainStates<TH>();
+                }
+                f = row_end;
+            }
+        });
+
+        using Tree = HashTree<TH, TREE_ARITY>;
+        Tree layered = Tree::NewHashTree(TREE_DEPTH, activation_epoch, parameter, chain_ends_hashes, th, *executor);
+        Tree tree = tree_tile_height > 0 ? layered.to_tiled(tree_tile_height) : layered;
         TH_domain root = tree.root();
         
-        PublicKey pk = GeneralizedXMSSPublicKey(root, parameter);
-        SecretKey sk = GeneralizedXMSSSecretKey(prf_key, tree, parameter, activation_epoch, num_active_epochs);
+        PublicKey pk = PublicKey(root, parameter);
+        SecretKey sk = SecretKey(prf_key, tree, parameter, activation_epoch, num_active_epochs, checkpoints);
 
         return std::make_tuple(pk, sk);
     }
 
-    Signature sign(SecretKey sk, uint32_t epoch, std::vector<uint8_t> &message) {
-        std::vector<uint> activation_range(sk.num_active_epochs);
-        std::iota(activation_range.begin(), activation_range.end(), sk.activation_epoch);
-
+    Signature sign(const SecretKey &sk, uint32_t epoch, std::vector<uint8_t> &message) {
         assert(
-            std::find(activation_range.begin(), activation_range.end(), static_cast<uint>(epoch)) != activation_range.end() &&
+            epoch >= sk.activation_epoch &&
+            static_cast<uint64_t>(epoch) < static_cast<uint64_t>(sk.activation_epoch) + sk.num_active_epochs &&
             "Signing: key not active during this epoch"
         );
 
         using IE_randomness = typename IE::Randomness;
 
-        HashTreeOpening<TH> path = sk.tree.path(epoch);
+        HashTreeOpening<TH, TREE_ARITY> path = [&]() -> HashTreeOpening<TH, TREE_ARITY> {
+            if constexpr (TREE_ARITY == 2) {
+                if(sk.split_tree) {
+                    return sk.split_tree->path(epoch);
+                }
+            }
+            return sk.tree.path(epoch);
+        }();
         uint max_tries = IE::MAX_TRIES;
         uint attempts = 0;
         std::optional<std::vector<uint8_t>> x_opt;
@@ -163,7 +303,7 @@ struct SignatureScheme {
         }
 
         if(!x_opt.has_value()) {
-            return GeneralizedXMSSErrorNoSignature<IE, TH>(max_tries);
+            return GeneralizedXMSSErrorNoSignature<IE, TH, TREE_ARITY>(max_tries);
         }
         
         assert(x_opt.has_value());
@@ -177,20 +317,36 @@ struct SignatureScheme {
             "Encoding is broken: returned too many or too few chunks."
         );
 
-        std::vector<TH_domain> hashes_(num_chains);
-        #pragma omp parralel for
+        // chain i runs to x[i], from its nearest checkpoint if the key has them, else from position 0
+        std::optional<ChainStates<TH>> cached;
+        if(sk.checkpoints) {
+            cached = sk.checkpoints->take(epoch);
+        }
+
+        std::vector<ChainJob> jobs;
+        jobs.reserve(num_chains);
+        ChainStates<TH> states(num_chains);
         for(uint chain_index = 0; chain_index < num_chains; chain_index++) {
-            TH_domain start = static_cast<TH_domain>(prf.apply(sk.prf_key, epoch, static_cast<uint64_t>(chain_index)));
-            uint steps = static_cast<uint>(x[chain_index]);
-            TH_domain out = chain<TH>(sk.parameter, epoch, static_cast<uint8_t>(chain_index), 0, steps, start);
-            hashes_[chain_index] = out;
+            uint k = cached ? std::min<uint>(x[chain_index] / sk.checkpoints->interval, sk.checkpoints->per_chain) : 0;
+            uint start_pos = k * (cached ? sk.checkpoints->interval : 0);
+            if(k > 0) {
+                states[chain_index] = (*cached)[(k - 1) * num_chains + chain_index];
+            } else {
+                states[chain_index] = domain_from_bytes<TH_domain>(prf.apply(sk.prf_key, epoch, static_cast<uint64_t>(chain_index)));
+            }
+            jobs.push_back(ChainJob{epoch, static_cast<uint8_t>(chain_index), static_cast<uint8_t>(start_pos),
+                                    static_cast<uint>(x[chain_index]) - start_pos});
         }
 
-        return GeneralizedXMSSSignature<IE, TH>(path, rho, hashes_);
+        walk_chains<TH>(th, sk.parameter, jobs, states);
+
+        std::vector<TH_domain> hashes_ = states.to_vector();
+
+        return GeneralizedXMSSSignature<IE, TH, TREE_ARITY>(path, rho, hashes_);
     }
 
     bool verify(PublicKey &pk, uint32_t epoch, std::vector<uint8_t> &message, Signature &sig) {
-        if(static_cast<uint64_t>(epoch) < LIFETIME) {
+        if(static_cast<uint64_t>(epoch) >= LIFETIME) {
             std::cout << "Generalized XMSS - Verify: Epoch too large.\n";
             return false;
         }
@@ -205,29 +361,377 @@ struct SignatureScheme {
         uint chain_length = IE::BASE;
         uint num_chains = IE::DIMENSION;
 
-        if(x.size() == num_chains) {
+        if(x.size() != num_chains) {
             std::cout << "Encoding is broken: returned too many or too few chunks.\n";
             return false;
         }
 
-        std::vector<TH_domain> chain_ends(num_chains);
+        // a malformed signature must not be read past its end
+        if(sig.hashes.size() != num_chains || sig.path.co_path.size() != TREE_DEPTH * (TREE_ARITY - 1)) {
+            return false;
+        }
 
-        for(int chain_index = 0; chain_index < x.size(); chain_index++) {
+        // complete every chain from x[i] to the end, all chains together
+        std::vector<ChainJob> jobs(num_chains);
+        for(uint chain_index = 0; chain_index < num_chains; chain_index++) {
             uint8_t xi = x[chain_index];
+            jobs[chain_index] = ChainJob{epoch, static_cast<uint8_t>(chain_index), xi,
+                                         static_cast<uint>(static_cast<uint8_t>(chain_length - 1) - xi)};
+        }
 
-            uint8_t steps = static_cast<uint8_t>(chain_length - 1) - xi;
-            uint8_t start_pos_in_chain = xi;
-            TH_domain &start = sig.hashes[chain_index];
-            TH_domain end = chain<TH>(pk.parameter, epoch, static_cast<uint8_t>(chain_index), start_pos_in_chain, static_cast<uint>(steps), start);
-            chain_ends[chain_index] = end;
+        ChainStates<TH> chain_ends{std::span<const TH_domain>(sig.hashes)};
+        if(verify_parallelism > 1) {
+            walk_chains_in_parts(pk.parameter, jobs, chain_ends);
+        } else {
+            walk_chains<TH>(th, pk.parameter, jobs, chain_ends);
         }
 
-        return hash_tree_verify(
+        return hash_tree_verify<TH, TREE_ARITY>(
             pk.parameter,
             pk.root,
             epoch,
-            chain_ends,
-            sig.path
+            chain_ends.span(),
+            sig.path,
+            th
         );
     }
-};
+
+    /// One signature to check with `verify_batch`.
+    struct BatchItem {
+        const PublicKey &pk;
+        uint32_t epoch;
+        std::vector<uint8_t> &message;
+        const Signature &sig;
+    };
+
+    /// Number of signatures one `verify_batch` task checks together.
+    static constexpr uint VERIFY_BATCH_ITEMS_PER_TASK = 64;
+
+    /// Checks every item like `verify` and returns whether item i is valid at index i.
+    ///
+    /// The items are cut into tasks of `VERIFY_BATCH_ITEMS_PER_TASK` on `executor`. A task
+    /// completes the chains of all its signatures in lockstep, then hashes their leaves and
+    /// each co-path level across all of them at once, so that the hashes of different keys
+    /// share the lanes of a `MultiKeyBatchTweakableHash_c`.
+    std::vector<bool> verify_batch(std::span<const BatchItem> items) {
+        // one byte per item, as tasks write their results concurrently
+        std::vector<uint8_t> valid(items.size(), 0);
+        const size_t num_tasks = (items.size() + VERIFY_BATCH_ITEMS_PER_TASK - 1) / VERIFY_BATCH_ITEMS_PER_TASK;
+        executor->parallel_for(num_tasks, [&](size_t task, unsigned) {
+            const size_t begin = task * VERIFY_BATCH_ITEMS_PER_TASK;
+            const size_t end = std::min<size_t>(begin + VERIFY_BATCH_ITEMS_PER_TASK, items.size());
+            verify_items(items.subspan(begin, end - begin), valid.data() + begin);
+        });
+        return std::vector<bool>(valid.begin(), valid.end());
+    }
+
+    /// Computes checkpoints with spacing `checkpoint_interval` for epochs
+    /// [first_epoch, first_epoch + num_epochs) of `sk` that do not have them yet,
+    /// e.g. for the next few epochs ahead of signing.
+    void prepare_checkpoints(SecretKey &sk, uint32_t first_epoch, uint num_epochs) {
+        assert(checkpoint_interval > 0 && "Prepare checkpoints: `checkpoint_interval` is 0");
+
+        if(!sk.checkpoints || sk.checkpoints->interval != checkpoint_interval) {
+            sk.checkpoints = std::make_shared<ChainCheckpoints<TH>>(checkpoint_interval, IE::DIMENSION, IE::BASE);
+        }
+
+        uint64_t begin_epoch = std::max<uint64_t>(first_epoch, sk.activation_epoch);
+        uint64_t end_epoch = std::min<uint64_t>(uint64_t{first_epoch} + num_epochs, sk.activation_epoch + sk.num_active_epochs);
+        if(begin_epoch >= end_epoch) {
+            return;
+        }
+
+        std::vector<WalkScratch> scratch(executor->concurrency());
+        executor->parallel_for(end_epoch - begin_epoch, [&](size_t task, unsigned worker) {
+            uint32_t epoch = static_cast<uint32_t>(begin_epoch + task);
+            if(!sk.checkpoints->contains(epoch)) {
+                walk_chain_range(sk.prf_key, sk.parameter, epoch, 0, IE::DIMENSION, scratch[worker], sk.checkpoints.get());
+            }
+        });
+    }
+
+private:
+    std::tuple<PublicKey, SecretKey> key_gen_streaming(const typename PRF::Key &prf_key, const typename TH::Parameter &parameter,
+                                                      const uint activation_epoch, const uint num_active_epochs) {
+        const uint h = bottom_tree_height;
+        assert(h <= LOG_LIFETIME && "Key gen: `bottom_tree_height` is larger than the tree");
+
+        // widen the active range to whole bottom trees
+        const uint64_t first_epoch = (static_cast<uint64_t>(activation_epoch) >> h) << h;
+        const uint64_t end_epoch = std::min<uint64_t>(
+            ((static_cast<uint64_t>(activation_epoch) + num_active_epochs + (uint64_t{1} << h) - 1) >> h) << h, LIFETIME);
+
+        std::shared_ptr<ChainCheckpoints<TH>> checkpoints;
+        if(checkpoint_interval > 0) {
+            checkpoints = std::make_shared<ChainCheckpoints<TH>>(checkpoint_interval, IE::DIMENSION, IE::BASE);
+        }
+
+        TreeHash<TH> tree_hash(LOG_LIFETIME, parameter, th, h);
+        stream_leaves(prf_key, parameter, first_epoch, end_epoch - first_epoch, checkpoints.get(),
+                      [&](uint64_t first, std::span<const TH_domain> leaves) {
+                          tree_hash.push_leaves(static_cast<uint32_t>(first), leaves);
+                      });
+        TH_domain root = tree_hash.finish();
+
+        // each bottom tree is rebuilt by a copy of this scheme, so the key does not refer to it
+        const uint32_t first_bottom = static_cast<uint32_t>(first_epoch >> h);
+        const uint32_t num_bottoms = static_cast<uint32_t>((end_epoch - first_epoch) >> h);
+        HashTree<TH> top(LOG_LIFETIME - h, tree_hash.take_layers());
+        std::shared_ptr<SplitHashTree<TH>> split_tree;
+        if(bottom_tree_traversal) {
+            split_tree = std::make_shared<SplitHashTree<TH>>(
+                LOG_LIFETIME, h, first_bottom, num_bottoms, std::move(top),
+                typename SplitHashTree<TH>::StartTraversal([scheme = *this, prf_key, parameter](uint32_t position) mutable {
+                    return scheme.start_traversal(prf_key, parameter, position);
+                }));
+        } else {
+            split_tree = std::make_shared<SplitHashTree<TH>>(
+                LOG_LIFETIME, h, first_bottom, num_bottoms, std::move(top),
+                typename SplitHashTree<TH>::BuildBottom([scheme = *this, prf_key, parameter](uint32_t bottom) mutable {
+                    return scheme.build_bottom_tree(prf_key, parameter, bottom);
+                }));
+        }
+        split_tree->prepare(first_bottom);
+
+        PublicKey pk = PublicKey(root, parameter);
+        SecretKey sk = SecretKey(prf_key, HashTree<TH>(0, {}), parameter, static_cast<uint>(first_epoch),
+                                 end_epoch - first_epoch, checkpoints, split_tree);
+        return std::make_tuple(pk, sk);
+    }
+
+    /// Rebuilds bottom tree `bottom` of height `bottom_tree_height` from its leaves.
+    HashTree<TH> build_bottom_tree(const typename PRF::Key &prf_key, const typename TH::Parameter &parameter, uint32_t bottom) {
+        const uint h = bottom_tree_height;
+
+        TreeHash<TH> tree_hash(h, parameter, th, 0);
+        stream_leaves(prf_key, parameter, static_cast<uint64_t>(bottom) << h, uint64_t{1} << h, nullptr,
+                      [&](uint64_t first, std::span<const TH_domain> leaves) {
+                          tree_hash.push_leaves(static_cast<uint32_t>(first), leaves);
+                      });
+        tree_hash.finish();
+        return HashTree<TH>(h, tree_hash.take_layers());
+    }
+
+    /// Starts a traversal of the bottom tree below leaf `position`, at that leaf. The traversal
+    /// computes its leaves one by one with a copy of this scheme.
+    MerkleTraversal<TH> start_traversal(const typename PRF::Key &prf_key, const typename TH::Parameter &parameter, uint32_t position) {
+        const uint h = bottom_tree_height;
+        const uint32_t first = (position >> h) << h;
+
+        typename MerkleTraversal<TH>::StartNodes start(h, first, position);
+        TreeHash<TH> tree_hash(h, parameter, th);
+        tree_hash.observe(std::ref(start));
+        stream_leaves(prf_key, parameter, first, uint64_t{1} << h, nullptr,
+                      [&](uint64_t first_leaf, std::span<const TH_domain> leaves) {
+                          tree_hash.push_leaves(static_cast<uint32_t>(first_leaf), leaves);
+                      });
+        tree_hash.finish();
+
+        auto leaf = [scheme = *this, prf_key, parameter, walk = WalkScratch()](uint32_t epoch) mutable {
+            scheme.walk_chain_range(prf_key, parameter, epoch, 0, IE::DIMENSION, walk, nullptr);
+            return scheme.th.apply(parameter, scheme.th.tree_tweak(0, epoch), walk.states.span());
+        };
+        return MerkleTraversal<TH>(std::move(start), parameter, th, leaf);
+    }
+
+    /// Computes the leaves of epochs [first_epoch, first_epoch + num_epochs) on `executor` and
+    /// hands them to `sink` in order. The epochs are processed a window of
+    /// `STREAM_TASKS_PER_WORKER` tasks per worker at a time, so at most one window of leaves
+    /// is held at once.
+    void stream_leaves(const typename PRF::Key &prf_key, const typename TH::Parameter &parameter,
+                       uint64_t first_epoch, uint64_t num_epochs, ChainCheckpoints<TH> *checkpoints,
+                       const std::function<void(uint64_t first, std::span<const TH_domain> leaves)> &sink) {
+        const uint num_chains = IE::DIMENSION;
+        const uint64_t window = static_cast<uint64_t>(executor->concurrency()) * STREAM_TASKS_PER_WORKER * STREAM_EPOCHS_PER_TASK;
+
+        std::vector<WalkScratch> scratch(executor->concurrency());
+        std::vector<TH_domain> leaves;
+
+        for(uint64_t window_first = 0; window_first < num_epochs; window_first += window) {
+            const uint64_t window_epochs = std::min(window, num_epochs - window_first);
+            const size_t num_tasks = (window_epochs + STREAM_EPOCHS_PER_TASK - 1) / STREAM_EPOCHS_PER_TASK;
+            leaves.resize(window_epochs);
+
+            executor->parallel_for(num_tasks, [&](size_t task, unsigned worker) {
+                const uint64_t begin = task * STREAM_EPOCHS_PER_TASK;
+                const uint64_t end = std::min<uint64_t>(begin + STREAM_EPOCHS_PER_TASK, window_epochs);
+                const uint64_t epoch = first_epoch + window_first + begin;
+
+                WalkScratch &walk = scratch[worker];
+                walk_chain_range(prf_key, parameter, static_cast<uint>(epoch), 0, (end - begin) * num_chains, walk, checkpoints);
+                for(uint64_t e = begin; e < end; e++) {
+                    leaves[e] = th.apply(parameter, th.tree_tweak(0, static_cast<uint32_t>(first_epoch + window_first + e)),
+                                         walk.states.row(e - begin, num_chains));
+                }
+            });
+
+            sink(first_epoch + window_first, std::span<const TH_domain>(leaves));
+        }
+    }
+
+    /// Walks `jobs` like `walk_chains`, cut into parts that run in parallel on `verify_executor`, see
+    /// `verify_parallelism`. The chains are dealt to the parts longest first, so that every part
+    /// walks about as many steps, and as many chains per lockstep round, as the others.
+    void walk_chains_in_parts(const typename TH::Parameter &parameter, const std::vector<ChainJob> &jobs, ChainStates<TH> &states) {
+        const size_t num_parts = std::min<size_t>({verify_parallelism, verify_executor->concurrency(),
+                                                   jobs.size() / VERIFY_MIN_CHAINS_PER_PART});
+        if(num_parts <= 1) {
+            walk_chains<TH>(th, parameter, jobs, states);
+            return;
+        }
+
+        std::vector<size_t> order(jobs.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].steps > jobs[b].steps; });
+
+        // every part writes back a distinct set of chains
+        verify_executor->parallel_for(num_parts, [&](size_t part, unsigned) {
+            std::vector<ChainJob> part_jobs;
+            ChainStates<TH> part_states((order.size() - part + num_parts - 1) / num_parts);
+            for(size_t k = part, j = 0; k < order.size(); k += num_parts, j++) {
+                part_jobs.push_back(jobs[order[k]]);
+                part_states[j] = states[order[k]];
+            }
+            walk_chains<TH>(th, parameter, part_jobs, part_states);
+            for(size_t k = part, j = 0; k < order.size(); k += num_parts, j++) {
+                states[order[k]] = std::move(part_states[j]);
+            }
+        });
+    }
+
+    /// Sets valid[i] to whether items[i] verifies, see `verify_batch`.
+    void verify_items(std::span<const BatchItem> items, uint8_t *valid) {
+        using IE_parameter = typename IE::param;
+        using TH_parameter = typename TH::Parameter;
+        constexpr uint BITS = TREE_ARITY_BITS<TREE_ARITY>;
+        const uint num_chains = IE::DIMENSION;
+        const uint chain_length = IE::BASE;
+
+        // items that encode and have signatures of the right shape; only they are hashed
+        std::vector<size_t> live;
+        std::vector<ChainJob> jobs;
+        std::vector<const TH_parameter *> chain_parameters;
+        for(size_t i = 0; i < items.size(); i++) {
+            const BatchItem &item = items[i];
+            if(static_cast<uint64_t>(item.epoch) >= LIFETIME || item.sig.hashes.size() != num_chains
+               || item.sig.path.co_path.size() != TREE_DEPTH * (TREE_ARITY - 1)) {
+                continue;
+            }
+            std::vector<uint8_t> x = IE::encode(static_cast<IE_parameter>(item.pk.parameter), item.message, item.sig.rho, item.epoch);
+            if(x.size() != num_chains) {
+                continue;
+            }
+
+            live.push_back(i);
+            for(uint chain_index = 0; chain_index < num_chains; chain_index++) {
+                uint8_t xi = x[chain_index];
+                jobs.push_back(ChainJob{item.epoch, static_cast<uint8_t>(chain_index), xi,
+                                        static_cast<uint>(static_cast<uint8_t>(chain_length - 1) - xi)});
+                chain_parameters.push_back(&item.pk.parameter);
+            }
+        }
+
+        // complete the chains of all live items together
+        ChainStates<TH> chain_ends(live.size() * num_chains);
+        for(size_t k = 0; k < live.size(); k++) {
+            const auto &hashes = items[live[k]].sig.hashes;
+            std::copy(hashes.begin(), hashes.end(), chain_ends.data() + k * num_chains);
+        }
+        walk_chains<TH>(th, chain_parameters, jobs, chain_ends);
+
+        // the leaves, then one tree level after the other, each across all items
+        std::vector<const TH_parameter *> parameters;
+        std::vector<typename TH::Tweak> tweaks;
+        std::vector<std::span<const TH_domain>> messages;
+        for(size_t k = 0; k < live.size(); k++) {
+            const BatchItem &item = items[live[k]];
+            parameters.push_back(&item.pk.parameter);
+            tweaks.push_back(th.tree_tweak(0, item.epoch));
+            messages.push_back(chain_ends.row(k, num_chains));
+        }
+        std::vector<TH_domain> nodes = apply_many_keys(th, parameters, tweaks, messages);
+
+        std::vector<std::array<TH_domain, TREE_ARITY>> children(live.size());
+        for(uint level = 0; level < TREE_DEPTH; level++) {
+            tweaks.clear();
+            messages.clear();
+            for(size_t k = 0; k < live.size(); k++) {
+                const BatchItem &item = items[live[k]];
+                const uint32_t position = item.epoch >> (level * BITS);
+                const uint child_index = position % TREE_ARITY;
+                const TH_domain *siblings = item.sig.path.co_path.data() + level * (TREE_ARITY - 1);
+                for(uint c = 0; c < TREE_ARITY; c++) {
+                    children[k][c] = c < child_index ? siblings[c] : c == child_index ? nodes[k] : siblings[c - 1];
+                }
+                tweaks.push_back(tree_node_tweak<TREE_ARITY>(th, level + 1, position >> BITS));
+                messages.emplace_back(children[k].data(), TREE_ARITY);
+            }
+            nodes = apply_many_keys(th, parameters, tweaks, messages);
+        }
+
+        for(size_t k = 0; k < live.size(); k++) {
+            valid[live[k]] = nodes[k] == items[live[k]].pk.root;
+        }
+    }
+
+    /// Per-worker buffers for walking chains, reused from task to task.
+    struct WalkScratch {
+        std::vector<ChainJob> jobs;
+        ChainStates<TH> states;
+    };
+
+    /// Chain ends of one epoch during `key_gen`, collected from the tasks that walk its chains.
+    struct EpochChainEnds {
+        std::once_flag allocated;
+        ChainStates<TH> states;
+        std::atomic<uint> remaining{0};
+    };
+
+    /// Walks chains [begin, end) of the chains of epochs first_epoch, first_epoch + 1, ...,
+    /// numbered epoch after epoch, from their PRF start to the end. The chain ends are left in
+    /// `walk.states`. With `checkpoints`, the walk pauses every `checkpoints->interval` steps
+    /// to store the intermediate values.
+    void walk_chain_range(const typename PRF::Key &prf_key, const typename TH::Parameter &parameter,
+                          uint first_epoch, size_t begin, size_t end, WalkScratch &walk, ChainCheckpoints<TH> *checkpoints) {
+        const uint num_chains = IE::DIMENSION;
+        const uint chain_length = IE::BASE;
+
+        walk.jobs.clear();
+        walk.states.resize(end - begin);
+        for(size_t f = begin; f < end; f++) {
+            uint32_t epoch = static_cast<uint32_t>(first_epoch + f / num_chains);
+            uint chain_index = static_cast<uint>(f % num_chains);
+            walk.states[f - begin] = domain_from_bytes<TH_domain>(prf.apply(prf_key, epoch, static_cast<uint64_t>(chain_index)));
+            walk.jobs.push_back(ChainJob{epoch, static_cast<uint8_t>(chain_index), 0, static_cast<uint>(chain_length - 1)});
+        }
+
+        if(checkpoints == nullptr) {
+            walk_chains<TH>(th, parameter, walk.jobs, walk.states);
+            return;
+        }
+
+        // walk `interval` steps at a time and store the values at every checkpoint,
+        // then walk the rest of the chains
+        uint pos = 0;
+        for(uint k = 1; k <= checkpoints->per_chain; k++) {
+            for(ChainJob &job : walk.jobs) {
+                job.start_pos_in_chain = static_cast<uint8_t>(pos);
+                job.steps = checkpoints->interval;
+            }
+            walk_chains<TH>(th, parameter, walk.jobs, walk.states);
+            pos += checkpoints->interval;
+
+            for(size_t f = begin; f < end;) {
+                size_t row_end = std::min(end, (f / num_chains + 1) * num_chains);
+                checkpoints->store(static_cast<uint32_t>(first_epoch + f / num_chains), k, static_cast<uint>(f % num_chains),
+                                   walk.states.span().subspan(f - begin, row_end - f));
+                f = row_end;
+            }
+        }
+        for(ChainJob &job : walk.jobs) {
+            job.start_pos_in_chain = static_cast<uint8_t>(pos);
+            job.steps = chain_length - 1 - pos;
+        }
+        walk_chains<TH>(th, parameter, walk.jobs, walk.states);
+    }
+};
\ No newline at end of file
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "generalized_xmss.hpp"
+#include "../mapped_file.hpp"
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+/// On-disk format of a `GeneralizedXMSSSecretKey` with a full tree, laid out so that a signer
+/// can map the file and serve co-paths from the mapping without reading the tree first:
+///
+///     SecretKeyFileHeader                      64 bytes
+///     PRF key                                  prf_key_size bytes
+///     parameter                                parameter_size bytes
+///     SecretKeyFileLayer[num_layers]           per tree layer, leaf layer first
+///     zero padding to a multiple of 64
+///     tree nodes                               arena_nodes * domain_size bytes, at arena_offset
+///
+/// The nodes are `HashTree::arena()` as it is in memory, so the file is tied to the byte
+/// order and domain type it was written with; both are recorded and checked when mapping.
+/// The arena is in the layered layout or, if `tile_height` is not 0, the tiled one of
+/// `HashTree::to_tiled`. Version 1 files have no `tile_height` and are always layered.
+/// Byte-vector PRF keys are stored as their bytes, other keys and parameters, and the nodes,
+/// must be trivially copyable and are stored as their object representation. Chain
+/// checkpoints are not stored; a mapped key can get them with `prepare_checkpoints`.
+struct SecretKeyFileHeader {
+    static constexpr char MAGIC[8] = {'G', 'X', 'M', 'S', 'S', 'S', 'K', '\0'};
+    static constexpr uint32_t VERSION = 2;
+    /// Written in the host's byte order; a file from a host of the other order reads it swapped.
+    static constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+    static constexpr uint64_t ARENA_ALIGNMENT = 64;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t depth;
+    uint32_t activation_epoch;
+    uint32_t num_active_epochs;
+    uint32_t domain_size;
+    uint32_t prf_key_size;
+    uint32_t parameter_size;
+    uint32_t num_layers;
+    /// since version 2; reserved and 0 in version 1
+    uint32_t tile_height;
+    uint64_t arena_offset;
+    uint64_t arena_nodes;
+};
+static_assert(sizeof(SecretKeyFileHeader) == 64 && std::is_trivially_copyable_v<SecretKeyFileHeader>);
+
+struct SecretKeyFileLayer {
+    uint64_t start_index;
+    uint64_t offset;
+    uint64_t size;
+};
+static_assert(sizeof(SecretKeyFileLayer) == 24);
+
+namespace secret_key_file {
+
+/// Closes a file descriptor when it goes out of scope.
+struct FileDescriptor {
+    int fd;
+    ~FileDescriptor() { if(fd >= 0) ::close(fd); }
+};
+
+inline void write_all(int fd, const void *data, size_t size, const std::string &path) {
+    const char *cursor = static_cast<const char *>(data);
+    while(size > 0) {
+        ssize_t written = ::write(fd, cursor, size);
+        if(written < 0 && errno == EINTR) {
+            continue;
+        }
+        if(written <= 0) {
+            throw std::runtime_error("Secret key file: cannot write " + path + ": " + std::strerror(errno));
+        }
+        cursor += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+inline void sync(int fd, const std::string &path) {
+    if(::fsync(fd) != 0) {
+        throw std::runtime_error("Secret key file: cannot sync " + path + ": " + std::strerror(errno));
+    }
+}
+
+template <typename T>
+std::vector<uint8_t> to_bytes(const T &value) {
+    if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+        return value;
+    } else {
+        static_assert(std::is_trivially_copyable_v<T>, "Secret key file: type is neither a byte vector nor trivially copyable");
+        std::vector<uint8_t> bytes(sizeof(T));
+        std::memcpy(bytes.data(), &value, sizeof(T));
+        return bytes;
+    }
+}
+
+template <typename T>
+T from_bytes(const std::byte *bytes, size_t size) {
+    if constexpr (std::is_same_v<T, std::vector<uint8_t>>) {
+        const uint8_t *first = reinterpret_cast<const uint8_t *>(bytes);
+        return std::vector<uint8_t>(first, first + size);
+    } else {
+        if(size != sizeof(T)) {
+            throw std::runtime_error("Secret key file: stored size does not match the key's types");
+        }
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+}
+
+} // namespace secret_key_file
+
+/// Writes `sk` to `path` in the format of `SecretKeyFileHeader`. The file is written next to
+/// `path`, readable by its owner only, synced and renamed into place, and the directory is
+/// synced after the rename, so neither a reader nor a crash sees a half-written key.
+template <typename PRF, typename TH>
+void save_secret_key(const GeneralizedXMSSSecretKey<PRF, TH> &sk, const std::string &path) {
+    using Domain = typename TH::Domain;
+    static_assert(std::is_trivially_copyable_v<Domain>, "Secret key file: tree nodes must be trivially copyable");
+
+    if(sk.split_tree) {
+        throw std::invalid_argument("Secret key file: only keys that hold their whole tree can be saved");
+    }
+    if(sk.num_active_epochs > UINT32_MAX) {
+        throw std::invalid_argument("Secret key file: too many active epochs for the header");
+    }
+
+    const std::vector<uint8_t> prf_key = secret_key_file::to_bytes(sk.prf_key);
+    const std::vector<uint8_t> parameter = secret_key_file::to_bytes(sk.parameter);
+    const HashTree<TH> &tree = sk.tree;
+
+    std::vector<SecretKeyFileLayer> layers;
+    for(uint l = 0; l < tree.num_layers(); l++) {
+        const auto &layer = tree.layer(l);
+        layers.push_back(SecretKeyFileLayer{layer.start_index, layer.offset, layer.size});
+    }
+
+    const uint64_t tables_end = sizeof(SecretKeyFileHeader) + prf_key.size() + parameter.size()
+                                + layers.size() * sizeof(SecretKeyFileLayer);
+    const uint64_t alignment = SecretKeyFileHeader::ARENA_ALIGNMENT;
+
+    SecretKeyFileHeader header{};
+    std::memcpy(header.magic, SecretKeyFileHeader::MAGIC, sizeof(header.magic));
+    header.version = SecretKeyFileHeader::VERSION;
+    header.byte_order = SecretKeyFileHeader::BYTE_ORDER_MARK;
+    header.depth = tree.tree_depth();
+    header.activation_epoch = sk.activation_epoch;
+    header.num_active_epochs = static_cast<uint32_t>(sk.num_active_epochs);
+    header.domain_size = sizeof(Domain);
+    header.prf_key_size = static_cast<uint32_t>(prf_key.size());
+    header.parameter_size = static_cast<uint32_t>(parameter.size());
+    header.num_layers = static_cast<uint32_t>(layers.size());
+    header.tile_height = tree.tree_tile_height();
+    header.arena_offset = (tables_end + alignment - 1) / alignment * alignment;
+    header.arena_nodes = tree.arena().size();
+
+    // a staging file left by a crashed save is replaced; O_EXCL then makes sure the key is
+    // written to a fresh file of mode 0600 and not through a link someone else placed there
+    const std::string staging = path + ".tmp";
+    if(::unlink(staging.c_str()) != 0 && errno != ENOENT) {
+        throw std::runtime_error("Secret key file: cannot remove " + staging + ": " + std::strerror(errno));
+    }
+    {
+        secret_key_file::FileDescriptor out{::open(staging.c_str(), O_CREAT | O_EXCL | O_WRONLY | O_CLOEXEC, 0600)};
+        if(out.fd < 0) {
+            throw std::runtime_error("Secret key file: cannot create " + staging + ": " + std::strerror(errno));
+        }
+        const std::vector<char> padding(header.arena_offset - tables_end, 0);
+        secret_key_file::write_all(out.fd, &header, sizeof(header), staging);
+        secret_key_file::write_all(out.fd, prf_key.data(), prf_key.size(), staging);
+        secret_key_file::write_all(out.fd, parameter.data(), parameter.size(), staging);
+        secret_key_file::write_all(out.fd, layers.data(), layers.size() * sizeof(SecretKeyFileLayer), staging);
+        secret_key_file::write_all(out.fd, padding.data(), padding.size(), staging);
+        secret_key_file::write_all(out.fd, tree.arena().data(), tree.arena().size_bytes(), staging);
+        secret_key_file::sync(out.fd, staging);
+    }
+    std::filesystem::rename(staging, path);
+
+    const std::filesystem::path directory = std::filesystem::absolute(path).parent_path();
+    secret_key_file::FileDescriptor dir{::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    if(dir.fd < 0) {
+        throw std::runtime_error("Secret key file: cannot open " + directory.string() + ": " + std::strerror(errno));
+    }
+    secret_key_file::sync(dir.fd, directory.string());
+}
+
+/// Maps the key saved at `path`. Only the header, PRF key, parameter and layer table are
+/// read; the tree of the returned key serves `root` and `path` from the mapping, which stays
+/// open as long as a copy of the key or its tree exists. Throws `std::runtime_error` if the
+/// file is not a key of this version, byte order and domain type, or is truncated.
+template <typename PRF, typename TH>
+GeneralizedXMSSSecretKey<PRF, TH> map_secret_key(const std::string &path) {
+    using Domain = typename TH::Domain;
+    using LayerRange = typename HashTree<TH>::LayerRange;
+    static_assert(std::is_trivially_copyable_v<Domain>, "Secret key file: tree nodes must be trivially copyable");
+
+    auto file = std::make_shared<const MappedFile>(path);
+    const std::span<const std::byte> bytes = file->bytes();
+
+    SecretKeyFileHeader header;
+    if(bytes.size() < sizeof(header)) {
+        throw std::runtime_error("Secret key file: truncated header");
+    }
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    if(std::memcmp(header.magic, SecretKeyFileHeader::MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("Secret key file: not a secret key file");
+    }
+    if(header.byte_order != SecretKeyFileHeader::BYTE_ORDER_MARK) {
+        throw std::runtime_error("Secret key file: written with a different byte order");
+    }
+    if(header.version == 1) {
+        header.tile_height = 0;
+    } else if(header.version != SecretKeyFileHeader::VERSION) {
+        throw std::runtime_error("Secret key file: unsupported version " + std::to_string(header.version));
+    }
+    if(header.domain_size != sizeof(Domain)) {
+        throw std::runtime_error("Secret key file: node size does not match the tweakable hash");
+    }
+
+    const uint64_t tables_end = sizeof(header) + uint64_t{header.prf_key_size} + header.parameter_size
+                                + uint64_t{header.num_layers} * sizeof(SecretKeyFileLayer);
+    if(header.depth > 32 || header.num_layers != uint64_t{header.depth} + 1 || header.tile_height > header.depth
+       || tables_end > bytes.size() || header.arena_offset > bytes.size() || header.arena_offset < tables_end
+       || header.arena_offset % SecretKeyFileHeader::ARENA_ALIGNMENT != 0
+       || header.arena_nodes > (bytes.size() - std::min<uint64_t>(bytes.size(), header.arena_offset)) / sizeof(Domain)) {
+        throw std::runtime_error("Secret key file: truncated or inconsistent layout");
+    }
+
+    const std::byte *cursor = bytes.data() + sizeof(header);
+    auto prf_key = secret_key_file::from_bytes<typename PRF::Key>(cursor, header.prf_key_size);
+    cursor += header.prf_key_size;
+    auto parameter = secret_key_file::from_bytes<typename TH::Parameter>(cursor, header.parameter_size);
+    cursor += header.parameter_size;
+
+    // the layers must lie in the tree, 2^(depth - l) nodes wide on layer l (the root layer is
+    // padded to a pair, so 2 nodes wide), and one after the other
+    std::vector<LayerRange> ranges;
+    ranges.reserve(header.num_layers);
+    uint64_t offset = 0;
+    for(uint32_t l = 0; l < header.num_layers; l++) {
+        SecretKeyFileLayer layer;
+        std::memcpy(&layer, cursor + l * sizeof(layer), sizeof(layer));
+        const uint64_t width = std::max<uint64_t>(uint64_t{1} << (header.depth - l), 2);
+        if(layer.size == 0 || layer.offset != offset || layer.size > width || layer.start_index > width - layer.size
+           || layer.start_index > UINT32_MAX) {
+            throw std::runtime_error("Secret key file: layer outside the tree");
+        }
+        offset += layer.size;
+        ranges.push_back(LayerRange{static_cast<uint>(layer.start_index), layer.offset, layer.size});
+    }
+    if(header.arena_nodes != HashTree<TH>::arena_size(ranges, header.tile_height)) {
+        throw std::runtime_error("Secret key file: node count does not match the layers");
+    }
+
+    std::span<const Domain> nodes(reinterpret_cast<const Domain *>(bytes.data() + header.arena_offset), header.arena_nodes);
+    HashTree<TH> tree(header.depth, std::move(ranges), nodes, std::move(file), header.tile_height);
+    return GeneralizedXMSSSecretKey<PRF, TH>(prf_key, tree, parameter, header.activation_epoch, header.num_active_epochs);
+}
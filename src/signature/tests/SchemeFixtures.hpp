@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../../symmetric/tweak_hash/sha.hpp"
+
+// Deterministic stand-ins for the PRF and incomparable encoding of a `SignatureScheme`,
+// shared by the signature tests.
+
+using TH = ShaTweakHashFixed<16, 24>;
+
+// ---- Deterministic PRF ----
+struct CounterPRF
+{
+    using Key = std::vector<uint8_t>;
+
+    Key key_gen() { return Key(32, 7); }
+
+    std::vector<uint8_t> apply(const Key &, uint32_t epoch, uint64_t index)
+    {
+        std::vector<uint8_t> out(24);
+        for (int b = 0; b < 4; b++)
+        {
+            out[b] = static_cast<uint8_t>(epoch >> (8 * b));
+        }
+        out[4] = static_cast<uint8_t>(index);
+        return out;
+    }
+};
+
+// ---- Encoding with a fixed codeword per epoch: chain i starts at (STRIDE * i + epoch) % BASE ----
+template <uint DIMENSION_t, uint BASE_t, uint STRIDE = 1>
+struct EpochEncoding
+{
+    using param = TH::Parameter;
+    using Randomness = int;
+
+    static constexpr uint DIMENSION = DIMENSION_t;
+    static constexpr uint BASE = BASE_t;
+    static constexpr uint MAX_TRIES = 1;
+
+    static Randomness rand() { return 0; }
+
+    static std::vector<uint8_t> encode(param, std::vector<uint8_t> &, Randomness, uint32_t epoch)
+    {
+        std::vector<uint8_t> x(DIMENSION);
+        for (uint i = 0; i < DIMENSION; i++)
+        {
+            x[i] = static_cast<uint8_t>((STRIDE * i + epoch) % BASE);
+        }
+        return x;
+    }
+};
+
+using FixedEncoding = EpochEncoding<8, 4>;
@@ -0,0 +1,54 @@
+#include "catch_amalgamated.hpp"
+#include <numeric>
+#include "../generalized_xmss.hpp"
+#include "SchemeFixtures.hpp"
+
+// chains of 16 with starts spread over the chain, so checkpoints fall on both sides of them
+using CheckpointEncoding = EpochEncoding<12, 16, 5>;
+
+using Scheme = SignatureScheme<CounterPRF, CheckpointEncoding, TH, 3>;
+
+TEST_CASE("Checkpoints: signatures match signing without checkpoints")
+{
+    std::vector<uint8_t> message(32, 1);
+
+    for (uint interval : {1u, 3u, 4u, 15u})
+    {
+        Scheme scheme{TH(), CounterPRF(), CheckpointEncoding()};
+        scheme.checkpoint_interval = interval;
+        auto [pk, sk] = scheme.key_gen(0, 8);
+        REQUIRE(sk.checkpoints->size() == 8);
+
+        auto plain = Scheme::SecretKey(sk.prf_key, sk.tree, sk.parameter, sk.activation_epoch, sk.num_active_epochs);
+
+        for (uint32_t epoch = 0; epoch < 8; epoch++)
+        {
+            auto sig = scheme.sign(sk, epoch, message);
+            auto expected = scheme.sign(plain, epoch, message);
+            REQUIRE(sig.hashes == expected.hashes);
+            REQUIRE(scheme.verify(pk, epoch, message, sig));
+        }
+
+        // every epoch is signed once, so its checkpoints are dropped
+        REQUIRE(sk.checkpoints->size() == 0);
+    }
+}
+
+TEST_CASE("Checkpoints: prepared lazily for upcoming epochs")
+{
+    std::vector<uint8_t> message(32, 2);
+
+    Scheme scheme{TH(), CounterPRF(), CheckpointEncoding()};
+    auto [pk, sk] = scheme.key_gen(0, 8);
+    REQUIRE(sk.checkpoints == nullptr);
+
+    scheme.checkpoint_interval = 4;
+    scheme.prepare_checkpoints(sk, 2, 3);
+    REQUIRE(sk.checkpoints->size() == 3);
+    REQUIRE(sk.checkpoints->contains(4));
+    REQUIRE_FALSE(sk.checkpoints->contains(5));
+
+    auto sig = scheme.sign(sk, 3, message);
+    REQUIRE(scheme.verify(pk, 3, message, sig));
+    REQUIRE_FALSE(sk.checkpoints->contains(3));
+}
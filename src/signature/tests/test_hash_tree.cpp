@@ -0,0 +1,252 @@
+#include "catch_amalgamated.hpp"
+#include "../generalized_xmss.hpp"
+#include "../../symmetric/tweak_hash_tree.hpp"
+#include "../../symmetric/tree_hash.hpp"
+#include "../../work_stealing.hpp"
+#include "SchemeFixtures.hpp"
+
+static std::vector<TH::Domain> random_leaves(TH &th, size_t n)
+{
+    std::vector<TH::Domain> leaves;
+    for (size_t i = 0; i < n; i++)
+    {
+        leaves.push_back(th.rand_domain());
+    }
+    return leaves;
+}
+
+static TH::Domain walk_up(TH &th, const TH::Parameter &parameter, TH::Domain node, uint32_t position,
+                          const HashTreeOpening<TH> &opening)
+{
+    for (uint l = 0; l < opening.co_path.size(); l++)
+    {
+        TH::Domain children[2];
+        children[position % 2] = node;
+        children[1 - position % 2] = opening.co_path[l];
+        position >>= 1;
+        node = th.apply(parameter, th.tree_tweak(static_cast<uint8_t>(l + 1), position),
+                        std::span<const TH::Domain>(children));
+    }
+    return node;
+}
+
+TEST_CASE("HashTree: layers are contiguous in one arena")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+
+    for (uint32_t start : {0u, 1u, 6u})
+    {
+        auto leaves = random_leaves(th, 9);
+        auto tree = HashTree<TH>::NewHashTree(5, start, parameter, leaves, th);
+
+        REQUIRE(tree.num_layers() == 6);
+        REQUIRE(reinterpret_cast<uintptr_t>(tree.arena().data()) % 64 == 0);
+
+        size_t offset = 0;
+        for (uint l = 0; l < tree.num_layers(); l++)
+        {
+            const auto &layer = tree.layer(l);
+            REQUIRE(layer.offset == offset);
+            REQUIRE(layer.start_index % 2 == 0);
+            REQUIRE(layer.size % 2 == 0);
+            offset += layer.size;
+        }
+        REQUIRE(offset == tree.arena().size());
+
+        // the leaves are stored in place, after the left padding
+        const auto &leaf_layer = tree.layer(0);
+        for (uint32_t i = 0; i < leaves.size(); i++)
+        {
+            REQUIRE(tree.arena()[leaf_layer.offset + start + i - leaf_layer.start_index] == leaves[i]);
+        }
+        REQUIRE(tree.arena()[tree.layer(5).offset] == tree.root());
+
+        for (uint32_t i = 0; i < leaves.size(); i++)
+        {
+            auto opening = tree.path(start + i);
+            REQUIRE(opening.co_path.size() == 5);
+            REQUIRE(walk_up(th, parameter, leaves[i], start + i, opening) == tree.root());
+        }
+    }
+}
+
+TEST_CASE("HashTree: every parent is the hash of its children, in subtrees and above")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+    InlineExecutor inline_executor;
+    WorkStealingScheduler pool(4);
+
+    for (Executor *executor : {static_cast<Executor *>(&inline_executor), static_cast<Executor *>(&pool)})
+    {
+        for (auto [depth, start, count] : {std::tuple{12u, 5u, 3000u}, std::tuple{13u, 0u, 8192u}, std::tuple{4u, 3u, 6u}})
+        {
+            auto leaves = random_leaves(th, count);
+            auto tree = HashTree<TH>::NewHashTree(depth, start, parameter, leaves, th, *executor);
+
+            for (uint l = 0; l < depth; l++)
+            {
+                const auto &children = tree.layer(l);
+                for (uint32_t p = children.start_index / 2; p < (children.start_index + children.size) / 2; p++)
+                {
+                    TH::Domain pair[2] = {tree.node(l, 2 * p), tree.node(l, 2 * p + 1)};
+                    REQUIRE(tree.node(l + 1, p) == th.apply(parameter, th.tree_tweak(static_cast<uint8_t>(l + 1), p),
+                                                            std::span<const TH::Domain>(pair)));
+                }
+            }
+            for (uint32_t i = 0; i < count; i += 97)
+            {
+                REQUIRE(tree.node(0, start + i) == leaves[i]);
+            }
+        }
+    }
+}
+
+TEST_CASE("HashTree: a tree flattened from TreeHash layers opens like a built one")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+    auto leaves = random_leaves(th, 32);
+
+    auto built = HashTree<TH>::NewHashTree(5, 0, parameter, leaves, th);
+
+    TreeHash<TH> tree_hash(5, parameter, th, 0);
+    tree_hash.push_leaves(0, leaves);
+    tree_hash.finish();
+    HashTree<TH> flattened(5, tree_hash.take_layers());
+
+    REQUIRE(flattened.root() == built.root());
+    REQUIRE(flattened.num_layers() == built.num_layers());
+    for (uint32_t position = 0; position < 32; position++)
+    {
+        REQUIRE(flattened.path(position).co_path == built.path(position).co_path);
+    }
+}
+
+TEST_CASE("HashTree: tiled layout opens like the layered one")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+
+    for (uint32_t start : {0u, 5u, 200u})
+    {
+        auto leaves = random_leaves(th, 37);
+        auto layered = HashTree<TH>::NewHashTree(9, start, parameter, leaves, th);
+        std::vector<HashTree<TH>::LayerRange> ranges;
+        for (uint l = 0; l < layered.num_layers(); l++)
+        {
+            ranges.push_back(layered.layer(l));
+        }
+
+        for (uint tile_height : {1u, 3u, 4u, 10u, 12u})
+        {
+            auto tiled = layered.to_tiled(tile_height);
+            REQUIRE(tiled.tree_tile_height() == tile_height);
+            REQUIRE(tiled.root() == layered.root());
+            REQUIRE(tiled.arena().size() == HashTree<TH>::arena_size(ranges, tile_height));
+            for (uint32_t i = 0; i < leaves.size(); i++)
+            {
+                REQUIRE(tiled.path(start + i).co_path == layered.path(start + i).co_path);
+            }
+        }
+    }
+}
+
+TEST_CASE("HashTree: a co-path stays inside one tile per band")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+    auto leaves = random_leaves(th, 256);
+    auto tiled = HashTree<TH>::NewHashTree(8, 0, parameter, leaves, th).to_tiled(4);
+
+    // bands of 4 levels below the root band, in tiles of 16 + 8 + 4 + 2 nodes
+    const TH::Domain *base = tiled.arena().data();
+    for (uint32_t position : {0u, 77u, 255u})
+    {
+        for (uint band = 0; band < 2; band++)
+        {
+            const uint32_t ancestor = position >> (4 * band);
+            const TH::Domain *first = &tiled.node(4 * band, ancestor ^ 1);
+            for (uint l = 4 * band; l < 4 * band + 4; l++)
+            {
+                const TH::Domain *sibling = &tiled.node(l, (position >> l) ^ 1);
+                REQUIRE(sibling - base >= 0);
+                REQUIRE(std::abs(sibling - first) < 30);
+            }
+        }
+    }
+}
+
+template <uint ARITY>
+static void check_arity(uint depth, uint32_t start, uint32_t count)
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+
+    // leaves are hashes of their contents, as `hash_tree_verify` expects
+    auto contents = random_leaves(th, count);
+    std::vector<TH::Domain> leaves;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        leaves.push_back(th.apply(parameter, th.tree_tweak(0, start + i), std::span<const TH::Domain>(&contents[i], 1)));
+    }
+
+    auto tree = HashTree<TH, ARITY>::NewHashTree(depth, start, parameter, leaves, th);
+    auto tiled = tree.to_tiled(2);
+    REQUIRE(tree.num_layers() == depth + 1);
+    for (uint l = 0; l < tree.num_layers(); l++)
+    {
+        REQUIRE(tree.layer(l).start_index % ARITY == 0);
+        REQUIRE(tree.layer(l).size % ARITY == 0);
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto opening = tree.path(start + i);
+        REQUIRE(opening.co_path.size() == depth * (ARITY - 1));
+        REQUIRE(tiled.path(start + i).co_path == opening.co_path);
+        std::span<const TH::Domain> content(&contents[i], 1);
+        REQUIRE(hash_tree_verify<TH, ARITY>(parameter, tree.root(), start + i, content, opening, th));
+        REQUIRE_FALSE(hash_tree_verify<TH, ARITY>(parameter, tree.root(), (start + i) ^ 1, content, opening, th));
+    }
+}
+
+TEST_CASE("HashTree: 4-ary and 8-ary trees open and verify every leaf")
+{
+    check_arity<4>(4, 0, 256);
+    check_arity<4>(5, 13, 300);
+    check_arity<8>(3, 0, 512);
+    check_arity<8>(3, 7, 90);
+    check_arity<2>(8, 3, 100);
+}
+
+TEST_CASE("HashTree: arities hash under distinct tweaks")
+{
+    TH th;
+    auto bytes = [](const ShaTweak &tweak) { return std::vector<uint8_t>(tweak.data(), tweak.data() + tweak.size()); };
+    REQUIRE(bytes(tree_node_tweak<2>(th, 1, 0)) == bytes(th.tree_tweak(1, 0)));
+    REQUIRE(bytes(tree_node_tweak<4>(th, 1, 0)) != bytes(th.tree_tweak(1, 0)));
+    REQUIRE(bytes(tree_node_tweak<8>(th, 1, 0)) != bytes(tree_node_tweak<4>(th, 1, 0)));
+}
+
+TEST_CASE("SignatureScheme: 4-ary tree signs and verifies")
+{
+    using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, 8, 4>;
+    static_assert(Scheme::TREE_DEPTH == 4);
+
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    auto [pk, sk] = scheme.key_gen(9, 200);
+
+    std::vector<uint8_t> message(32, 2);
+    for (uint32_t epoch : {9u, 10u, 64u, 208u})
+    {
+        auto sig = scheme.sign(sk, epoch, message);
+        REQUIRE(sig.path.co_path.size() == 4 * 3);
+        REQUIRE(scheme.verify(pk, epoch, message, sig));
+        REQUIRE_FALSE(scheme.verify(pk, epoch + 1, message, sig));
+    }
+
+    scheme.bottom_tree_height = 2;
+    REQUIRE_THROWS_AS(scheme.key_gen(0, 16), std::invalid_argument);
+}
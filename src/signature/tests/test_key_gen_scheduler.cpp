@@ -0,0 +1,158 @@
+#include "catch_amalgamated.hpp"
+#include <atomic>
+#include <stdexcept>
+#include <thread>
+#include "../generalized_xmss.hpp"
+#include "../../work_stealing.hpp"
+#include "SchemeFixtures.hpp"
+
+// 256 chains per task is not a multiple of 12, so tasks end in the middle of epochs
+using SchedulerEncoding = EpochEncoding<12, 8>;
+
+TEST_CASE("WorkStealingScheduler: runs every task exactly once")
+{
+    for (unsigned threads : {1u, 3u, 8u})
+    {
+        WorkStealingScheduler scheduler(threads);
+        std::vector<std::atomic<int>> runs(1000);
+        std::atomic<bool> bad_worker{false};
+
+        scheduler.run(runs.size(), [&](size_t task, unsigned worker)
+        {
+            if (worker >= scheduler.num_threads())
+            {
+                bad_worker = true;
+            }
+            runs[task]++;
+        });
+
+        REQUIRE_FALSE(bad_worker);
+        for (auto &r : runs)
+        {
+            REQUIRE(r == 1);
+        }
+    }
+}
+
+TEST_CASE("WorkStealingScheduler: rethrows a task's exception")
+{
+    WorkStealingScheduler scheduler(4);
+    auto failing = [](size_t task, unsigned)
+    {
+        if (task == 37)
+        {
+            throw std::runtime_error("task failed");
+        }
+    };
+    REQUIRE_THROWS_AS(scheduler.run(100, failing), std::runtime_error);
+}
+
+TEST_CASE("WorkStealingScheduler: the pool is reused and nested calls run inline")
+{
+    WorkStealingScheduler scheduler(4);
+    REQUIRE_THROWS_AS(scheduler.run(10, [](size_t, unsigned) { throw std::runtime_error("fails"); }), std::runtime_error);
+
+    for (int round = 0; round < 3; round++)
+    {
+        std::atomic<int> inner_runs{0};
+        std::atomic<bool> moved_worker{false};
+        scheduler.run(16, [&](size_t, unsigned worker)
+        {
+            scheduler.run(5, [&](size_t, unsigned inner_worker)
+            {
+                if (inner_worker != worker)
+                {
+                    moved_worker = true;
+                }
+                inner_runs++;
+            });
+        });
+        REQUIRE(inner_runs == 80);
+        REQUIRE_FALSE(moved_worker);
+    }
+}
+
+TEST_CASE("SubmittingExecutor: runs every task once on the host's threads")
+{
+    std::vector<std::thread> host_threads;
+    SubmittingExecutor executor([&](std::function<void()> job)
+                                { host_threads.emplace_back(std::move(job)); },
+                                4);
+
+    std::vector<std::atomic<int>> runs(500);
+    std::atomic<bool> bad_worker{false};
+    executor.parallel_for(runs.size(), [&](size_t task, unsigned worker)
+    {
+        if (worker >= executor.concurrency())
+        {
+            bad_worker = true;
+        }
+        runs[task]++;
+    });
+    REQUIRE(host_threads.size() == 3);
+    REQUIRE_FALSE(bad_worker);
+    for (auto &r : runs)
+    {
+        REQUIRE(r == 1);
+    }
+
+    auto failing = [](size_t task, unsigned)
+    {
+        if (task == 3)
+        {
+            throw std::runtime_error("task failed");
+        }
+    };
+    REQUIRE_THROWS_AS(executor.parallel_for(20, failing), std::runtime_error);
+
+    for (std::thread &t : host_threads)
+    {
+        t.join();
+    }
+}
+
+TEST_CASE("key_gen: flattened tasks build the same tree as walking every chain")
+{
+    constexpr uint LOG_LIFETIME = 6;
+    using Scheme = SignatureScheme<CounterPRF, SchedulerEncoding, TH, LOG_LIFETIME>;
+
+    TH th;
+    CounterPRF prf;
+
+    std::vector<std::thread> host_threads;
+    auto submit = [&](std::function<void()> job)
+    { host_threads.emplace_back(std::move(job)); };
+
+    std::vector<std::shared_ptr<Executor>> executors = {
+        std::make_shared<InlineExecutor>(),
+        std::make_shared<WorkStealingScheduler>(3),
+        std::make_shared<SubmittingExecutor>(submit, 4),
+    };
+
+    for (auto &executor : executors)
+    {
+        Scheme scheme{TH(), CounterPRF(), SchedulerEncoding()};
+        scheme.executor = executor;
+        auto [pk, sk] = scheme.key_gen(0, 1 << LOG_LIFETIME);
+
+        std::vector<TH::Domain> leaves;
+        for (uint32_t epoch = 0; epoch < (1u << LOG_LIFETIME); epoch++)
+        {
+            std::vector<TH::Domain> ends;
+            for (uint8_t c = 0; c < SchedulerEncoding::DIMENSION; c++)
+            {
+                auto start = domain_from_bytes<TH::Domain>(prf.apply({}, epoch, c));
+                ends.push_back(chain(th, pk.parameter, epoch, c, 0, SchedulerEncoding::BASE - 1, start));
+            }
+            leaves.push_back(th.apply(pk.parameter, th.tree_tweak(0, epoch), std::span<const TH::Domain>(ends)));
+        }
+
+        auto tree = HashTree<TH>::NewHashTree(LOG_LIFETIME, 0, pk.parameter, leaves, th);
+        REQUIRE(tree.root() == pk.root);
+    }
+
+    for (std::thread &t : host_threads)
+    {
+        t.join();
+    }
+}
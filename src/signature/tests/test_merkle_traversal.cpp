@@ -0,0 +1,92 @@
+#include "catch_amalgamated.hpp"
+#include <functional>
+#include "../generalized_xmss.hpp"
+#include "../../symmetric/tree_hash.hpp"
+#include "../../symmetric/merkle_traversal.hpp"
+#include "SchemeFixtures.hpp"
+
+TEST_CASE("MerkleTraversal: co-paths of consecutive leaves match the stored tree")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+
+    for (uint height : {1u, 2u, 5u, 9u})
+    {
+        const uint32_t first = 3u << height;
+        std::vector<TH::Domain> leaves;
+        for (uint32_t i = 0; i < (1u << height); i++)
+        {
+            leaves.push_back(th.rand_domain());
+        }
+
+        for (uint32_t offset : {0u, 1u, (1u << height) / 2 + 1})
+        {
+            if (offset >= (1u << height))
+            {
+                continue;
+            }
+
+            TreeHash<TH> tree_hash(height, parameter, th, 0);
+            MerkleTraversal<TH>::StartNodes start(height, first, first + offset);
+            tree_hash.observe(std::ref(start));
+            tree_hash.push_leaves(first, leaves);
+            tree_hash.finish();
+            HashTree<TH> tree(height, tree_hash.take_layers());
+
+            size_t leaf_calls = 0;
+            size_t max_leaf_calls = 0;
+            size_t max_nodes = 0;
+            MerkleTraversal<TH> traversal(start, parameter, th, [&](uint32_t position)
+            {
+                leaf_calls++;
+                return leaves[position - first];
+            });
+
+            for (uint32_t position = first + offset;; position++)
+            {
+                REQUIRE(traversal.leaf() == position);
+                REQUIRE(traversal.co_path() == tree.path(position).co_path);
+                max_nodes = std::max(max_nodes, traversal.stored_nodes());
+                if (!traversal.has_next())
+                {
+                    break;
+                }
+                leaf_calls = 0;
+                traversal.next();
+                max_leaf_calls = std::max(max_leaf_calls, leaf_calls);
+            }
+
+            REQUIRE(max_leaf_calls <= 2 * height - 1);
+            REQUIRE(max_nodes <= 3 * height);
+            REQUIRE_THROWS_AS(traversal.next(), std::out_of_range);
+        }
+    }
+}
+
+TEST_CASE("key_gen: bottom tree traversal signs epochs in order and out of order")
+{
+    constexpr uint LOG_LIFETIME = 10;
+    using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, LOG_LIFETIME>;
+
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    scheme.bottom_tree_height = 6;
+    scheme.bottom_tree_traversal = true;
+    auto [pk, sk] = scheme.key_gen(64, 192);
+    REQUIRE(sk.split_tree->holds(1));
+
+    std::vector<uint8_t> message(32, 5);
+    for (uint32_t epoch = 70; epoch < 190; epoch += 3)
+    {
+        auto sig = scheme.sign(sk, epoch, message);
+        REQUIRE(sig.path.co_path.size() == LOG_LIFETIME);
+        REQUIRE(scheme.verify(pk, epoch, message, sig));
+    }
+    // the traversal of the next bottom tree is prepared ahead
+    REQUIRE(sk.split_tree->holds(3));
+
+    for (uint32_t epoch : {65u, 255u, 64u})
+    {
+        auto sig = scheme.sign(sk, epoch, message);
+        REQUIRE(scheme.verify(pk, epoch, message, sig));
+    }
+}
@@ -0,0 +1,171 @@
+#include "catch_amalgamated.hpp"
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include "../generalized_xmss.hpp"
+#include "../secret_key_file.hpp"
+#include "SchemeFixtures.hpp"
+
+constexpr uint LOG_LIFETIME = 8;
+using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, LOG_LIFETIME>;
+using SecretKey = Scheme::SecretKey;
+
+static std::string key_path(const std::string &name)
+{
+    return (std::filesystem::temp_directory_path() / name).string();
+}
+
+TEST_CASE("Secret key file: a mapped key signs like the original")
+{
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    auto [pk, sk] = scheme.key_gen(20, 200);
+
+    const std::string path = key_path("gxmss_test_key.bin");
+    // a staging file left behind by a crashed save is replaced
+    std::ofstream(path + ".tmp") << "stale";
+    save_secret_key(sk, path);
+    REQUIRE(!std::filesystem::exists(path + ".tmp"));
+    REQUIRE((std::filesystem::status(path).permissions() & std::filesystem::perms::all)
+            == (std::filesystem::perms::owner_read | std::filesystem::perms::owner_write));
+
+    SecretKey mapped = map_secret_key<CounterPRF, TH>(path);
+    REQUIRE(mapped.prf_key == sk.prf_key);
+    REQUIRE(mapped.parameter == sk.parameter);
+    REQUIRE(mapped.activation_epoch == 20);
+    REQUIRE(mapped.num_active_epochs == 200);
+    REQUIRE(mapped.tree.root() == pk.root);
+    REQUIRE(mapped.tree.num_layers() == sk.tree.num_layers());
+    REQUIRE(reinterpret_cast<uintptr_t>(mapped.tree.arena().data()) % 64 == 0);
+
+    std::vector<uint8_t> message(32, 9);
+    for (uint32_t epoch : {20u, 21u, 100u, 219u})
+    {
+        REQUIRE(mapped.tree.path(epoch).co_path == sk.tree.path(epoch).co_path);
+        auto sig = scheme.sign(mapped, epoch, message);
+        REQUIRE(scheme.verify(pk, epoch, message, sig));
+    }
+
+    // copies keep the mapping alive
+    std::optional<SecretKey> copy;
+    {
+        SecretKey first = map_secret_key<CounterPRF, TH>(path);
+        copy.emplace(first);
+    }
+    std::filesystem::remove(path);
+    REQUIRE(copy->tree.path(150).co_path == sk.tree.path(150).co_path);
+}
+
+TEST_CASE("Secret key file: a tiled tree is mapped in its layout")
+{
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    scheme.tree_tile_height = 3;
+    auto [pk, sk] = scheme.key_gen(7, 150);
+    REQUIRE(sk.tree.tree_tile_height() == 3);
+
+    const std::string path = key_path("gxmss_test_key_tiled.bin");
+    save_secret_key(sk, path);
+    SecretKey mapped = map_secret_key<CounterPRF, TH>(path);
+    std::filesystem::remove(path);
+
+    REQUIRE(mapped.tree.tree_tile_height() == 3);
+    REQUIRE(mapped.tree.root() == pk.root);
+    std::vector<uint8_t> message(32, 1);
+    for (uint32_t epoch = 7; epoch < 157; epoch += 10)
+    {
+        REQUIRE(mapped.tree.path(epoch).co_path == sk.tree.path(epoch).co_path);
+        auto sig = scheme.sign(mapped, epoch, message);
+        REQUIRE(scheme.verify(pk, epoch, message, sig));
+    }
+}
+
+TEST_CASE("Secret key file: rejects files of another version or a truncated tree")
+{
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    auto [pk, sk] = scheme.key_gen(0, 64);
+
+    const std::string path = key_path("gxmss_test_key_bad.bin");
+    save_secret_key(sk, path);
+    const auto size = std::filesystem::file_size(path);
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(SecretKeyFileHeader, version));
+        uint32_t version = SecretKeyFileHeader::VERSION + 1;
+        file.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    }
+    REQUIRE_THROWS_AS((map_secret_key<CounterPRF, TH>(path)), std::runtime_error);
+
+    // leaf layers that run past the last leaf, and root layers past their pair, are rejected
+    for (uint l : {0u, LOG_LIFETIME})
+    {
+        save_secret_key(sk, path);
+        const auto layer = sizeof(SecretKeyFileHeader) + sk.prf_key.size() + sizeof(TH::Parameter) + l * sizeof(SecretKeyFileLayer);
+        const uint64_t width = l == 0 ? uint64_t{1} << LOG_LIFETIME : 2;
+        uint64_t start_index = width - sk.tree.layer(l).size + 1;
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(layer + offsetof(SecretKeyFileLayer, start_index));
+        file.write(reinterpret_cast<const char *>(&start_index), sizeof(start_index));
+        file.close();
+        REQUIRE_THROWS_AS((map_secret_key<CounterPRF, TH>(path)), std::runtime_error);
+    }
+
+    save_secret_key(sk, path);
+    std::filesystem::resize_file(path, size - 1);
+    REQUIRE_THROWS_AS((map_secret_key<CounterPRF, TH>(path)), std::runtime_error);
+
+    std::filesystem::remove(path);
+    REQUIRE_THROWS_AS((map_secret_key<CounterPRF, TH>(path)), std::runtime_error);
+
+    // split keys do not hold the tree
+    scheme.bottom_tree_height = 4;
+    auto [split_pk, split_sk] = scheme.key_gen(0, 64);
+    REQUIRE_THROWS_AS(save_secret_key(split_sk, path), std::invalid_argument);
+}
+
+TEST_CASE("Secret key file: rejects a header whose tables or arena lie past the end of the file")
+{
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    auto [pk, sk] = scheme.key_gen(0, 64);
+
+    const std::string path = key_path("gxmss_test_key_header.bin");
+    auto map_with = [&](auto change)
+    {
+        save_secret_key(sk, path);
+        SecretKeyFileHeader header;
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        change(header);
+        file.seekp(0);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.close();
+        return map_secret_key<CounterPRF, TH>(path);
+    };
+    save_secret_key(sk, path);
+    const uint64_t size = std::filesystem::file_size(path);
+    const uint64_t alignment = SecretKeyFileHeader::ARENA_ALIGNMENT;
+
+    // a huge PRF key and an empty arena after it: the size checks alone pass
+    REQUIRE_THROWS_AS(map_with([&](SecretKeyFileHeader &header)
+    {
+        header.prf_key_size = 1u << 30;
+        header.arena_offset = (sizeof(header) + header.prf_key_size + header.parameter_size
+                               + header.num_layers * sizeof(SecretKeyFileLayer) + alignment - 1) / alignment * alignment;
+        header.arena_nodes = 0;
+    }), std::runtime_error);
+
+    // an empty arena past the end of the file
+    REQUIRE_THROWS_AS(map_with([&](SecretKeyFileHeader &header)
+    {
+        header.arena_offset = (size + alignment) / alignment * alignment;
+        header.arena_nodes = 0;
+    }), std::runtime_error);
+
+    REQUIRE_THROWS_AS(map_with([&](SecretKeyFileHeader &header) { header.tile_height = header.depth + 1; }),
+                      std::runtime_error);
+
+    // the unchanged header still maps
+    REQUIRE(map_with([](SecretKeyFileHeader &) {}).tree.root() == sk.tree.root());
+
+    std::filesystem::remove(path);
+}
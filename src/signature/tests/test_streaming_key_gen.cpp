@@ -0,0 +1,251 @@
+#include "catch_amalgamated.hpp"
+#include <stdexcept>
+#include "../generalized_xmss.hpp"
+#include "../../symmetric/tree_hash.hpp"
+#include "../../symmetric/split_hash_tree.hpp"
+#include <atomic>
+#include "SchemeFixtures.hpp"
+
+static std::vector<TH::Domain> random_leaves(TH &th, size_t n)
+{
+    std::vector<TH::Domain> leaves;
+    for (size_t i = 0; i < n; i++)
+    {
+        leaves.push_back(th.rand_domain());
+    }
+    return leaves;
+}
+
+TEST_CASE("TreeHash: same root as NewHashTree for a full tree")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+    auto leaves = random_leaves(th, 64);
+
+    auto tree = HashTree<TH>::NewHashTree(6, 0, parameter, leaves, th);
+
+    TreeHash<TH> tree_hash(6, parameter, th);
+    tree_hash.push_leaves(0, leaves);
+    REQUIRE(tree_hash.stack_size() == 1);
+    REQUIRE(tree_hash.finish() == tree.root());
+
+    // the same tree from subtree roots of height 2
+    TreeHash<TH> from_subtrees(6, parameter, th);
+    for (uint32_t s = 0; s < 16; s++)
+    {
+        TreeHash<TH> subtree(2, parameter, th);
+        subtree.push_leaves(4 * s, std::span<const TH::Domain>(leaves).subspan(4 * s, 4));
+        from_subtrees.push(2, s, subtree.finish());
+    }
+    REQUIRE(from_subtrees.finish() == tree.root());
+}
+
+TEST_CASE("TreeHash: retained layers open every leaf of a padded range")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+
+    for (uint32_t start : {0u, 3u, 5u})
+    {
+        auto leaves = random_leaves(th, 11);
+
+        TreeHash<TH> tree_hash(8, parameter, th, 0);
+        tree_hash.push_leaves(start, leaves);
+        REQUIRE(tree_hash.stack_size() <= 8);
+        auto root = tree_hash.finish();
+        HashTree<TH> tree(8, tree_hash.take_layers());
+        REQUIRE(tree.root() == root);
+
+        for (uint32_t i = 0; i < leaves.size(); i++)
+        {
+            auto opening = tree.path(start + i);
+            REQUIRE(opening.co_path.size() == 8);
+
+            auto node = leaves[i];
+            uint32_t position = start + i;
+            for (uint l = 0; l < 8; l++)
+            {
+                TH::Domain children[2];
+                children[position % 2] = node;
+                children[1 - position % 2] = opening.co_path[l];
+                position >>= 1;
+                node = th.apply(parameter, th.tree_tweak(static_cast<uint8_t>(l + 1), position),
+                                std::span<const TH::Domain>(children));
+            }
+            REQUIRE(node == root);
+        }
+    }
+}
+
+TEST_CASE("TreeHash: rejects nodes out of order")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+    auto leaves = random_leaves(th, 4);
+
+    TreeHash<TH> tree_hash(4, parameter, th);
+    tree_hash.push(0, 0, leaves[0]);
+    REQUIRE_THROWS_AS(tree_hash.push(0, 2, leaves[2]), std::invalid_argument);
+    REQUIRE_THROWS_AS(tree_hash.push(1, 1, leaves[1]), std::invalid_argument);
+    tree_hash.push(0, 1, leaves[1]);
+    tree_hash.push(1, 1, leaves[2]);
+    REQUIRE_THROWS_AS(tree_hash.push(5, 0, leaves[3]), std::invalid_argument);
+}
+
+TEST_CASE("SplitHashTree: co-paths match the full tree and the next bottom tree is prepared")
+{
+    TH th;
+    auto parameter = th.rand_parameter();
+    auto leaves = random_leaves(th, 64);
+    auto full = HashTree<TH>::NewHashTree(6, 0, parameter, leaves, th);
+
+    // bottom trees of 8 leaves under a top tree of depth 3
+    TreeHash<TH> top_hash(6, parameter, th, 3);
+    top_hash.push_leaves(0, leaves);
+    top_hash.finish();
+
+    std::atomic<int> builds{0};
+    auto build = [&](uint32_t bottom)
+    {
+        builds++;
+        TreeHash<TH> bottom_hash(3, parameter, th, 0);
+        bottom_hash.push_leaves(8 * bottom, std::span<const TH::Domain>(leaves).subspan(8 * bottom, 8));
+        bottom_hash.finish();
+        return HashTree<TH>(3, bottom_hash.take_layers());
+    };
+
+    SplitHashTree<TH> split(6, 3, 0, 8, HashTree<TH>(3, top_hash.take_layers()), build);
+    REQUIRE(split.root() == full.root());
+
+    for (uint32_t position = 0; position < 64; position++)
+    {
+        REQUIRE(split.path(position).co_path == full.path(position).co_path);
+        REQUIRE(split.holds(position / 8));
+        if (position / 8 + 1 < 8)
+        {
+            REQUIRE(split.holds(position / 8 + 1));
+        }
+    }
+    // every bottom tree is built once when the epochs are used in order
+    REQUIRE(builds == 8);
+
+    // jumping back rebuilds
+    REQUIRE(split.path(3).co_path == full.path(3).co_path);
+    REQUIRE_FALSE(split.holds(7));
+    REQUIRE_THROWS_AS(split.path(64), std::invalid_argument);
+}
+
+TEST_CASE("key_gen: streaming builds the same tree as keeping every layer")
+{
+    constexpr uint LOG_LIFETIME = 8;
+    using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, LOG_LIFETIME>;
+
+    TH th;
+    CounterPRF prf;
+    std::vector<uint8_t> message(32, 3);
+
+    for (uint h : {1u, 4u, 8u})
+    {
+        Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+        scheme.bottom_tree_height = h;
+        auto [pk, sk] = scheme.key_gen(0, 1 << LOG_LIFETIME);
+        REQUIRE(sk.split_tree->bottom_height == h);
+
+        std::vector<TH::Domain> leaves;
+        for (uint32_t epoch = 0; epoch < (1u << LOG_LIFETIME); epoch++)
+        {
+            std::vector<TH::Domain> ends;
+            for (uint8_t c = 0; c < FixedEncoding::DIMENSION; c++)
+            {
+                auto start = domain_from_bytes<TH::Domain>(prf.apply({}, epoch, c));
+                ends.push_back(chain(th, pk.parameter, epoch, c, 0, FixedEncoding::BASE - 1, start));
+            }
+            leaves.push_back(th.apply(pk.parameter, th.tree_tweak(0, epoch), std::span<const TH::Domain>(ends)));
+        }
+        auto tree = HashTree<TH>::NewHashTree(LOG_LIFETIME, 0, pk.parameter, leaves, th);
+        REQUIRE(tree.root() == pk.root);
+
+        for (uint32_t epoch : {0u, 77u, 255u})
+        {
+            auto sig = scheme.sign(sk, epoch, message);
+            REQUIRE(sig.path.co_path == tree.path(epoch).co_path);
+            REQUIRE(scheme.verify(pk, epoch, message, sig));
+        }
+    }
+}
+
+TEST_CASE("key_gen: streaming a 2^32 lifetime key")
+{
+    constexpr uint LOG_LIFETIME = 32;
+    using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, LOG_LIFETIME>;
+
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    scheme.bottom_tree_height = 6;
+
+    // the active range is widened to whole bottom trees of 64 epochs
+    const uint activation = 0xfffff000u + 70;
+    auto [pk, sk] = scheme.key_gen(activation, 100);
+    REQUIRE(sk.activation_epoch == 0xfffff000u + 64);
+    REQUIRE(sk.num_active_epochs == 128);
+
+    std::vector<uint8_t> message(32, 4);
+    for (uint32_t epoch : {0xfffff000u + 64, 0xfffff000u + 100, 0xfffff000u + 191})
+    {
+        auto sig = scheme.sign(sk, epoch, message);
+        REQUIRE(sig.path.co_path.size() == LOG_LIFETIME);
+        REQUIRE(scheme.verify(pk, epoch, message, sig));
+        REQUIRE_FALSE(scheme.verify(pk, epoch + 1, message, sig));
+    }
+}
+
+TEST_CASE("key_gen: a streaming key can sign the last epoch of a 2^32 lifetime")
+{
+    constexpr uint LOG_LIFETIME = 32;
+    using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, LOG_LIFETIME>;
+
+    Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+    scheme.bottom_tree_height = 6;
+
+    std::vector<uint8_t> message(32, 4);
+    auto [pk, sk] = scheme.key_gen(0xffffffffu - 10, 11);
+    REQUIRE(uint64_t{sk.activation_epoch} + sk.num_active_epochs == uint64_t{1} << 32);
+
+    auto sig = scheme.sign(sk, 0xffffffffu, message);
+    REQUIRE(scheme.verify(pk, 0xffffffffu, message, sig));
+
+    // a key active over the whole lifetime counts 2^32 epochs; streaming all of them is out of
+    // reach for a test, so give the key above that range and sign its last epoch again
+    Scheme::SecretKey whole(sk.prf_key, sk.tree, sk.parameter, 0, uint64_t{1} << 32, sk.checkpoints, sk.split_tree);
+    REQUIRE(whole.num_active_epochs == uint64_t{1} << 32);
+    auto whole_sig = scheme.sign(whole, 0xffffffffu, message);
+    REQUIRE(scheme.verify(pk, 0xffffffffu, message, whole_sig));
+}
+
+TEST_CASE("sign: a split key signs from inside a task of its own pool")
+{
+    constexpr uint LOG_LIFETIME = 6;
+    using Scheme = SignatureScheme<CounterPRF, FixedEncoding, TH, LOG_LIFETIME>;
+
+    for (bool traversal : {false, true})
+    {
+        Scheme scheme{TH(), CounterPRF(), FixedEncoding()};
+        auto pool = std::make_shared<WorkStealingScheduler>(4);
+        scheme.executor = pool;
+        scheme.bottom_tree_height = 3;
+        scheme.bottom_tree_traversal = traversal;
+        auto [pk, sk] = scheme.key_gen(0, 1 << LOG_LIFETIME);
+
+        // the bottom trees prepared in the background need the pool, which runs this call
+        std::vector<uint8_t> message(32, 5);
+        std::vector<std::optional<Scheme::Signature>> signatures(1 << LOG_LIFETIME);
+        pool->parallel_for(signatures.size(), [&](size_t epoch, unsigned)
+        {
+            signatures[epoch].emplace(scheme.sign(sk, static_cast<uint32_t>(epoch), message));
+        });
+
+        for (uint32_t epoch = 0; epoch < signatures.size(); epoch++)
+        {
+            REQUIRE(scheme.verify(pk, epoch, message, *signatures[epoch]));
+        }
+    }
+}
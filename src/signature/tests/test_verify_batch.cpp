@@ -0,0 +1,216 @@
+#include "catch_amalgamated.hpp"
+#include <atomic>
+#include <future>
+#include <thread>
+#include "../generalized_xmss.hpp"
+#include "../../work_stealing.hpp"
+#include "SchemeFixtures.hpp"
+
+// the chain positions depend on the message, so a changed message is caught by the chains
+struct MessageEncoding
+{
+    using param = TH::Parameter;
+    using Randomness = int;
+
+    static constexpr uint DIMENSION = 8;
+    static constexpr uint BASE = 4;
+    static constexpr uint MAX_TRIES = 1;
+
+    static Randomness rand() { return 0; }
+
+    static std::vector<uint8_t> encode(param, std::vector<uint8_t> &message, Randomness, uint32_t epoch)
+    {
+        std::vector<uint8_t> x(DIMENSION);
+        for (uint i = 0; i < DIMENSION; i++)
+        {
+            x[i] = static_cast<uint8_t>((message[i % message.size()] + i + epoch) % BASE);
+        }
+        return x;
+    }
+};
+
+template <uint ARITY>
+void check_verify_batch(std::shared_ptr<Executor> executor)
+{
+    constexpr uint LOG_LIFETIME = 6;
+    using Scheme = SignatureScheme<CounterPRF, MessageEncoding, TH, LOG_LIFETIME, ARITY>;
+    using Signature = typename Scheme::Signature;
+
+    Scheme scheme{TH(), CounterPRF(), MessageEncoding()};
+    scheme.executor = executor;
+
+    // three keys, so that every task mixes parameters
+    std::vector<typename Scheme::PublicKey> pks;
+    std::vector<typename Scheme::SecretKey> sks;
+    for (int k = 0; k < 3; k++)
+    {
+        auto [pk, sk] = scheme.key_gen(0, 1 << LOG_LIFETIME);
+        pks.push_back(pk);
+        sks.push_back(sk);
+    }
+
+    std::vector<std::vector<uint8_t>> messages;
+    std::vector<Signature> signatures;
+    std::vector<uint32_t> epochs;
+    std::vector<size_t> signers;
+    for (uint32_t i = 0; i < 150; i++)
+    {
+        const size_t signer = i % pks.size();
+        const uint32_t epoch = (7 * i) % (1u << LOG_LIFETIME);
+        messages.push_back(std::vector<uint8_t>(32, static_cast<uint8_t>(i)));
+        signatures.push_back(scheme.sign(sks[signer], epoch, messages.back()));
+        epochs.push_back(epoch);
+        signers.push_back(signer);
+    }
+
+    // corrupt some items: another message, another epoch, another key, a wrong co-path node,
+    // a co-path of the wrong length and an epoch outside the lifetime
+    std::vector<uint8_t> other_message(32, 0xee);
+    std::vector<TH::Domain> bad_co_path = signatures[4].path.co_path;
+    bad_co_path.back()[0] ^= 1;
+    std::vector<TH::Domain> short_co_path(signatures[9].path.co_path.begin(), signatures[9].path.co_path.end() - 1);
+    Signature bad_path(HashTreeOpening<TH, ARITY>(bad_co_path), signatures[4].rho, signatures[4].hashes);
+    Signature short_path(HashTreeOpening<TH, ARITY>(short_co_path), signatures[9].rho, signatures[9].hashes);
+    signatures.push_back(bad_path);
+    signatures.push_back(short_path);
+    const size_t bad_path_signature = signatures.size() - 2;
+    const size_t short_path_signature = signatures.size() - 1;
+
+    std::vector<typename Scheme::BatchItem> items;
+    for (size_t i = 0; i < epochs.size(); i++)
+    {
+        const auto &pk = pks[i == 3 ? (signers[i] + 1) % pks.size() : signers[i]];
+        const uint32_t epoch = i == 2 ? epochs[i] + 1 : i == 100 ? 1u << LOG_LIFETIME : epochs[i];
+        std::vector<uint8_t> &message = i == 1 ? other_message : messages[i];
+        const Signature &sig = signatures[i == 4 ? bad_path_signature : i == 9 ? short_path_signature : i];
+        items.push_back({pk, epoch, message, sig});
+    }
+
+    std::vector<bool> valid = scheme.verify_batch(items);
+
+    REQUIRE(valid.size() == items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        auto &item = items[i];
+        const bool expected = i != 1 && i != 2 && i != 3 && i != 4 && i != 9 && i != 100;
+        REQUIRE(valid[i] == expected);
+        REQUIRE(scheme.verify(const_cast<typename Scheme::PublicKey &>(item.pk), item.epoch, item.message,
+                              const_cast<Signature &>(item.sig)) == expected);
+    }
+
+    // too few chain ends
+    std::vector<TH::Domain> short_hashes(signatures[5].hashes.begin(), signatures[5].hashes.end() - 1);
+    Signature short_chains(signatures[5].path, signatures[5].rho, short_hashes);
+    REQUIRE(!scheme.verify(pks[signers[5]], epochs[5], messages[5], short_chains));
+
+    REQUIRE(scheme.verify_batch({}).empty());
+}
+
+TEST_CASE("verify_batch: matches verify for valid and corrupted signatures")
+{
+    std::vector<std::shared_ptr<Executor>> executors = {
+        std::make_shared<InlineExecutor>(),
+        std::make_shared<WorkStealingScheduler>(4),
+    };
+
+    for (auto &executor : executors)
+    {
+        check_verify_batch<2>(executor);
+        check_verify_batch<4>(executor);
+        check_verify_batch<8>(executor);
+    }
+}
+
+// enough chains for a parallel verify to cut them into several parts
+struct WideEncoding
+{
+    using param = TH::Parameter;
+    using Randomness = int;
+
+    static constexpr uint DIMENSION = 64;
+    static constexpr uint BASE = 16;
+    static constexpr uint MAX_TRIES = 1;
+
+    static Randomness rand() { return 0; }
+
+    static std::vector<uint8_t> encode(param, std::vector<uint8_t> &message, Randomness, uint32_t epoch)
+    {
+        std::vector<uint8_t> x(DIMENSION);
+        for (uint i = 0; i < DIMENSION; i++)
+        {
+            x[i] = static_cast<uint8_t>((message[i % message.size()] * (i + 1) + epoch) % BASE);
+        }
+        return x;
+    }
+};
+
+TEST_CASE("verify: chains completed in parallel parts give the same result")
+{
+    constexpr uint LOG_LIFETIME = 4;
+    using Scheme = SignatureScheme<CounterPRF, WideEncoding, TH, LOG_LIFETIME>;
+
+    std::vector<std::shared_ptr<Executor>> executors = {
+        std::make_shared<InlineExecutor>(),
+        std::make_shared<WorkStealingScheduler>(4),
+    };
+
+    for (auto &executor : executors)
+    {
+        Scheme scheme{TH(), CounterPRF(), WideEncoding()};
+        scheme.executor = executor;
+        scheme.verify_executor = executor;
+        auto [pk, sk] = scheme.key_gen(0, 1 << LOG_LIFETIME);
+
+        std::vector<uint8_t> other_message(32, 0xee);
+        for (uint32_t epoch = 0; epoch < (1u << LOG_LIFETIME); epoch += 3)
+        {
+            std::vector<uint8_t> message(32, static_cast<uint8_t>(epoch + 1));
+            auto sig = scheme.sign(sk, epoch, message);
+
+            for (uint parallelism : {1u, 2u, 3u, 8u, 100u})
+            {
+                scheme.verify_parallelism = parallelism;
+                REQUIRE(scheme.verify(pk, epoch, message, sig));
+                REQUIRE(!scheme.verify(pk, epoch, other_message, sig));
+                REQUIRE(!scheme.verify(pk, epoch ^ 1, message, sig));
+            }
+        }
+    }
+}
+
+TEST_CASE("verify: a parallel verify does not wait for work on the key generation pool")
+{
+    constexpr uint LOG_LIFETIME = 4;
+    using Scheme = SignatureScheme<CounterPRF, WideEncoding, TH, LOG_LIFETIME>;
+
+    Scheme scheme{TH(), CounterPRF(), WideEncoding()};
+    auto [pk, sk] = scheme.key_gen(0, 1 << LOG_LIFETIME);
+    std::vector<uint8_t> message(32, 3);
+    auto sig = scheme.sign(sk, 5, message);
+
+    // a long job holds the key generation pool until the verify is done
+    auto key_gen_pool = std::make_shared<WorkStealingScheduler>(2);
+    scheme.executor = key_gen_pool;
+    scheme.verify_executor = std::make_shared<WorkStealingScheduler>(4);
+    scheme.verify_parallelism = 4;
+
+    std::promise<void> verified;
+    std::shared_future<void> verified_future = verified.get_future().share();
+    std::atomic<bool> holding{false};
+    std::thread holder([&]
+    {
+        key_gen_pool->parallel_for(1, [&](size_t, unsigned)
+        {
+            holding = true;
+            verified_future.wait();
+        });
+    });
+    while (!holding)
+    {
+        std::this_thread::yield();
+    }
+
+    REQUIRE(scheme.verify(pk, 5, message, sig));
+    verified.set_value();
+    holder.join();
+}
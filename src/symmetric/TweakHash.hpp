@@ -3,6 +3,13 @@
 #include <openssl/rand.h>
 #include <cstdint>
 #include <memory>
+#include <algorithm>
+#include <vector>
+#include <span>
+#include <stdexcept>
+#include <concepts>
+#include <type_traits>
+#include "chain_states.hpp"
 
 template <typename Parameter_i, typename Tweak_i, typename Domain_i>
 struct TweakableHash {
@@ -16,29 +23,251 @@ struct TweakableHash {
 
     /// Returns a tweak to be used in the Merkle tree.
     /// Note: this is assumed to be distinct from the outputs of chain_tweak
-    virtual std::unique_ptr<Tweak> tree_tweak(uint8_t level, uint32_t pos_in_level) = 0;
+    virtual Tweak tree_tweak(uint8_t level, uint32_t pos_in_level) = 0;
 
     /// Returns a tweak to be used in chains.
     /// Note: this is assumed to be distinct from the outputs of tree_tweak
-    virtual std::unique_ptr<Tweak> chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) = 0;
+    virtual Tweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) = 0;
 
     /// Applies the tweakable hash to parameter, tweak, and message.
-    virtual Domain apply(Parameter parameter, Tweak& tweak, Domain&) = 0;
+    virtual Domain apply(Parameter parameter, const Tweak& tweak, Domain&) = 0;
 
     virtual void internal_consistency_check() = 0;
 };
 
+/// Builds a domain value from raw bytes, e.g. a PRF output used as a chain start.
+/// Fixed-size domains (`std::array`) take the first N bytes; vector domains take all of them.
+/// Domains of field elements take 8 little-endian bytes per element, reduced into the field.
+/// Both of these throw std::invalid_argument if `bytes` is shorter than the domain: the missing
+/// part of every chain start would be a constant.
+template <typename Domain>
+Domain domain_from_bytes(const std::vector<uint8_t> &bytes) {
+    if constexpr (std::is_same_v<Domain, std::vector<uint8_t>>) {
+        return bytes;
+    } else if constexpr (std::is_same_v<typename Domain::value_type, uint8_t>) {
+        Domain domain{};
+        if (bytes.size() < domain.size()) {
+            throw std::invalid_argument("domain_from_bytes: fewer bytes than the domain holds");
+        }
+        std::copy_n(bytes.begin(), domain.size(), domain.begin());
+        return domain;
+    } else {
+        Domain domain{};
+        if (bytes.size() < 8 * domain.size()) {
+            throw std::invalid_argument("domain_from_bytes: fewer than 8 bytes per field element");
+        }
+        for (size_t i = 0; i < domain.size(); i++) {
+            uint64_t value = 0;
+            for (size_t b = 0; b < 8; b++) {
+                value |= static_cast<uint64_t>(bytes[8 * i + b]) << (8 * b);
+            }
+            domain[i] = Domain::value_type::from_u64(value);
+        }
+        return domain;
+    }
+}
+
+/// A tweakable hash that can also hash a group of independent inputs under one parameter at once.
+/// Input i of `apply_many` is `tweaks[i]` together with the concatenation of `messages[i]`.
+template <typename TH>
+concept BatchTweakableHash_c = requires(TH th, const typename TH::Parameter &parameter,
+                                        const std::vector<typename TH::Tweak> &tweaks,
+                                        std::vector<std::span<const typename TH::Domain>> &messages) {
+    { th.apply_many(parameter, tweaks, messages) } -> std::same_as<std::vector<typename TH::Domain>>;
+};
+
+/// A batch hash whose inputs may each come under their own parameter, e.g. the chains of
+/// signatures by different keys. Input i is `*parameters[i]`, `tweaks[i]` and the
+/// concatenation of `messages[i]`.
+template <typename TH>
+concept MultiKeyBatchTweakableHash_c = requires(TH th, const std::vector<const typename TH::Parameter *> &parameters,
+                                                const std::vector<typename TH::Tweak> &tweaks,
+                                                std::vector<std::span<const typename TH::Domain>> &messages) {
+    { th.apply_many(parameters, tweaks, messages) } -> std::same_as<std::vector<typename TH::Domain>>;
+};
+
+/// Hashes input i = (*parameters[i], tweaks[i], concatenation of messages[i]) for every i,
+/// all at once if TH supports multi-key `apply_many`, else one by one.
+template <typename TH>
+std::vector<typename TH::Domain> apply_many_keys(TH &th, const std::vector<const typename TH::Parameter *> &parameters,
+     const std::vector<typename TH::Tweak> &tweaks, std::vector<std::span<const typename TH::Domain>> &messages) {
+    if constexpr (MultiKeyBatchTweakableHash_c<TH>) {
+        return th.apply_many(parameters, tweaks, messages);
+    } else {
+        std::vector<typename TH::Domain> results;
+        results.reserve(messages.size());
+        for (size_t i = 0; i < messages.size(); i++) {
+            results.push_back(th.apply(*parameters[i], tweaks[i], messages[i]));
+        }
+        return results;
+    }
+}
+
+/// A chain tweak that can be moved along its chain in place, see `EncodedTweak`.
+/// Chains then build their tweak once and only patch the position at every step.
+template <typename Tweak>
+concept PatchableChainTweak_c = requires(Tweak tweak, uint8_t pos_in_chain) {
+    tweak.set_pos_in_chain(pos_in_chain);
+};
+
 template <typename TH>
-typename TH::Domain chain(TH &th, typename TH::Parameter &parameter,
+typename TH::Domain chain(TH &th, const typename TH::Parameter &parameter,
      uint32_t epoch, uint8_t chain_index, uint8_t start_pos_in_chain, uint steps, typename TH::Domain &start) {
     using TH_domain = typename TH::Domain;
     
     TH_domain current = start;
+    auto tweak = th.chain_tweak(epoch, chain_index, start_pos_in_chain + static_cast<uint8_t>(1));
 
     for(uint j = 0; j < steps; j++) {
-        typename TH::Tweak tweak = th.chain_tweak(epoch, chain_index, start_pos_in_chain + static_cast<uint8_t>(j) + static_cast<uint8_t>(1));
-        current = th.apply(parameter, &tweak, current.data());
+        uint8_t pos_in_chain = start_pos_in_chain + static_cast<uint8_t>(j) + static_cast<uint8_t>(1);
+        if constexpr (PatchableChainTweak_c<typename TH::Tweak>) {
+            tweak.set_pos_in_chain(pos_in_chain);
+        } else {
+            tweak = th.chain_tweak(epoch, chain_index, pos_in_chain);
+        }
+        current = th.apply(parameter, tweak, current);
     }
 
     return current;
-}
\ No newline at end of file
+}
+
+/// One chain for `walk_chains`: chain `chain_index` of `epoch`, whose current value sits at
+/// position `start_pos_in_chain`, to be advanced `steps` times.
+struct ChainJob {
+    uint32_t epoch;
+    uint8_t chain_index;
+    uint8_t start_pos_in_chain;
+    uint steps;
+};
+
+/// Advances many chains in lockstep, possibly from different epochs. Chain i is described
+/// by `jobs[i]` and its value is `states[i]`; on return `states[i]` holds the end of the chain.
+///
+/// If TH supports `apply_many`, every step hashes all chains that still have steps left as
+/// one group, so the multi-lane kernels see DIMENSION times the number of epochs inputs per
+/// call. A chain drops out of the group as soon as it reaches its target position, which
+/// keeps the group dense when the step counts differ, as in `verify`. Otherwise each chain
+/// is walked with `chain`.
+template <typename TH>
+void walk_chains(TH &th, const typename TH::Parameter &parameter, const std::vector<ChainJob> &jobs,
+     ChainStates<TH> &states) {
+    using TH_domain = typename TH::Domain;
+    using TH_tweak = typename TH::Tweak;
+
+    if constexpr (BatchTweakableHash_c<TH>) {
+        // one tweak per chain, moved along the chain at every step
+        std::vector<TH_tweak> chain_tweaks;
+        chain_tweaks.reserve(jobs.size());
+        std::vector<size_t> live;
+        live.reserve(jobs.size());
+        for (size_t i = 0; i < jobs.size(); i++) {
+            chain_tweaks.push_back(th.chain_tweak(jobs[i].epoch, jobs[i].chain_index, jobs[i].start_pos_in_chain));
+            if (jobs[i].steps > 0) {
+                live.push_back(i);
+            }
+        }
+
+        std::vector<TH_tweak> tweaks;
+        std::vector<std::span<const TH_domain>> messages;
+        tweaks.reserve(live.size());
+        messages.reserve(live.size());
+
+        for (uint j = 0; !live.empty(); j++) {
+            tweaks.clear();
+            messages.clear();
+
+            for (size_t i : live) {
+                uint8_t pos_in_chain = jobs[i].start_pos_in_chain + static_cast<uint8_t>(j) + static_cast<uint8_t>(1);
+                if constexpr (PatchableChainTweak_c<TH_tweak>) {
+                    chain_tweaks[i].set_pos_in_chain(pos_in_chain);
+                } else {
+                    chain_tweaks[i] = th.chain_tweak(jobs[i].epoch, jobs[i].chain_index, pos_in_chain);
+                }
+                tweaks.push_back(chain_tweaks[i]);
+                messages.emplace_back(states.data() + i, 1);
+            }
+
+            std::vector<TH_domain> next = th.apply_many(parameter, tweaks, messages);
+            for (size_t k = 0; k < live.size(); k++) {
+                states[live[k]] = std::move(next[k]);
+            }
+
+            // drop the chains that reached their end
+            std::erase_if(live, [&](size_t i) { return jobs[i].steps == j + 1; });
+        }
+    } else {
+        for (size_t i = 0; i < jobs.size(); i++) {
+            const ChainJob &job = jobs[i];
+            states[i] = chain<TH>(th, parameter, job.epoch, job.chain_index, job.start_pos_in_chain, job.steps, states[i]);
+        }
+    }
+}
+
+/// Walks several chains of the same epoch together, see `walk_chains`.
+/// Chain i has index `chain_indices[i]`, starts with value `starts[i]` at position `start_pos_in_chain[i]`
+/// and is advanced `steps[i]` times. Returns the end of every chain, in input order.
+template <typename TH>
+std::vector<typename TH::Domain> chain_many(TH &th, const typename TH::Parameter &parameter, uint32_t epoch,
+     const std::vector<uint8_t> &chain_indices, const std::vector<uint8_t> &start_pos_in_chain,
+     const std::vector<uint> &steps, const std::vector<typename TH::Domain> &starts) {
+    std::vector<ChainJob> jobs;
+    jobs.reserve(starts.size());
+    for (size_t i = 0; i < starts.size(); i++) {
+        jobs.push_back(ChainJob{epoch, chain_indices[i], start_pos_in_chain[i], steps[i]});
+    }
+
+    ChainStates<TH> states{std::span<const typename TH::Domain>(starts)};
+    walk_chains<TH>(th, parameter, jobs, states);
+    return states.to_vector();
+}
+
+/// Advances many chains in lockstep like `walk_chains`, chain i under `*parameters[i]`, so
+/// that the chains of signatures by different keys share the multi-lane kernels of a
+/// `MultiKeyBatchTweakableHash_c`.
+template <typename TH>
+void walk_chains(TH &th, const std::vector<const typename TH::Parameter *> &parameters,
+     const std::vector<ChainJob> &jobs, ChainStates<TH> &states) {
+    using TH_domain = typename TH::Domain;
+    using TH_tweak = typename TH::Tweak;
+
+    std::vector<TH_tweak> chain_tweaks;
+    chain_tweaks.reserve(jobs.size());
+    std::vector<size_t> live;
+    live.reserve(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        chain_tweaks.push_back(th.chain_tweak(jobs[i].epoch, jobs[i].chain_index, jobs[i].start_pos_in_chain));
+        if (jobs[i].steps > 0) {
+            live.push_back(i);
+        }
+    }
+
+    std::vector<const typename TH::Parameter *> live_parameters;
+    std::vector<TH_tweak> tweaks;
+    std::vector<std::span<const TH_domain>> messages;
+
+    for (uint j = 0; !live.empty(); j++) {
+        live_parameters.clear();
+        tweaks.clear();
+        messages.clear();
+
+        for (size_t i : live) {
+            uint8_t pos_in_chain = jobs[i].start_pos_in_chain + static_cast<uint8_t>(j) + static_cast<uint8_t>(1);
+            if constexpr (PatchableChainTweak_c<TH_tweak>) {
+                chain_tweaks[i].set_pos_in_chain(pos_in_chain);
+            } else {
+                chain_tweaks[i] = th.chain_tweak(jobs[i].epoch, jobs[i].chain_index, pos_in_chain);
+            }
+            live_parameters.push_back(parameters[i]);
+            tweaks.push_back(chain_tweaks[i]);
+            messages.emplace_back(states.data() + i, 1);
+        }
+
+        std::vector<TH_domain> next = apply_many_keys(th, live_parameters, tweaks, messages);
+        for (size_t k = 0; k < live.size(); k++) {
+            states[live[k]] = std::move(next[k]);
+        }
+
+        // drop the chains that reached their end
+        std::erase_if(live, [&](size_t i) { return jobs[i].steps == j + 1; });
+    }
+}
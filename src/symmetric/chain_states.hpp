@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <span>
+#include <type_traits>
+
+/// Allocator whose allocations start on a cache-line boundary.
+template <typename T>
+struct CacheAlignedAllocator {
+    using value_type = T;
+
+    static constexpr std::size_t ALIGNMENT = 64;
+
+    CacheAlignedAllocator() = default;
+
+    template <typename U>
+    CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{ALIGNMENT}));
+    }
+
+    void deallocate(T *p, std::size_t) {
+        ::operator delete(p, std::align_val_t{ALIGNMENT});
+    }
+
+    template <typename U>
+    bool operator==(const CacheAlignedAllocator<U> &) const { return true; }
+};
+
+/// Current values of a set of Winternitz chains in one contiguous, cache-line aligned buffer.
+///
+/// For fixed-size domains (`std::array` of bytes or field elements) the layout is
+/// [chain][byte] with a stride of `STRIDE` bytes, so a whole epoch (or several) needs a
+/// single allocation, the values can be handed to `apply_many` and to the leaf hash as one
+/// span, and SIMD gathers read consecutive memory. `std::vector<uint8_t>` domains, whose
+/// length is only known at runtime, still keep one heap buffer per chain.
+///
+/// Chains of several epochs are stored epoch after epoch; `row` returns the chains of one.
+template <typename TH>
+class ChainStates {
+public:
+    using Domain = typename TH::Domain;
+
+    /// Distance between two consecutive chain values, in bytes.
+    static constexpr std::size_t STRIDE = sizeof(Domain);
+
+    /// Whether the chain values themselves live in the buffer.
+    static constexpr bool CONTIGUOUS = std::is_trivially_copyable_v<Domain>;
+
+    ChainStates() = default;
+
+    explicit ChainStates(std::size_t num_chains) : values(num_chains) {}
+
+    explicit ChainStates(std::span<const Domain> initial) : values(initial.begin(), initial.end()) {}
+
+    std::size_t size() const { return values.size(); }
+
+    /// Changes the number of chains; shrinking keeps the allocation, so a reused scratch
+    /// buffer stops allocating once it has reached its largest size.
+    void resize(std::size_t num_chains) { values.resize(num_chains); }
+
+    Domain &operator[](std::size_t i) { return values[i]; }
+    const Domain &operator[](std::size_t i) const { return values[i]; }
+
+    Domain *data() { return values.data(); }
+    const Domain *data() const { return values.data(); }
+
+    std::span<Domain> span() { return std::span<Domain>(values); }
+    std::span<const Domain> span() const { return std::span<const Domain>(values); }
+
+    /// Chains `r * len` to `(r + 1) * len`, e.g. all chains of the r-th epoch of a batch.
+    std::span<const Domain> row(std::size_t r, std::size_t len) const { return span().subspan(r * len, len); }
+
+    /// Copies the values out, e.g. into a signature.
+    std::vector<Domain> to_vector() const { return std::vector<Domain>(values.begin(), values.end()); }
+
+private:
+    std::vector<Domain, CacheAlignedAllocator<Domain>> values;
+};
@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// CPU features the hash kernels can use, detected once per process.
+struct CpuFeatures
+{
+    bool sse41 = false;
+    bool sha_ni = false;
+    bool avx2 = false;
+    bool avx512f = false;
+
+    static const CpuFeatures &get()
+    {
+        static const CpuFeatures features = detect();
+        return features;
+    }
+
+    std::string to_string() const
+    {
+        std::string out;
+        auto add = [&](bool present, const char *name)
+        {
+            if (present)
+            {
+                out += out.empty() ? "" : " ";
+                out += name;
+            }
+        };
+        add(sse41, "sse4.1");
+        add(sha_ni, "sha-ni");
+        add(avx2, "avx2");
+        add(avx512f, "avx512f");
+        return out.empty() ? "none" : out;
+    }
+
+private:
+    static CpuFeatures detect()
+    {
+        CpuFeatures features;
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        features.sse41 = __builtin_cpu_supports("sse4.1");
+        features.sha_ni = __builtin_cpu_supports("sha");
+        features.avx2 = __builtin_cpu_supports("avx2");
+        features.avx512f = __builtin_cpu_supports("avx512f");
+#endif
+        return features;
+    }
+};
+
+/// The kernel chosen for one backend and input length.
+struct KernelSelection
+{
+    std::string backend;
+    std::size_t input_len;
+    std::string kernel;
+    double ns_per_hash;
+    bool forced;
+};
+
+/// Picks the fastest of several interchangeable hash kernels at runtime.
+///
+/// The first time a backend hashes inputs of a given length, every kernel the CPU supports
+/// is timed on a small batch of inputs of exactly that length, and the fastest one is kept
+/// for the rest of the process. Kernels produce identical outputs, so the choice only
+/// affects speed. `report` lists what was chosen.
+///
+/// Setting the environment variable XMSS_KERNEL to a comma-separated list of kernel names
+/// (e.g. `XMSS_KERNEL=sha256-avx2-x8,keccak-scalar`) skips the benchmark for backends that
+/// offer one of the named kernels.
+struct KernelSelector
+{
+    /// Passed to the `measure` callback of `select`; times one candidate kernel per call.
+    class Bench
+    {
+    public:
+        /// `run` hashes `hashes` inputs; `id` is what `select` returns if this candidate wins.
+        template <typename Run>
+        void candidate(int id, const char *name, std::size_t hashes, Run run)
+        {
+            if (forced_id.has_value())
+            {
+                return;
+            }
+            if (is_forced(name))
+            {
+                forced_id = id;
+                best = Result{id, name, 0.0};
+                return;
+            }
+
+            double ns = time(run) / static_cast<double>(hashes);
+            if (ns < best.ns_per_hash)
+            {
+                best = Result{id, name, ns};
+            }
+        }
+
+    private:
+        friend struct KernelSelector;
+
+        struct Result
+        {
+            int id = -1;
+            std::string kernel;
+            double ns_per_hash = std::numeric_limits<double>::infinity();
+        };
+
+        Result best;
+        std::optional<int> forced_id;
+
+        /// best of five runs after a warm-up, in nanoseconds per call of `run`
+        template <typename Run>
+        static double time(Run &run)
+        {
+            using clock = std::chrono::steady_clock;
+
+            run();
+            double best_ns = std::numeric_limits<double>::infinity();
+            for (int trial = 0; trial < 5; trial++)
+            {
+                constexpr int REPS = 8;
+                auto start = clock::now();
+                for (int r = 0; r < REPS; r++)
+                {
+                    run();
+                }
+                double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / REPS;
+                best_ns = std::min(best_ns, ns);
+            }
+            return best_ns;
+        }
+
+        static bool is_forced(const char *name)
+        {
+            const char *env = std::getenv("XMSS_KERNEL");
+            if (env == nullptr)
+            {
+                return false;
+            }
+            std::string_view list(env), wanted(name);
+            while (!list.empty())
+            {
+                std::size_t comma = list.find(',');
+                if (list.substr(0, comma) == wanted)
+                {
+                    return true;
+                }
+                list = (comma == std::string_view::npos) ? std::string_view() : list.substr(comma + 1);
+            }
+            return false;
+        }
+    };
+
+    /// Returns the id of the kernel selected for `backend` and `input_len`. On the first call
+    /// for this pair, `measure(bench)` is invoked and registers the candidates on `bench`.
+    ///
+    /// `measure` must not call `select` itself. Every call site has its own `Measure` type, so
+    /// the per-thread table below holds the answers of one call site for every length it has
+    /// seen, and callers that alternate lengths (chain steps, leaves, tree nodes) do not take
+    /// the lock once each length is known. The benchmark of a new pair runs outside the lock,
+    /// so it only holds up the threads that wait for that same pair.
+    template <typename Measure>
+    static int select(const char *backend, std::size_t input_len, Measure measure)
+    {
+        // a call site sees a handful of lengths, so a linear search beats a map
+        thread_local std::vector<std::pair<std::size_t, int>> cached;
+        for (const auto &[len, id] : cached)
+        {
+            if (len == input_len)
+            {
+                return id;
+            }
+        }
+
+        State &s = state();
+        Choice *choice;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto &slot = s.chosen[std::make_pair(std::string_view(backend), input_len)];
+            if (!slot)
+            {
+                slot = std::make_unique<Choice>();
+            }
+            choice = slot.get();
+        }
+
+        std::call_once(choice->once, [&]
+        {
+            Bench bench;
+            measure(bench);
+            choice->id = bench.best.id;
+
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.selections.push_back(KernelSelection{backend, input_len, bench.best.kernel, bench.best.ns_per_hash,
+                                                   bench.forced_id.has_value()});
+        });
+
+        cached.emplace_back(input_len, choice->id);
+        return choice->id;
+    }
+
+    /// All selections made so far, in the order they were made.
+    static std::vector<KernelSelection> report()
+    {
+        State &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return s.selections;
+    }
+
+    static void print_report(std::ostream &os)
+    {
+        os << "CPU features: " << CpuFeatures::get().to_string() << "\n";
+        for (const KernelSelection &selection : report())
+        {
+            os << selection.backend << " (" << selection.input_len << " input units): " << selection.kernel;
+            if (selection.forced)
+            {
+                os << " [forced by XMSS_KERNEL]";
+            }
+            else
+            {
+                os << " [" << selection.ns_per_hash << " ns/hash]";
+            }
+            os << "\n";
+        }
+    }
+
+private:
+    /// The kernel of one backend and length; `id` is set once, under `once`.
+    struct Choice
+    {
+        std::once_flag once;
+        int id = -1;
+    };
+
+    struct State
+    {
+        std::mutex mutex;
+        std::map<std::pair<std::string_view, std::size_t>, std::unique_ptr<Choice>> chosen;
+        std::vector<KernelSelection> selections;
+    };
+
+    static State &state()
+    {
+        static State s;
+        return s;
+    }
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <stdexcept>
+#include <openssl/evp.h>
+#include <openssl/opensslv.h>
+
+/// Digests used by the OpenSSL backends.
+enum class EvpAlgorithm
+{
+    SHA256,
+    COUNT
+};
+
+/// Per-thread cache of OpenSSL digest state.
+///
+/// Creating an EVP_MD_CTX and resolving the digest through the provider on every hash
+/// dominates the cost of hashing a few dozen bytes. Each thread instead keeps one
+/// pre-fetched EVP_MD and one context per algorithm for its whole lifetime; `start`
+/// only re-initialises that context. Everything is freed when the thread exits.
+///
+/// A context returned by `start` is only valid until the next `start` for the same
+/// algorithm on the same thread, so a hash must be finished before starting another one.
+struct EvpContext
+{
+    static EVP_MD_CTX *start(EvpAlgorithm algorithm)
+    {
+        Slot &slot = slots()[static_cast<std::size_t>(algorithm)];
+        if (slot.ctx == nullptr)
+        {
+            slot.init(algorithm);
+        }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        if (1 != EVP_DigestInit_ex2(slot.ctx, slot.md, NULL))
+#else
+        if (1 != EVP_DigestInit_ex(slot.ctx, slot.md, NULL))
+#endif
+        {
+            throw std::runtime_error("Failed to initialize digest");
+        }
+        return slot.ctx;
+    }
+
+    static void update(EVP_MD_CTX *ctx, const void *data, std::size_t len)
+    {
+        if (1 != EVP_DigestUpdate(ctx, data, len))
+        {
+            throw std::runtime_error("Failed to update digest");
+        }
+    }
+
+    /// Writes the digest to `out`, which must hold EVP_MAX_MD_SIZE bytes
+    /// (or at least the digest size of the algorithm).
+    static unsigned int finish(EVP_MD_CTX *ctx, uint8_t *out)
+    {
+        unsigned int digest_len;
+        if (1 != EVP_DigestFinal_ex(ctx, out, &digest_len))
+        {
+            throw std::runtime_error("Failed to finalize digest");
+        }
+        return digest_len;
+    }
+
+private:
+    struct Slot
+    {
+        const EVP_MD *md = nullptr;
+        EVP_MD_CTX *ctx = nullptr;
+        bool fetched = false;
+
+        void init(EvpAlgorithm algorithm)
+        {
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            md = EVP_MD_fetch(NULL, name(algorithm), NULL);
+            fetched = (md != nullptr);
+#else
+            md = legacy(algorithm);
+#endif
+            if (md == nullptr)
+            {
+                throw std::runtime_error("Failed to fetch digest");
+            }
+
+            if ((ctx = EVP_MD_CTX_new()) == NULL)
+            {
+                throw std::runtime_error("Failed to create EVP_MD_CTX");
+            }
+        }
+
+        ~Slot()
+        {
+            EVP_MD_CTX_free(ctx);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+            if (fetched)
+            {
+                EVP_MD_free(const_cast<EVP_MD *>(md));
+            }
+#endif
+        }
+    };
+
+    static const char *name(EvpAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case EvpAlgorithm::SHA256:
+            return "SHA256";
+        default:
+            throw std::invalid_argument("Unknown digest");
+        }
+    }
+
+    static const EVP_MD *legacy(EvpAlgorithm algorithm)
+    {
+        switch (algorithm)
+        {
+        case EvpAlgorithm::SHA256:
+            return EVP_sha256();
+        default:
+            throw std::invalid_argument("Unknown digest");
+        }
+    }
+
+    static Slot *slots()
+    {
+        thread_local Slot cache[static_cast<std::size_t>(EvpAlgorithm::COUNT)];
+        return cache;
+    }
+};
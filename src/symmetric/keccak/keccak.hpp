@@ -0,0 +1,352 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <bit>
+#include <algorithm>
+#include <vector>
+#include "../dispatch.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KECCAK_MULTI_LANE_X86 1
+#endif
+
+/// Keccak-f[1600] and the SHA-3 / SHAKE sponges (FIPS 202).
+///
+/// `Keccak::permute` is the scalar permutation. `Keccak::permute_x4` runs four independent
+/// permutations at once, one per 64-bit lane of an AVX2 register. The `Sponge` functions
+/// hash one input with the scalar permutation, or four inputs of equal length with the
+/// 4-lane one, which is the shape of the tweakable hash inputs.
+///
+/// The AVX2 code is compiled with function-level target attributes; callers must check
+/// `Keccak::has_avx2()`.
+namespace keccak
+{
+    inline constexpr std::size_t STATE_WORDS = 25;
+
+    inline constexpr uint64_t RC[24] = {
+        0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+        0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+        0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+        0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+        0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+        0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL};
+
+    /// rotation offset of lane x + 5y
+    inline constexpr int RHO[25] = {
+        0, 1, 62, 28, 27,
+        36, 44, 6, 55, 20,
+        3, 10, 43, 25, 39,
+        41, 45, 15, 21, 8,
+        18, 2, 61, 56, 14};
+
+    /// lane x + 5y moves to lane y + 5(2x + 3y) in the pi step
+    inline constexpr int PI[25] = {
+        0, 10, 20, 5, 15,
+        16, 1, 11, 21, 6,
+        7, 17, 2, 12, 22,
+        23, 8, 18, 3, 13,
+        14, 24, 9, 19, 4};
+
+    /// SHA3-256: rate 136 bytes, domain suffix 01
+    struct Sha3_256
+    {
+        static constexpr const char *NAME = "sha3-256";
+        static constexpr std::size_t RATE = 136;
+        static constexpr uint8_t SUFFIX = 0x06;
+        static constexpr std::size_t OUT_LEN = 32;
+    };
+
+    /// SHAKE128: rate 168 bytes, domain suffix 1111, any output length
+    struct Shake128
+    {
+        static constexpr const char *NAME = "shake128";
+        static constexpr std::size_t RATE = 168;
+        static constexpr uint8_t SUFFIX = 0x1f;
+        static constexpr std::size_t OUT_LEN = 32;
+    };
+
+    struct Keccak
+    {
+        static constexpr std::size_t LANES = 4;
+
+        static bool has_avx2()
+        {
+#ifdef KECCAK_MULTI_LANE_X86
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+
+        static void permute(uint64_t a[STATE_WORDS])
+        {
+            uint64_t b[STATE_WORDS], c[5], d[5];
+            for (int round = 0; round < 24; round++)
+            {
+                // theta
+                #pragma GCC unroll 5
+                for (int x = 0; x < 5; x++)
+                {
+                    c[x] = a[x] ^ a[x + 5] ^ a[x + 10] ^ a[x + 15] ^ a[x + 20];
+                }
+                #pragma GCC unroll 5
+                for (int x = 0; x < 5; x++)
+                {
+                    d[x] = c[(x + 4) % 5] ^ std::rotl(c[(x + 1) % 5], 1);
+                }
+                // rho and pi
+                #pragma GCC unroll 25
+                for (int i = 0; i < 25; i++)
+                {
+                    b[PI[i]] = std::rotl(a[i] ^ d[i % 5], RHO[i]);
+                }
+                // chi
+                #pragma GCC unroll 25
+                for (int y = 0; y < 25; y += 5)
+                {
+                    #pragma GCC unroll 5
+                    for (int x = 0; x < 5; x++)
+                    {
+                        a[y + x] = b[y + x] ^ (~b[y + (x + 1) % 5] & b[y + (x + 2) % 5]);
+                    }
+                }
+                // iota
+                a[0] ^= RC[round];
+            }
+        }
+
+#ifdef KECCAK_MULTI_LANE_X86
+        /// Four permutations at once; `a[i]` holds lane word i of each of the four states.
+        __attribute__((target("avx2"))) static void permute_x4(__m256i a[STATE_WORDS])
+        {
+            __m256i b[STATE_WORDS], c[5], d[5];
+            for (int round = 0; round < 24; round++)
+            {
+                #pragma GCC unroll 5
+                for (int x = 0; x < 5; x++)
+                {
+                    c[x] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(a[x], a[x + 5]), _mm256_xor_si256(a[x + 10], a[x + 15])), a[x + 20]);
+                }
+                #pragma GCC unroll 5
+                for (int x = 0; x < 5; x++)
+                {
+                    d[x] = _mm256_xor_si256(c[(x + 4) % 5], rotl_x4(c[(x + 1) % 5], 1));
+                }
+                #pragma GCC unroll 25
+                for (int i = 0; i < 25; i++)
+                {
+                    b[PI[i]] = rotl_x4(_mm256_xor_si256(a[i], d[i % 5]), RHO[i]);
+                }
+                #pragma GCC unroll 25
+                for (int y = 0; y < 25; y += 5)
+                {
+                    #pragma GCC unroll 5
+                    for (int x = 0; x < 5; x++)
+                    {
+                        a[y + x] = _mm256_xor_si256(b[y + x], _mm256_andnot_si256(b[y + (x + 1) % 5], b[y + (x + 2) % 5]));
+                    }
+                }
+                a[0] = _mm256_xor_si256(a[0], _mm256_set1_epi64x(static_cast<long long>(RC[round])));
+            }
+        }
+
+    private:
+        __attribute__((target("avx2"))) static inline __m256i rotl_x4(__m256i x, int n)
+        {
+            // AVX2 has no 64-bit rotate; variable shifts by 64 give 0, so n = 0 works too
+            return _mm256_or_si256(_mm256_sllv_epi64(x, _mm256_set1_epi64x(n)), _mm256_srlv_epi64(x, _mm256_set1_epi64x(64 - n)));
+        }
+#endif
+    };
+
+    /// SHA-3 / SHAKE sponge over Keccak-f[1600] for the variant V (Sha3_256 or Shake128).
+    template <typename V>
+    struct Sponge
+    {
+        static constexpr std::size_t RATE = V::RATE;
+
+        /// Hashes `len` bytes of `in` and writes `out_len` output bytes to `out`.
+        /// For SHA3-256, `out_len` is at most 32.
+        static void hash(const uint8_t *in, std::size_t len, uint8_t *out, std::size_t out_len)
+        {
+            uint64_t state[STATE_WORDS] = {0};
+
+            while (len >= RATE)
+            {
+                xor_block(state, in);
+                Keccak::permute(state);
+                in += RATE;
+                len -= RATE;
+            }
+
+            uint8_t last[RATE];
+            pad(last, in, len);
+            xor_block(state, last);
+            Keccak::permute(state);
+
+            while (true)
+            {
+                std::size_t n = std::min(out_len, RATE);
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    out[i] = static_cast<uint8_t>(state[i / 8] >> (8 * (i % 8)));
+                }
+                out += n;
+                out_len -= n;
+                if (out_len == 0)
+                {
+                    break;
+                }
+                Keccak::permute(state);
+            }
+        }
+
+        /// Whether `hash_x4` beats four calls of `hash` for inputs of `len` bytes on this CPU;
+        /// timed once per length by `KernelSelector`.
+        static bool use_x4(std::size_t len)
+        {
+            return KernelSelector::select(V::NAME, len, [len](KernelSelector::Bench &bench)
+            {
+                std::vector<uint8_t> inputs(4 * len), outputs(4 * V::OUT_LEN);
+                const uint8_t *in[4];
+                uint8_t *out[4];
+                for (std::size_t i = 0; i < inputs.size(); i++)
+                {
+                    inputs[i] = static_cast<uint8_t>(i * 131 + 7);
+                }
+                for (std::size_t l = 0; l < 4; l++)
+                {
+                    in[l] = inputs.data() + l * len;
+                    out[l] = outputs.data() + l * V::OUT_LEN;
+                }
+
+                if (Keccak::has_avx2())
+                {
+                    bench.candidate(1, "keccak-avx2-x4", 4, [&]
+                                    { hash_x4(in, len, out, V::OUT_LEN); });
+                }
+                bench.candidate(0, "keccak-scalar", 4, [&]
+                {
+                    for (std::size_t l = 0; l < 4; l++)
+                    {
+                        hash(in[l], len, out[l], V::OUT_LEN);
+                    }
+                });
+            }) == 1;
+        }
+
+        /// Four inputs of the same length at once, one per lane; one by one without AVX2.
+        static void hash_x4(const uint8_t *const in[4], std::size_t len, uint8_t *const out[4], std::size_t out_len)
+        {
+#ifdef KECCAK_MULTI_LANE_X86
+            if (Keccak::has_avx2())
+            {
+                hash_x4_avx2(in, len, out, out_len);
+                return;
+            }
+#endif
+            for (std::size_t l = 0; l < 4; l++)
+            {
+                hash(in[l], len, out[l], out_len);
+            }
+        }
+
+    private:
+        static void xor_block(uint64_t state[STATE_WORDS], const uint8_t *block)
+        {
+            for (std::size_t w = 0; w < RATE / 8; w++)
+            {
+                uint64_t word;
+                std::memcpy(&word, block + 8 * w, 8);
+                state[w] ^= word;
+            }
+        }
+
+        /// Copies the final `len` < RATE bytes to `block` and applies the pad10*1 padding
+        /// together with the domain suffix.
+        static void pad(uint8_t block[RATE], const uint8_t *in, std::size_t len)
+        {
+            std::memset(block, 0, RATE);
+            std::memcpy(block, in, len);
+            block[len] ^= V::SUFFIX;
+            block[RATE - 1] ^= 0x80;
+        }
+
+#ifdef KECCAK_MULTI_LANE_X86
+        __attribute__((target("avx2"))) static inline void xor_block_x4(__m256i state[STATE_WORDS], const uint8_t *const blocks[4])
+        {
+            for (std::size_t w = 0; w < RATE / 8; w++)
+            {
+                uint64_t words[4];
+                for (std::size_t l = 0; l < 4; l++)
+                {
+                    std::memcpy(&words[l], blocks[l] + 8 * w, 8);
+                }
+                __m256i v = _mm256_set_epi64x(static_cast<long long>(words[3]), static_cast<long long>(words[2]),
+                                              static_cast<long long>(words[1]), static_cast<long long>(words[0]));
+                state[w] = _mm256_xor_si256(state[w], v);
+            }
+        }
+
+        __attribute__((target("avx2"))) static void hash_x4_avx2(const uint8_t *const in[4], std::size_t len,
+                                                                 uint8_t *const out[4], std::size_t out_len)
+        {
+            __m256i state[STATE_WORDS];
+            for (std::size_t i = 0; i < STATE_WORDS; i++)
+            {
+                state[i] = _mm256_setzero_si256();
+            }
+
+            std::size_t offset = 0;
+            const uint8_t *blocks[4];
+            while (len - offset >= RATE)
+            {
+                for (std::size_t l = 0; l < 4; l++)
+                {
+                    blocks[l] = in[l] + offset;
+                }
+                xor_block_x4(state, blocks);
+                Keccak::permute_x4(state);
+                offset += RATE;
+            }
+
+            uint8_t last[4][RATE];
+            for (std::size_t l = 0; l < 4; l++)
+            {
+                pad(last[l], in[l] + offset, len - offset);
+                blocks[l] = last[l];
+            }
+            xor_block_x4(state, blocks);
+            Keccak::permute_x4(state);
+
+            std::size_t written = 0;
+            while (true)
+            {
+                alignas(32) uint64_t words[STATE_WORDS][4];
+                for (std::size_t w = 0; w < RATE / 8; w++)
+                {
+                    _mm256_store_si256(reinterpret_cast<__m256i *>(words[w]), state[w]);
+                }
+
+                std::size_t n = std::min(out_len - written, RATE);
+                for (std::size_t l = 0; l < 4; l++)
+                {
+                    for (std::size_t i = 0; i < n; i++)
+                    {
+                        out[l][written + i] = static_cast<uint8_t>(words[i / 8][l] >> (8 * (i % 8)));
+                    }
+                }
+                written += n;
+                if (written == out_len)
+                {
+                    break;
+                }
+                Keccak::permute_x4(state);
+            }
+        }
+#endif
+    };
+}
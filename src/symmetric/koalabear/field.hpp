@@ -0,0 +1,190 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KOALABEAR_PACKED_X86 1
+#endif
+
+/// The KoalaBear prime field, p = 2^31 - 2^24 + 1.
+///
+/// p - 1 = 2^24 * 127 is not divisible by 3, so x -> x^3 is a permutation and serves as
+/// the Poseidon2 S-box. Elements fit into 31 bits, so eight of them fill an AVX2 register.
+namespace koalabear
+{
+    inline constexpr uint32_t P = 0x7f000001;
+
+    /// A field element in canonical form, i.e. `value` < P.
+    struct Element
+    {
+        uint32_t value = 0;
+
+        constexpr Element() = default;
+
+        static constexpr Element from_u64(uint64_t v)
+        {
+            Element e;
+            e.value = static_cast<uint32_t>(v % P);
+            return e;
+        }
+
+        constexpr Element operator+(Element other) const
+        {
+            uint32_t sum = value + other.value;
+            return raw(sum >= P ? sum - P : sum);
+        }
+
+        constexpr Element operator-(Element other) const
+        {
+            return raw(value >= other.value ? value - other.value : value + P - other.value);
+        }
+
+        constexpr Element operator-() const
+        {
+            return Element() - *this;
+        }
+
+        constexpr Element operator*(Element other) const
+        {
+            return raw(static_cast<uint32_t>(static_cast<uint64_t>(value) * other.value % P));
+        }
+
+        constexpr Element &operator+=(Element other)
+        {
+            return *this = *this + other;
+        }
+
+        constexpr Element &operator*=(Element other)
+        {
+            return *this = *this * other;
+        }
+
+        constexpr Element pow(uint64_t exponent) const
+        {
+            Element result = raw(1), base = *this;
+            while (exponent > 0)
+            {
+                if (exponent & 1)
+                {
+                    result *= base;
+                }
+                base *= base;
+                exponent >>= 1;
+            }
+            return result;
+        }
+
+        constexpr Element inverse() const
+        {
+            return pow(P - 2);
+        }
+
+        constexpr bool operator==(const Element &other) const = default;
+
+    private:
+        static constexpr Element raw(uint32_t v)
+        {
+            Element e;
+            e.value = v;
+            return e;
+        }
+    };
+
+    /// x * 2^32 mod P
+    constexpr uint32_t to_monty_form(uint32_t x)
+    {
+        return static_cast<uint32_t>((static_cast<uint64_t>(x) << 32) % P);
+    }
+
+    /// P^-1 mod 2^32, by Newton iteration
+    constexpr uint32_t inverse_mod_2_32(uint32_t x)
+    {
+        uint32_t inv = 1;
+        for (int i = 0; i < 5; i++)
+        {
+            inv *= 2 - x * inv;
+        }
+        return inv;
+    }
+
+    inline constexpr uint32_t MONTY_MU = inverse_mod_2_32(P);
+    inline constexpr uint32_t MONTY_R2 = static_cast<uint32_t>(static_cast<uint64_t>(to_monty_form(1)) * to_monty_form(1) % P);
+
+    static_assert(static_cast<uint32_t>(P * MONTY_MU) == 1);
+
+    /// Eight field elements in the 32-bit lanes of an AVX2 register, in Montgomery form
+    /// (x is held as x * 2^32 mod P). Multiplication is a Montgomery product, so values
+    /// enter with `to_monty` and leave with `from_monty`.
+    ///
+    /// The functions are compiled with a function-level target attribute; callers must
+    /// check `has_avx2()`.
+    struct Packed
+    {
+        static constexpr std::size_t LANES = 8;
+
+        static bool has_avx2()
+        {
+#ifdef KOALABEAR_PACKED_X86
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+
+        /// x * 2^32 mod P of a canonical value, for constants kept in Montgomery form.
+        static constexpr uint32_t monty(uint32_t x)
+        {
+            return to_monty_form(x);
+        }
+
+#ifdef KOALABEAR_PACKED_X86
+        __attribute__((target("avx2"))) static inline __m256i add(__m256i a, __m256i b)
+        {
+            // a + b < 2P < 2^32, the smaller of a + b and a + b - P is the reduced sum
+            __m256i sum = _mm256_add_epi32(a, b);
+            return _mm256_min_epu32(sum, _mm256_sub_epi32(sum, _mm256_set1_epi32(P)));
+        }
+
+        __attribute__((target("avx2"))) static inline __m256i sub(__m256i a, __m256i b)
+        {
+            // if a < b the difference wraps above P and adding P brings it back
+            __m256i diff = _mm256_sub_epi32(a, b);
+            return _mm256_min_epu32(diff, _mm256_add_epi32(diff, _mm256_set1_epi32(P)));
+        }
+
+        /// Montgomery product a * b * 2^-32 mod P.
+        __attribute__((target("avx2"))) static inline __m256i mul(__m256i a, __m256i b)
+        {
+            const __m256i p = _mm256_set1_epi32(P);
+            const __m256i mu = _mm256_set1_epi32(MONTY_MU);
+
+            // even lanes in the low halves of the 64-bit products, odd lanes shifted down
+            __m256i prod_even = _mm256_mul_epu32(a, b);
+            __m256i prod_odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+
+            // q * P agrees with the product in the low 32 bits, so the difference is
+            // (a * b - q * P) / 2^32 in the high half, a value in (-P, P)
+            __m256i qp_even = _mm256_mul_epu32(_mm256_mul_epu32(prod_even, mu), p);
+            __m256i qp_odd = _mm256_mul_epu32(_mm256_mul_epu32(prod_odd, mu), p);
+
+            __m256i d_even = _mm256_srli_epi64(_mm256_sub_epi64(prod_even, qp_even), 32);
+            __m256i d_odd = _mm256_sub_epi64(prod_odd, qp_odd);
+            __m256i d = _mm256_blend_epi32(d_even, d_odd, 0b10101010);
+
+            return _mm256_min_epu32(d, _mm256_add_epi32(d, p));
+        }
+
+        __attribute__((target("avx2"))) static inline __m256i to_monty(__m256i a)
+        {
+            return mul(a, _mm256_set1_epi32(MONTY_R2));
+        }
+
+        __attribute__((target("avx2"))) static inline __m256i from_monty(__m256i a)
+        {
+            return mul(a, _mm256_set1_epi32(1));
+        }
+#endif
+    };
+}
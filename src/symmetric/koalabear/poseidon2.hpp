@@ -0,0 +1,328 @@
+#pragma once
+
+#include "field.hpp"
+#include <cstdint>
+#include <cstddef>
+
+/// The Poseidon2 permutation over KoalaBear, width 16 (Grassi, Khovratovich, Schofnegger,
+/// "Poseidon2: A Faster Version of the Poseidon Hash Function").
+///
+/// S-box x^3, 8 full rounds and 20 partial rounds. The external layer is circ(2 M4, M4, M4, M4),
+/// the internal layer is the all-ones matrix plus diag(INTERNAL_DIAG). Round constants are
+/// drawn from the Grain LFSR exactly as in the Poseidon reference, seeded with the field
+/// size, the width and the round numbers.
+///
+/// `permute` works on one state of canonical elements. `permute_x8` runs eight independent
+/// permutations at once, one per AVX2 lane, on states in Montgomery form (see `Packed`).
+namespace koalabear
+{
+    struct Poseidon2
+    {
+        static constexpr std::size_t WIDTH = 16;
+        static constexpr std::size_t FULL_ROUNDS = 8;
+        static constexpr std::size_t PARTIAL_ROUNDS = 20;
+
+        static void permute(Element state[WIDTH])
+        {
+            const Constants &c = constants();
+
+            external_layer(state);
+            for (std::size_t r = 0; r < FULL_ROUNDS / 2; r++)
+            {
+                full_round(state, c.external[r]);
+            }
+            for (std::size_t r = 0; r < PARTIAL_ROUNDS; r++)
+            {
+                state[0] = sbox(state[0] + c.internal[r]);
+                internal_layer(state, c.diag);
+            }
+            for (std::size_t r = FULL_ROUNDS / 2; r < FULL_ROUNDS; r++)
+            {
+                full_round(state, c.external[r]);
+            }
+        }
+
+#ifdef KOALABEAR_PACKED_X86
+        /// Eight permutations at once; `state[i]` holds element i of every lane in Montgomery form.
+        /// Callers must check `Packed::has_avx2()`.
+        __attribute__((target("avx2"))) static void permute_x8(__m256i state[WIDTH])
+        {
+            const Constants &c = constants();
+
+            external_layer_x8(state);
+            for (std::size_t r = 0; r < FULL_ROUNDS / 2; r++)
+            {
+                full_round_x8(state, c.external_monty[r]);
+            }
+            for (std::size_t r = 0; r < PARTIAL_ROUNDS; r++)
+            {
+                state[0] = sbox_x8(Packed::add(state[0], _mm256_set1_epi32(c.internal_monty[r])));
+                internal_layer_x8(state, c.diag_monty);
+            }
+            for (std::size_t r = FULL_ROUNDS / 2; r < FULL_ROUNDS; r++)
+            {
+                full_round_x8(state, c.external_monty[r]);
+            }
+        }
+#endif
+
+    private:
+        struct Constants
+        {
+            Element external[FULL_ROUNDS][WIDTH];
+            Element internal[PARTIAL_ROUNDS];
+            Element diag[WIDTH];
+
+            // the same constants in Montgomery form, for the packed permutation
+            uint32_t external_monty[FULL_ROUNDS][WIDTH];
+            uint32_t internal_monty[PARTIAL_ROUNDS];
+            uint32_t diag_monty[WIDTH];
+        };
+
+        /// Grain LFSR of the Poseidon reference (Appendix F of the Poseidon paper), used in
+        /// self-shrinking mode to sample field elements by rejection.
+        struct Grain
+        {
+            uint8_t bits[80];
+
+            Grain(std::size_t field_bits, std::size_t width, std::size_t full_rounds, std::size_t partial_rounds)
+            {
+                std::size_t i = 0;
+                auto push = [&](uint64_t value, std::size_t len)
+                {
+                    for (std::size_t b = len; b-- > 0;)
+                    {
+                        bits[i++] = (value >> b) & 1;
+                    }
+                };
+                push(1, 2); // prime field
+                push(0, 4); // S-box x^alpha
+                push(field_bits, 12);
+                push(width, 12);
+                push(full_rounds, 10);
+                push(partial_rounds, 10);
+                push((uint64_t(1) << 30) - 1, 30);
+
+                for (int j = 0; j < 160; j++)
+                {
+                    next_bit();
+                }
+            }
+
+            uint8_t next_bit()
+            {
+                uint8_t bit = bits[62] ^ bits[51] ^ bits[38] ^ bits[23] ^ bits[13] ^ bits[0];
+                for (std::size_t j = 0; j < 79; j++)
+                {
+                    bits[j] = bits[j + 1];
+                }
+                bits[79] = bit;
+                return bit;
+            }
+
+            Element next_element()
+            {
+                while (true)
+                {
+                    uint64_t value = 0;
+                    for (int b = 0; b < 31; b++)
+                    {
+                        // self-shrinking: a pair (1, x) emits x, a pair (0, x) emits nothing
+                        while (next_bit() == 0)
+                        {
+                            next_bit();
+                        }
+                        value = (value << 1) | next_bit();
+                    }
+                    if (value < P)
+                    {
+                        return Element::from_u64(value);
+                    }
+                }
+            }
+        };
+
+        static const Constants &constants()
+        {
+            static const Constants c = []
+            {
+                Constants c;
+                Grain grain(31, WIDTH, FULL_ROUNDS, PARTIAL_ROUNDS);
+
+                for (std::size_t r = 0; r < FULL_ROUNDS / 2; r++)
+                {
+                    for (std::size_t i = 0; i < WIDTH; i++)
+                    {
+                        c.external[r][i] = grain.next_element();
+                    }
+                }
+                for (std::size_t r = 0; r < PARTIAL_ROUNDS; r++)
+                {
+                    c.internal[r] = grain.next_element();
+                }
+                for (std::size_t r = FULL_ROUNDS / 2; r < FULL_ROUNDS; r++)
+                {
+                    for (std::size_t i = 0; i < WIDTH; i++)
+                    {
+                        c.external[r][i] = grain.next_element();
+                    }
+                }
+
+                // -2, 1, 2, 1/2, 3, 4, -1/2, -3, -4, 1/2^8, 1/8, 1/2^24, -1/2^8, -1/8, -1/16, -1/2^24
+                const Element one = Element::from_u64(1), two = Element::from_u64(2);
+                const Element half = two.inverse();
+                const Element diag[WIDTH] = {
+                    -two, one, two, half, Element::from_u64(3), Element::from_u64(4), -half, -Element::from_u64(3),
+                    -Element::from_u64(4), half.pow(8), half.pow(3), half.pow(24), -half.pow(8), -half.pow(3), -half.pow(4), -half.pow(24)};
+
+                for (std::size_t i = 0; i < WIDTH; i++)
+                {
+                    c.diag[i] = diag[i];
+                    c.diag_monty[i] = Packed::monty(diag[i].value);
+                }
+                for (std::size_t r = 0; r < FULL_ROUNDS; r++)
+                {
+                    for (std::size_t i = 0; i < WIDTH; i++)
+                    {
+                        c.external_monty[r][i] = Packed::monty(c.external[r][i].value);
+                    }
+                }
+                for (std::size_t r = 0; r < PARTIAL_ROUNDS; r++)
+                {
+                    c.internal_monty[r] = Packed::monty(c.internal[r].value);
+                }
+                return c;
+            }();
+            return c;
+        }
+
+        static Element sbox(Element x)
+        {
+            return x * x * x;
+        }
+
+        static void full_round(Element state[WIDTH], const Element round_constants[WIDTH])
+        {
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                state[i] = sbox(state[i] + round_constants[i]);
+            }
+            external_layer(state);
+        }
+
+        /// M4 = [[5, 7, 1, 3], [4, 6, 1, 1], [1, 3, 5, 7], [1, 1, 4, 6]] in 8 additions and 4 doublings
+        static void m4(Element x[4])
+        {
+            Element t0 = x[0] + x[1];
+            Element t1 = x[2] + x[3];
+            Element t2 = x[1] + x[1] + t1;
+            Element t3 = x[3] + x[3] + t0;
+            Element t1_4 = t1 + t1;
+            t1_4 = t1_4 + t1_4;
+            Element t0_4 = t0 + t0;
+            t0_4 = t0_4 + t0_4;
+            Element t4 = t1_4 + t3;
+            Element t5 = t0_4 + t2;
+            x[0] = t3 + t5;
+            x[1] = t5;
+            x[2] = t2 + t4;
+            x[3] = t4;
+        }
+
+        static void external_layer(Element state[WIDTH])
+        {
+            for (std::size_t i = 0; i < WIDTH; i += 4)
+            {
+                m4(state + i);
+            }
+
+            Element sums[4];
+            for (std::size_t k = 0; k < 4; k++)
+            {
+                sums[k] = state[k] + state[k + 4] + state[k + 8] + state[k + 12];
+            }
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                state[i] += sums[i % 4];
+            }
+        }
+
+        static void internal_layer(Element state[WIDTH], const Element diag[WIDTH])
+        {
+            Element sum;
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                sum += state[i];
+            }
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                state[i] = sum + diag[i] * state[i];
+            }
+        }
+
+#ifdef KOALABEAR_PACKED_X86
+        __attribute__((target("avx2"))) static inline __m256i sbox_x8(__m256i x)
+        {
+            return Packed::mul(Packed::mul(x, x), x);
+        }
+
+        __attribute__((target("avx2"))) static inline void full_round_x8(__m256i state[WIDTH], const uint32_t round_constants[WIDTH])
+        {
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                state[i] = sbox_x8(Packed::add(state[i], _mm256_set1_epi32(round_constants[i])));
+            }
+            external_layer_x8(state);
+        }
+
+        __attribute__((target("avx2"))) static inline void m4_x8(__m256i x[4])
+        {
+            __m256i t0 = Packed::add(x[0], x[1]);
+            __m256i t1 = Packed::add(x[2], x[3]);
+            __m256i t2 = Packed::add(Packed::add(x[1], x[1]), t1);
+            __m256i t3 = Packed::add(Packed::add(x[3], x[3]), t0);
+            __m256i t1_4 = Packed::add(t1, t1);
+            t1_4 = Packed::add(t1_4, t1_4);
+            __m256i t0_4 = Packed::add(t0, t0);
+            t0_4 = Packed::add(t0_4, t0_4);
+            __m256i t4 = Packed::add(t1_4, t3);
+            __m256i t5 = Packed::add(t0_4, t2);
+            x[0] = Packed::add(t3, t5);
+            x[1] = t5;
+            x[2] = Packed::add(t2, t4);
+            x[3] = t4;
+        }
+
+        __attribute__((target("avx2"))) static inline void external_layer_x8(__m256i state[WIDTH])
+        {
+            for (std::size_t i = 0; i < WIDTH; i += 4)
+            {
+                m4_x8(state + i);
+            }
+
+            __m256i sums[4];
+            for (std::size_t k = 0; k < 4; k++)
+            {
+                sums[k] = Packed::add(Packed::add(state[k], state[k + 4]), Packed::add(state[k + 8], state[k + 12]));
+            }
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                state[i] = Packed::add(state[i], sums[i % 4]);
+            }
+        }
+
+        __attribute__((target("avx2"))) static inline void internal_layer_x8(__m256i state[WIDTH], const uint32_t diag[WIDTH])
+        {
+            __m256i sum = state[0];
+            for (std::size_t i = 1; i < WIDTH; i++)
+            {
+                sum = Packed::add(sum, state[i]);
+            }
+            for (std::size_t i = 0; i < WIDTH; i++)
+            {
+                state[i] = Packed::add(sum, Packed::mul(_mm256_set1_epi32(diag[i]), state[i]));
+            }
+        }
+#endif
+    };
+}
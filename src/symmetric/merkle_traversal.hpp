@@ -0,0 +1,190 @@
+#pragma once
+
+#include "tweak_hash_tree.hpp"
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+/// Co-paths for consecutive leaves of a complete subtree without storing the subtree, after
+/// Szydlo's logarithmic Merkle tree traversal (the BDS family of algorithms).
+///
+/// The traversal holds the current co-path plus, for every level h, a treehash instance that
+/// computes the level-h node the co-path will need next. After each leaf, the co-path nodes
+/// that change are taken from their finished instances, which restart on the node after next,
+/// and at most 2 * height - 1 instance steps run, the one with the lowest pending node first.
+/// A step computes one leaf and folds it into the instance's stack. Between them the instances
+/// hold O(height) nodes, so a subtree of height 24 needs a few kilobytes of state and at most
+/// 2 * height - 1 leaf computations per epoch.
+///
+/// The subtree has height `height` and spans the leaves [first_leaf, first_leaf + 2^height),
+/// with first_leaf a multiple of 2^height; positions are absolute, so the tweaks are those of
+/// `HashTree::NewHashTree`. A traversal can start at any leaf: `StartNodes` records the
+/// co-path of that leaf and the next node each instance would be computing while the subtree
+/// is built once with `TreeHash`, and the instances start out finished.
+template <TweakableHash_c TH>
+class MerkleTraversal {
+public:
+    using Domain = typename TH::Domain;
+    using Parameter = typename TH::Parameter;
+
+    /// Computes the leaf at an absolute position.
+    using LeafFn = std::function<Domain(uint32_t position)>;
+
+    /// The state at leaf `start_leaf`, recorded as a `TreeHash` observer over the subtree.
+    struct StartNodes {
+        uint height;
+        uint32_t first_leaf;
+        uint32_t start_leaf;
+        /// co-path of `start_leaf`
+        std::vector<Domain> co_path;
+        /// per level, the node the instance would be computing, if any
+        std::vector<Domain> pending;
+        std::vector<int64_t> pending_index;
+
+        StartNodes(uint _height_, uint32_t _first_leaf_, uint32_t _start_leaf_) :
+        height(_height_), first_leaf(_first_leaf_), start_leaf(_start_leaf_), co_path(_height_), pending(_height_),
+        pending_index(_height_, -1) {
+            // the node started when level h last flipped, as in `next`, or the first node
+            const uint64_t s = start_leaf - first_leaf;
+            for(uint h = 0; h < height; h++) {
+                const uint64_t flipped = (s >> h) << h;
+                const uint64_t start = flipped == 0 ? 0 : (flipped + (uint64_t{1} << h)) ^ (uint64_t{1} << h);
+                if(start < (uint64_t{1} << height)) {
+                    pending_index[h] = static_cast<int64_t>(start >> h);
+                }
+            }
+        }
+
+        void operator()(uint level, uint32_t position, const Domain &node) {
+            if(level >= height) {
+                return;
+            }
+            const int64_t relative = static_cast<int64_t>(position - (first_leaf >> level));
+            if(relative == static_cast<int64_t>(((start_leaf - first_leaf) >> level) ^ 1)) {
+                co_path[level] = node;
+            }
+            if(relative == pending_index[level]) {
+                pending[level] = node;
+            }
+        }
+    };
+
+    MerkleTraversal(StartNodes start, Parameter _parameter_, TH _th_, LeafFn _leaf_) :
+    height(start.height), first_leaf(start.first_leaf), parameter(std::move(_parameter_)), th(std::move(_th_)),
+    leaf_fn(std::move(_leaf_)), auth(std::move(start.co_path)), instances(start.height),
+    current(start.start_leaf - start.first_leaf) {
+        for(uint h = 0; h < height; h++) {
+            instances[h].height = h;
+            instances[h].node = std::move(start.pending[h]);
+        }
+    }
+
+    const uint height;
+    const uint32_t first_leaf;
+
+    /// Absolute position of the leaf whose co-path `co_path` returns.
+    uint32_t leaf() const { return first_leaf + current; }
+
+    /// Whether `next` can move on, i.e. the current leaf is not the last one.
+    bool has_next() const { return uint64_t{current} + 1 < (uint64_t{1} << height); }
+
+    /// The co-path of `leaf()` inside the subtree, `height` nodes.
+    const std::vector<Domain> &co_path() const { return auth; }
+
+    /// Moves on to the next leaf.
+    void next() {
+        if(!has_next()) {
+            throw std::out_of_range("MerkleTraversal: past the last leaf");
+        }
+
+        // co-path nodes of the levels whose left/right side flips
+        const uint64_t following = uint64_t{current} + 1;
+        for(uint h = 0; h < height && following % (uint64_t{1} << h) == 0; h++) {
+            Instance &instance = instances[h];
+            auth[h] = instance.node;
+            uint64_t start = (following + (uint64_t{1} << h)) ^ (uint64_t{1} << h);
+            if(start < (uint64_t{1} << height)) {
+                instance.start(static_cast<uint32_t>(start));
+            }
+        }
+
+        for(uint step = 0; step + 1 < 2 * height; step++) {
+            Instance *focus = nullptr;
+            for(Instance &instance : instances) {
+                if(instance.active && (focus == nullptr || instance.low() < focus->low())) {
+                    focus = &instance;
+                }
+            }
+            if(focus == nullptr) {
+                break;
+            }
+            update(*focus);
+        }
+
+        current++;
+    }
+
+    /// Nodes held by the traversal: the co-path, the finished instance nodes and the stacks.
+    size_t stored_nodes() const {
+        size_t n = auth.size() + instances.size();
+        for(const Instance &instance : instances) {
+            n += instance.stack.size();
+        }
+        return n;
+    }
+
+private:
+    struct Node {
+        uint level;
+        uint32_t position;
+        Domain node;
+    };
+
+    /// Computes the level-`height` node whose leaves start at relative position `next_leaf`.
+    struct Instance {
+        uint height = 0;
+        bool active = false;
+        uint32_t next_leaf = 0;
+        std::vector<Node> stack;
+        /// the last node computed
+        Domain node;
+
+        void start(uint32_t first) {
+            active = true;
+            next_leaf = first;
+            stack.clear();
+        }
+
+        /// height of the lowest pending node
+        uint low() const { return stack.empty() ? height : stack.back().level; }
+    };
+
+    Parameter parameter;
+    TH th;
+    LeafFn leaf_fn;
+    std::vector<Domain> auth;
+    std::vector<Instance> instances;
+    uint32_t current;
+
+    void update(Instance &instance) {
+        uint32_t position = first_leaf + instance.next_leaf++;
+        Node node{0, position, leaf_fn(position)};
+        while(!instance.stack.empty() && instance.stack.back().level == node.level) {
+            Domain children[2] = {instance.stack.back().node, node.node};
+            instance.stack.pop_back();
+            node.level++;
+            node.position >>= 1;
+            node.node = th.apply(parameter, th.tree_tweak(static_cast<uint8_t>(node.level), node.position),
+                                 std::span<const Domain>(children));
+        }
+        if(node.level == instance.height) {
+            instance.node = std::move(node.node);
+            instance.active = false;
+        } else {
+            instance.stack.push_back(std::move(node));
+        }
+    }
+};
@@ -23,7 +23,7 @@ public:
     typedef Parameter_t Parameter;
     typedef Randomness_t Randomness;
 
-    static constexpr unsigned int MESSAGE_LENGTH = params::MESSAGE_LENGTH;
+    static constexpr unsigned int MESSAGE_LENGTH = ::MESSAGE_LENGTH;
 
     // number of entries in a hash
     static constexpr unsigned int DIMENSION = DIMENSION_t;
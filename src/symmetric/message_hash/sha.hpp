@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <stdexcept>
 #include <bit>
 #include <iomanip>
@@ -7,6 +8,8 @@
 #include "../../random.hpp"
 #include "../message_hash.hpp"
 #include "../message_hash_pubFn.hpp"
+#include "../evp_context.hpp"
+#include "../sha256/dispatch.hpp"
 
 // A message hash implemented using SHA3
 /// All lengths must be given in Bytes.
@@ -24,67 +27,58 @@ public MessageHash<std::array<uint8_t, PARAMETER_LEN>, std::array<uint8_t, RAND_
 
     static Randomness rand()
     {
-        CryptoRng<uint8_t, RAND_LEN> crypto_rng;
-        return crypto_rng.generate_array();
+        Randomness randomness;
+        CryptoRng<uint8_t> crypto_rng;
+        crypto_rng.fill_bytes(randomness.data(), RAND_LEN);
+        return randomness;
     }
 
+    /// The SHA-256 implementation is picked per input length by `sha256::Dispatch`. OpenSSL is
+    /// fed the parts one by one through the thread's `EvpContext`; the in-tree kernel hashes a
+    /// serialized copy, on the stack unless the message is long.
     std::vector<uint8_t> apply(Parameter parameter, uint32_t epoch, Randomness randomness,
                                std::vector<uint8_t> message) override
     {
-        unsigned char *digest;
-        unsigned int digest_len;
-
-        EVP_MD_CTX *mdctx;
-        if ((mdctx = EVP_MD_CTX_new()) == NULL)
-        {
-            throw std::runtime_error("Failed to create EVP_MD_CTX");
-        }
-
-        if (1 != EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL))
-        {
-            throw std::runtime_error("Failed to initialize digest");
-        }
-
-        if (1 != EVP_DigestUpdate(mdctx, randomness.data(), randomness.size()))
-        {
-            throw std::runtime_error("Failed to update digest");
-        }
-
-        if (1 != EVP_DigestUpdate(mdctx, parameter.data(), parameter.size()))
-        {
-            throw std::runtime_error("Failed to update digest");
-        }
+        constexpr size_t PREFIX_LEN = RAND_LEN + PARAMETER_LEN + 1 + sizeof(uint32_t);
+        const size_t len = PREFIX_LEN + message.size();
 
         uint8_t TWEAK_SEPARATOR_FOR_MESSAGE_HASH_t = TWEAK_SEPARATOR_FOR_MESSAGE_HASH;
-        if (1 != EVP_DigestUpdate(mdctx, &TWEAK_SEPARATOR_FOR_MESSAGE_HASH_t, sizeof(TWEAK_SEPARATOR_FOR_MESSAGE_HASH_t)))
-        {
-            throw std::runtime_error("Failed to update digest");
-        }
-
         uint32_t le_epoch = endian::to_le(epoch);
 
-        if (1 != EVP_DigestUpdate(mdctx, &le_epoch, sizeof(le_epoch)))
+        uint8_t digest[sha256::DIGEST_LEN];
+        if (sha256::Dispatch::single(len) == sha256::Dispatch::OPENSSL)
         {
-            throw std::runtime_error("Failed to update digest with epoch");
-        }
+            EVP_MD_CTX *mdctx = EvpContext::start(EvpAlgorithm::SHA256);
 
-        if (1 != EVP_DigestUpdate(mdctx, message.data(), message.size()))
-        {
-            throw std::runtime_error("Failed to update digest with index");
-        }
+            EvpContext::update(mdctx, randomness.data(), randomness.size());
+            EvpContext::update(mdctx, parameter.data(), parameter.size());
+            EvpContext::update(mdctx, &TWEAK_SEPARATOR_FOR_MESSAGE_HASH_t, sizeof(TWEAK_SEPARATOR_FOR_MESSAGE_HASH_t));
+            EvpContext::update(mdctx, &le_epoch, sizeof(le_epoch));
+            EvpContext::update(mdctx, message.data(), message.size());
 
-        if ((digest = (unsigned char *)OPENSSL_malloc(EVP_MD_size(EVP_sha256()))) == NULL)
-        {
-            throw std::runtime_error("Failed to allocate memory for digest");
+            EvpContext::finish(mdctx, digest);
         }
-
-        if (1 != EVP_DigestFinal_ex(mdctx, digest, &digest_len))
+        else
         {
-            throw std::runtime_error("Failed to finalize digest");
+            uint8_t small[PREFIX_LEN + 2 * sha256::BLOCK_LEN];
+            std::vector<uint8_t> large;
+            uint8_t *input = small;
+            if (len > sizeof(small))
+            {
+                large.resize(len);
+                input = large.data();
+            }
+
+            uint8_t *dst = std::copy(randomness.begin(), randomness.end(), input);
+            dst = std::copy(parameter.begin(), parameter.end(), dst);
+            *dst++ = TWEAK_SEPARATOR_FOR_MESSAGE_HASH_t;
+            const uint8_t *epoch_bytes = reinterpret_cast<const uint8_t *>(&le_epoch);
+            dst = std::copy(epoch_bytes, epoch_bytes + sizeof(le_epoch), dst);
+            std::copy(message.begin(), message.end(), dst);
+
+            sha256::hash_from(sha256::IV, 0, input, len, digest);
         }
 
-        EVP_MD_CTX_free(mdctx);
-
         int slice = NUM_CHUNKS * CHUNK_SIZE / 8;
 
         std::vector<uint8_t> output(digest, digest + slice);
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <stdexcept>
+#include <cassert>
+#include <array>
+#include <vector>
+#include <openssl/rand.h>
+#include "../message_hash.hpp"
+#include "../message_hash_pubFn.hpp"
+#include "../keccak/keccak.hpp"
+
+// A message hash implemented using SHA3-256 or SHAKE128
+/// V(randomness || parameter || TWEAK_SEPARATOR_FOR_MESSAGE_HASH || epoch (4 bytes, little-endian) || message),
+/// truncated to NUM_CHUNKS * CHUNK_SIZE bits and split into chunks, like ShaMessageHash.
+/// All lengths must be given in Bytes.
+/// Randomness length must be non-zero.
+/// CHUNK_SIZE has to be 1,2,4, or 8.
+template <typename V, size_t PARAMETER_LEN, size_t RAND_LEN, size_t NUM_CHUNKS, size_t CHUNK_SIZE>
+struct KeccakMessageHash :
+public MessageHash<std::array<uint8_t, PARAMETER_LEN>, std::array<uint8_t, RAND_LEN>, NUM_CHUNKS, 1 << CHUNK_SIZE>
+{
+    using Parameter = std::array<uint8_t, PARAMETER_LEN>;
+    using Randomness = std::array<uint8_t, RAND_LEN>;
+    using Sponge = keccak::Sponge<V>;
+
+    static constexpr size_t OUTPUT_LEN = NUM_CHUNKS * CHUNK_SIZE / 8;
+
+    KeccakMessageHash() {}
+
+    static Randomness rand()
+    {
+        Randomness randomness;
+        if (RAND_bytes(randomness.data(), RAND_LEN) != 1)
+        {
+            throw std::runtime_error("Failed to generate random rand");
+        }
+        return randomness;
+    }
+
+    std::vector<uint8_t> apply(Parameter parameter, uint32_t epoch, Randomness randomness,
+                               std::vector<uint8_t> message) override
+    {
+        std::vector<uint8_t> input = serialize(parameter, epoch, randomness, message);
+
+        std::vector<uint8_t> output(OUTPUT_LEN);
+        Sponge::hash(input.data(), input.size(), output.data(), OUTPUT_LEN);
+        return MessageHashPubFn::bytes_to_chunks(output, CHUNK_SIZE);
+    }
+
+    /// Hashes many (epoch, randomness, message) triples under one parameter, e.g. when
+    /// verifying a batch of signatures. Groups of four messages of the same length run on
+    /// the 4-lane Keccak.
+    std::vector<std::vector<uint8_t>> apply_many(const Parameter &parameter, const std::vector<uint32_t> &epochs,
+                                                 const std::vector<Randomness> &randomness,
+                                                 const std::vector<std::vector<uint8_t>> &messages)
+    {
+        if (epochs.size() != messages.size() || randomness.size() != messages.size())
+        {
+            throw std::invalid_argument("apply_many: number of epochs, randomness and messages differ");
+        }
+
+        const size_t n = messages.size();
+        std::vector<std::vector<uint8_t>> inputs(n);
+        std::vector<std::vector<uint8_t>> outputs(n, std::vector<uint8_t>(OUTPUT_LEN));
+        for (size_t i = 0; i < n; i++)
+        {
+            inputs[i] = serialize(parameter, epochs[i], randomness[i], messages[i]);
+        }
+
+        constexpr size_t lanes = keccak::Keccak::LANES;
+        const bool multi_lane = n > 0 && Sponge::use_x4(inputs[0].size());
+
+        size_t i = 0;
+        while (i < n)
+        {
+            size_t used = 1;
+            while (multi_lane && used < lanes && i + used < n && inputs[i + used].size() == inputs[i].size())
+            {
+                used++;
+            }
+
+            if (used < 2)
+            {
+                Sponge::hash(inputs[i].data(), inputs[i].size(), outputs[i].data(), OUTPUT_LEN);
+            }
+            else
+            {
+                // unused lanes recompute the last input, their output is dropped
+                std::vector<uint8_t> spare(OUTPUT_LEN);
+                const uint8_t *in[lanes];
+                uint8_t *out[lanes];
+                for (size_t l = 0; l < lanes; l++)
+                {
+                    in[l] = inputs[i + std::min(l, used - 1)].data();
+                    out[l] = (l < used) ? outputs[i + l].data() : spare.data();
+                }
+                Sponge::hash_x4(in, inputs[i].size(), out, OUTPUT_LEN);
+            }
+            i += used;
+        }
+
+        std::vector<std::vector<uint8_t>> results(n);
+        for (size_t k = 0; k < n; k++)
+        {
+            results[k] = MessageHashPubFn::bytes_to_chunks(outputs[k], CHUNK_SIZE);
+        }
+        return results;
+    }
+
+    void internal_consistency_check() override
+    {
+        assert("SHA3 Message Hash: Chunk Size must be 1, 2, 4, or 8" &&
+               (CHUNK_SIZE == 1 || CHUNK_SIZE == 2 || CHUNK_SIZE == 4 || CHUNK_SIZE == 8));
+
+        assert(
+            RAND_LEN > 0 &&
+            "SHA3 Message Hash: Randomness Length must be non-zero");
+
+        assert(
+            (OUTPUT_LEN <= V::OUT_LEN || V::SUFFIX == keccak::Shake128::SUFFIX) &&
+            "SHA3 Message Hash: Hash Length (= NUM_CHUNKS * CHUNK_SIZE) must be at most 256 bits");
+
+        assert(
+            (this->BASE <= 1 << 8) &&
+            "SHA3 Message Hash: Base must be at most 2^8");
+
+        assert(
+            (this->DIMENSION <= 1 << 8) &&
+            "SHA3 Message Hash: Dimension must be at most 2^8");
+    }
+
+private:
+    static std::vector<uint8_t> serialize(const Parameter &parameter, uint32_t epoch, const Randomness &randomness,
+                                          const std::vector<uint8_t> &message)
+    {
+        std::vector<uint8_t> input;
+        input.reserve(RAND_LEN + PARAMETER_LEN + 1 + 4 + message.size());
+        input.insert(input.end(), randomness.begin(), randomness.end());
+        input.insert(input.end(), parameter.begin(), parameter.end());
+        input.push_back(static_cast<uint8_t>(TWEAK_SEPARATOR_FOR_MESSAGE_HASH));
+        for (int b = 0; b < 4; b++)
+        {
+            input.push_back(static_cast<uint8_t>(epoch >> (8 * b)));
+        }
+        input.insert(input.end(), message.begin(), message.end());
+        return input;
+    }
+};
+
+template <size_t PARAMETER_LEN, size_t RAND_LEN, size_t NUM_CHUNKS, size_t CHUNK_SIZE>
+using Sha3MessageHash = KeccakMessageHash<keccak::Sha3_256, PARAMETER_LEN, RAND_LEN, NUM_CHUNKS, CHUNK_SIZE>;
+
+template <size_t PARAMETER_LEN, size_t RAND_LEN, size_t NUM_CHUNKS, size_t CHUNK_SIZE>
+using ShakeMessageHash = KeccakMessageHash<keccak::Shake128, PARAMETER_LEN, RAND_LEN, NUM_CHUNKS, CHUNK_SIZE>;
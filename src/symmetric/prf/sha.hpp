@@ -1,5 +1,7 @@
 #pragma once
 #include "../prf.hpp"
+#include <vector>
+#include <cstdint>
 
 constexpr unsigned int KEY_LENGTH = 32;
 
@@ -0,0 +1,246 @@
+#pragma once
+
+#include "constants.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_COMPRESS_X86 1
+#endif
+
+/// In-tree SHA-256 compression function.
+///
+/// The tweakable hash inputs have lengths that are known at compile time, so the
+/// padding can be laid out once instead of going through EVP's generic buffering.
+/// `compress` uses the SHA extensions (SHA-NI) when the CPU has them and a portable
+/// implementation otherwise.
+namespace sha256
+{
+    struct Compress
+    {
+        static bool has_sha_ni()
+        {
+#ifdef SHA256_COMPRESS_X86
+            static const bool supported = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+            return supported;
+#else
+            return false;
+#endif
+        }
+
+        /// Applies the compression function to `state` for one 64-byte block.
+        static void compress(uint32_t state[8], const uint8_t block[BLOCK_LEN])
+        {
+#ifdef SHA256_COMPRESS_X86
+            if (has_sha_ni())
+            {
+                compress_sha_ni(state, block);
+                return;
+            }
+#endif
+            compress_portable(state, block);
+        }
+
+        static void compress_portable(uint32_t state[8], const uint8_t block[BLOCK_LEN])
+        {
+            uint32_t w[64];
+            for (int t = 0; t < 16; t++)
+            {
+                w[t] = (static_cast<uint32_t>(block[4 * t]) << 24) | (static_cast<uint32_t>(block[4 * t + 1]) << 16) |
+                       (static_cast<uint32_t>(block[4 * t + 2]) << 8) | static_cast<uint32_t>(block[4 * t + 3]);
+            }
+            for (int t = 16; t < 64; t++)
+            {
+                uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+                w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+            }
+
+            uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+            uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+            for (int t = 0; t < 64; t++)
+            {
+                uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+                uint32_t ch = (e & f) ^ (~e & g);
+                uint32_t t1 = h + S1 + ch + K[t] + w[t];
+                uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+                uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+                uint32_t t2 = S0 + maj;
+
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+
+            state[0] += a;
+            state[1] += b;
+            state[2] += c;
+            state[3] += d;
+            state[4] += e;
+            state[5] += f;
+            state[6] += g;
+            state[7] += h;
+        }
+
+#ifdef SHA256_COMPRESS_X86
+        /// Callers must check `has_sha_ni()`.
+        __attribute__((target("sha,sse4.1"))) static void compress_sha_ni(uint32_t state[8], const uint8_t block[BLOCK_LEN])
+        {
+            const __m128i MASK = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+            // the SHA instructions keep the state as (A, B, E, F) and (C, D, G, H)
+            __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0]));
+            __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4]));
+            tmp = _mm_shuffle_epi32(tmp, 0xB1);
+            state1 = _mm_shuffle_epi32(state1, 0x1B);
+            __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+            state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+            const __m128i abef_save = state0;
+            const __m128i cdgh_save = state1;
+
+            // message words of the last four groups of four rounds
+            __m128i w[4];
+            for (int i = 0; i < 16; i++)
+            {
+                __m128i &wi = w[i & 3];
+                if (i < 4)
+                {
+                    wi = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block + 16 * i)), MASK);
+                }
+                else
+                {
+                    wi = _mm_sha256msg1_epu32(wi, w[(i + 1) & 3]);
+                    wi = _mm_add_epi32(wi, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                    wi = _mm_sha256msg2_epu32(wi, w[(i + 3) & 3]);
+                }
+
+                __m128i msg = _mm_add_epi32(wi, _mm_loadu_si128(reinterpret_cast<const __m128i *>(&K[4 * i])));
+                state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+                msg = _mm_shuffle_epi32(msg, 0x0E);
+                state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            }
+
+            state0 = _mm_add_epi32(state0, abef_save);
+            state1 = _mm_add_epi32(state1, cdgh_save);
+
+            tmp = _mm_shuffle_epi32(state0, 0x1B);
+            state1 = _mm_shuffle_epi32(state1, 0xB1);
+            state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+            state1 = _mm_alignr_epi8(state1, tmp, 8);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+        }
+#endif
+
+        /// Writes the first `out_len` (at most 32) bytes of `state` in big-endian order.
+        static void output(const uint32_t state[8], uint8_t *out, std::size_t out_len)
+        {
+            uint8_t digest[DIGEST_LEN];
+            for (int i = 0; i < 8; i++)
+            {
+                digest[4 * i] = static_cast<uint8_t>(state[i] >> 24);
+                digest[4 * i + 1] = static_cast<uint8_t>(state[i] >> 16);
+                digest[4 * i + 2] = static_cast<uint8_t>(state[i] >> 8);
+                digest[4 * i + 3] = static_cast<uint8_t>(state[i]);
+            }
+            std::memcpy(out, digest, out_len);
+        }
+
+    private:
+        static constexpr uint32_t rotr(uint32_t x, int n)
+        {
+            return (x >> n) | (x << (32 - n));
+        }
+    };
+
+    /// SHA-256 of an input whose length LEN is fixed at compile time.
+    ///
+    /// The caller writes the LEN input bytes to the front of `block` (see `Block`), the
+    /// padding after them is filled in by `pad` once and can be reused for every hash of
+    /// the same shape. For the chain hash, parameter || tweak || domain value fits in a
+    /// single block, so each chain step is exactly one call of the compression function.
+    ///
+    /// PREFIX_BLOCKS full blocks may already have been absorbed into a midstate; they count
+    /// towards the encoded length and `hash_from` continues from that midstate.
+    template <std::size_t LEN, std::size_t PREFIX_BLOCKS = 0>
+    struct FixedInput
+    {
+        static constexpr std::size_t NUM_BLOCKS = num_blocks(LEN);
+
+        using Block = uint8_t[NUM_BLOCKS * BLOCK_LEN];
+
+        static void pad(Block &block)
+        {
+            std::memset(block + LEN, 0, sizeof(Block) - LEN);
+            block[LEN] = 0x80;
+
+            const uint64_t bit_len = static_cast<uint64_t>(PREFIX_BLOCKS * BLOCK_LEN + LEN) * 8;
+            for (std::size_t i = 0; i < LENGTH_FIELD_LEN; i++)
+            {
+                block[sizeof(Block) - 1 - i] = static_cast<uint8_t>(bit_len >> (8 * i));
+            }
+        }
+
+        /// Hashes the padded `block` and writes the first `out_len` digest bytes to `out`.
+        static void hash(const Block &block, uint8_t *out, std::size_t out_len = DIGEST_LEN)
+        {
+            static_assert(PREFIX_BLOCKS == 0, "use hash_from to continue from a midstate");
+            hash_from(IV, block, out, out_len);
+        }
+
+        /// Like `hash`, starting from the state after the PREFIX_BLOCKS prefix blocks.
+        static void hash_from(const uint32_t midstate[8], const Block &block, uint8_t *out, std::size_t out_len = DIGEST_LEN)
+        {
+            uint32_t state[8];
+            std::memcpy(state, midstate, sizeof(state));
+            for (std::size_t i = 0; i < NUM_BLOCKS; i++)
+            {
+                Compress::compress(state, block + i * BLOCK_LEN);
+            }
+            Compress::output(state, out, out_len);
+        }
+    };
+
+    /// SHA-256 of an input of runtime length `len`, continuing from the state after
+    /// `prefix_blocks` full blocks have been absorbed.
+    inline void hash_from(const uint32_t midstate[8], std::size_t prefix_blocks, const uint8_t *data, std::size_t len,
+                          uint8_t *out, std::size_t out_len = DIGEST_LEN)
+    {
+        uint32_t state[8];
+        std::memcpy(state, midstate, sizeof(state));
+
+        std::size_t full_blocks = len / BLOCK_LEN;
+        for (std::size_t i = 0; i < full_blocks; i++)
+        {
+            Compress::compress(state, data + i * BLOCK_LEN);
+        }
+
+        std::size_t rem = len - full_blocks * BLOCK_LEN;
+        std::size_t tail_len = (rem + 1 + LENGTH_FIELD_LEN <= BLOCK_LEN) ? BLOCK_LEN : 2 * BLOCK_LEN;
+        uint8_t tail[2 * BLOCK_LEN] = {0};
+        std::memcpy(tail, data + full_blocks * BLOCK_LEN, rem);
+        tail[rem] = 0x80;
+
+        const uint64_t bit_len = static_cast<uint64_t>(prefix_blocks * BLOCK_LEN + len) * 8;
+        for (std::size_t i = 0; i < LENGTH_FIELD_LEN; i++)
+        {
+            tail[tail_len - 1 - i] = static_cast<uint8_t>(bit_len >> (8 * i));
+        }
+
+        for (std::size_t i = 0; i < tail_len; i += BLOCK_LEN)
+        {
+            Compress::compress(state, tail + i);
+        }
+        Compress::output(state, out, out_len);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "constants.hpp"
+#include "compress.hpp"
+#include "multi_lane.hpp"
+#include "../dispatch.hpp"
+#include "../evp_context.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/// Runtime choice between the SHA-256 implementations.
+///
+/// A single hash can go through OpenSSL (whose assembly uses SHA-NI or AVX2 itself) or
+/// through the in-tree compression function (SHA-NI or portable); a batch of equal-length
+/// inputs can additionally run on the 8-lane AVX2 or 16-lane AVX-512 kernels. Which one is
+/// fastest depends on the CPU and on the input length (e.g. AVX-512 frequency drops), so
+/// `KernelSelector` times them once per input length.
+namespace sha256
+{
+    struct Dispatch
+    {
+        enum Single : int
+        {
+            OPENSSL = 0,
+            IN_TREE = 1,
+        };
+
+        /// Kernel used by `hash` for inputs of `len` bytes.
+        static Single single(std::size_t len)
+        {
+            return static_cast<Single>(KernelSelector::select("sha256", len, [len](KernelSelector::Bench &bench)
+            {
+                Inputs inputs(len, 4);
+                bench.candidate(OPENSSL, "sha256-openssl", 4, [&]
+                {
+                    for (std::size_t i = 0; i < 4; i++)
+                    {
+                        hash_openssl(inputs.in[i], len, inputs.out[i]);
+                    }
+                });
+                bench.candidate(IN_TREE, Compress::has_sha_ni() ? "sha256-sha-ni" : "sha256-portable", 4, [&]
+                {
+                    for (std::size_t i = 0; i < 4; i++)
+                    {
+                        hash_from(IV, 0, inputs.in[i], len, inputs.out[i]);
+                    }
+                });
+            }));
+        }
+
+        /// Number of inputs of `len` bytes to hash at once: 16, 8, or 0 for one by one with `hash`.
+        static std::size_t lanes(std::size_t len)
+        {
+            // outside the selector's lock, the batch benchmark below uses the single kernel
+            single(len);
+
+            return static_cast<std::size_t>(KernelSelector::select("sha256-batch", len, [len](KernelSelector::Bench &bench)
+            {
+                Inputs inputs(len, MultiLane::LANES_AVX512);
+                if (MultiLane::has_avx512())
+                {
+                    bench.candidate(MultiLane::LANES_AVX512, "sha256-avx512-x16", MultiLane::LANES_AVX512, [&]
+                    {
+                        MultiLane::hash_x16(inputs.in.data(), len, inputs.out.data());
+                    });
+                }
+                if (MultiLane::has_avx2())
+                {
+                    bench.candidate(MultiLane::LANES_AVX2, "sha256-avx2-x8", MultiLane::LANES_AVX512, [&]
+                    {
+                        MultiLane::hash_x8(inputs.in.data(), len, inputs.out.data());
+                        MultiLane::hash_x8(inputs.in.data() + MultiLane::LANES_AVX2, len, inputs.out.data() + MultiLane::LANES_AVX2);
+                    });
+                }
+                bench.candidate(0, "sha256-one-by-one", MultiLane::LANES_AVX512, [&]
+                {
+                    for (std::size_t i = 0; i < MultiLane::LANES_AVX512; i++)
+                    {
+                        hash(inputs.in[i], len, inputs.out[i]);
+                    }
+                });
+            }));
+        }
+
+        /// SHA-256 of `len` bytes with the kernel selected for that length.
+        static void hash(const uint8_t *in, std::size_t len, uint8_t out[DIGEST_LEN])
+        {
+            if (single(len) == IN_TREE)
+            {
+                hash_from(IV, 0, in, len, out);
+            }
+            else
+            {
+                hash_openssl(in, len, out);
+            }
+        }
+
+        static void hash_openssl(const uint8_t *in, std::size_t len, uint8_t out[DIGEST_LEN])
+        {
+            EVP_MD_CTX *mdctx = EvpContext::start(EvpAlgorithm::SHA256);
+            EvpContext::update(mdctx, in, len);
+            EvpContext::finish(mdctx, out);
+        }
+
+    private:
+        /// benchmark inputs: `count` distinct inputs of `len` bytes and room for their digests
+        struct Inputs
+        {
+            std::vector<uint8_t> bytes, digests;
+            std::vector<const uint8_t *> in;
+            std::vector<uint8_t *> out;
+
+            Inputs(std::size_t len, std::size_t count) : bytes(len * count), digests(DIGEST_LEN * count), in(count), out(count)
+            {
+                for (std::size_t i = 0; i < bytes.size(); i++)
+                {
+                    bytes[i] = static_cast<uint8_t>(i * 131 + 7);
+                }
+                for (std::size_t i = 0; i < count; i++)
+                {
+                    in[i] = bytes.data() + i * len;
+                    out[i] = digests.data() + i * DIGEST_LEN;
+                }
+            }
+        };
+    };
+}
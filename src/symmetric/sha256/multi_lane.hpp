@@ -0,0 +1,365 @@
+#pragma once
+
+#include "constants.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SHA256_MULTI_LANE_X86 1
+#endif
+
+/// Multi-lane SHA-256.
+///
+/// Hashes 8 (AVX2) or 16 (AVX-512) independent messages at once, one message per
+/// 32-bit SIMD lane. All messages of one call must have the same length, which is
+/// the case for the tweakable hash: the parameter, the tweak and the message have
+/// fixed lengths for a given instantiation.
+///
+/// The kernels are compiled with function-level target attributes, so the rest of
+/// the library does not need to be built with -mavx2 / -mavx512f. Callers must check
+/// `has_avx2()` / `has_avx512()` before calling the matching kernel.
+namespace sha256
+{
+    struct MultiLane
+    {
+        static constexpr std::size_t LANES_AVX2 = 8;
+        static constexpr std::size_t LANES_AVX512 = 16;
+
+        static bool has_avx2()
+        {
+#ifdef SHA256_MULTI_LANE_X86
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+
+        static bool has_avx512()
+        {
+#ifdef SHA256_MULTI_LANE_X86
+            return __builtin_cpu_supports("avx512f");
+#else
+            return false;
+#endif
+        }
+
+        /// Widest kernel available on this CPU, 0 if none.
+        static std::size_t lanes()
+        {
+            if (has_avx512())
+            {
+                return LANES_AVX512;
+            }
+            if (has_avx2())
+            {
+                return LANES_AVX2;
+            }
+            return 0;
+        }
+
+        /// Hashes `in[0..8)`, each `len` bytes long, and writes the 32-byte digests to `out[0..8)`.
+        static void hash_x8(const uint8_t *const in[LANES_AVX2], std::size_t len, uint8_t *const out[LANES_AVX2]);
+
+        /// Hashes `in[0..16)`, each `len` bytes long, and writes the 32-byte digests to `out[0..16)`.
+        static void hash_x16(const uint8_t *const in[LANES_AVX512], std::size_t len, uint8_t *const out[LANES_AVX512]);
+
+    private:
+        /// Padded tail of a message: the trailing partial block, 0x80, zeros and the bit length.
+        /// The tail spans one or two blocks.
+        struct Tail
+        {
+            uint8_t bytes[2 * BLOCK_LEN];
+        };
+
+        static std::size_t make_tail(const uint8_t *in, std::size_t len, Tail &tail)
+        {
+            std::size_t full_blocks = len / BLOCK_LEN;
+            std::size_t rem = len - full_blocks * BLOCK_LEN;
+            std::size_t tail_blocks = num_blocks(len) - full_blocks;
+
+            std::memset(tail.bytes, 0, sizeof(tail.bytes));
+            std::memcpy(tail.bytes, in + full_blocks * BLOCK_LEN, rem);
+            tail.bytes[rem] = 0x80;
+
+            uint64_t bit_len = static_cast<uint64_t>(len) * 8;
+            std::size_t end = tail_blocks * BLOCK_LEN;
+            for (std::size_t i = 0; i < LENGTH_FIELD_LEN; i++)
+            {
+                tail.bytes[end - 1 - i] = static_cast<uint8_t>(bit_len >> (8 * i));
+            }
+            return full_blocks;
+        }
+
+        static uint32_t load_be32(const uint8_t *p)
+        {
+            return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+                   (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+        }
+
+        static void store_be32(uint8_t *p, uint32_t v)
+        {
+            p[0] = static_cast<uint8_t>(v >> 24);
+            p[1] = static_cast<uint8_t>(v >> 16);
+            p[2] = static_cast<uint8_t>(v >> 8);
+            p[3] = static_cast<uint8_t>(v);
+        }
+
+        /// Transposes block `block` of every lane into `w[word][lane]`.
+        template <std::size_t LANES>
+        static void gather_block(const uint8_t *const in[LANES], const Tail tails[LANES], std::size_t full_blocks,
+                                 std::size_t block, uint32_t w[16][LANES])
+        {
+            for (std::size_t lane = 0; lane < LANES; lane++)
+            {
+                const uint8_t *src = (block < full_blocks)
+                                         ? in[lane] + block * BLOCK_LEN
+                                         : tails[lane].bytes + (block - full_blocks) * BLOCK_LEN;
+                for (std::size_t j = 0; j < 16; j++)
+                {
+                    w[j][lane] = load_be32(src + 4 * j);
+                }
+            }
+        }
+
+#ifdef SHA256_MULTI_LANE_X86
+        // ---- AVX2, 8 lanes ----
+
+        __attribute__((target("avx2"))) static inline __m256i rotr8(__m256i x, int n)
+        {
+            return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+        }
+
+        __attribute__((target("avx2"))) static void compress_x8(__m256i state[8], const uint32_t w_in[16][LANES_AVX2])
+        {
+            __m256i w[16];
+            for (int j = 0; j < 16; j++)
+            {
+                w[j] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(w_in[j]));
+            }
+
+            __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+            __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+
+            for (int t = 0; t < 64; t++)
+            {
+                __m256i wt;
+                if (t < 16)
+                {
+                    wt = w[t];
+                }
+                else
+                {
+                    __m256i w15 = w[(t - 15) & 15];
+                    __m256i w2 = w[(t - 2) & 15];
+                    __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+                    __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+                    wt = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+                    w[t & 15] = wt;
+                }
+
+                __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+                __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+                __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, wt));
+                t1 = _mm256_add_epi32(t1, _mm256_set1_epi32(static_cast<int>(K[t])));
+                __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+                __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+                __m256i t2 = _mm256_add_epi32(S0, maj);
+
+                h = g;
+                g = f;
+                f = e;
+                e = _mm256_add_epi32(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm256_add_epi32(t1, t2);
+            }
+
+            state[0] = _mm256_add_epi32(state[0], a);
+            state[1] = _mm256_add_epi32(state[1], b);
+            state[2] = _mm256_add_epi32(state[2], c);
+            state[3] = _mm256_add_epi32(state[3], d);
+            state[4] = _mm256_add_epi32(state[4], e);
+            state[5] = _mm256_add_epi32(state[5], f);
+            state[6] = _mm256_add_epi32(state[6], g);
+            state[7] = _mm256_add_epi32(state[7], h);
+        }
+
+        __attribute__((target("avx2"))) static void hash_x8_avx2(const uint8_t *const in[LANES_AVX2], std::size_t len,
+                                                                 uint8_t *const out[LANES_AVX2])
+        {
+            Tail tails[LANES_AVX2];
+            std::size_t full_blocks = 0;
+            for (std::size_t lane = 0; lane < LANES_AVX2; lane++)
+            {
+                full_blocks = make_tail(in[lane], len, tails[lane]);
+            }
+
+            __m256i state[8];
+            for (int i = 0; i < 8; i++)
+            {
+                state[i] = _mm256_set1_epi32(static_cast<int>(IV[i]));
+            }
+
+            alignas(32) uint32_t w[16][LANES_AVX2];
+            for (std::size_t block = 0; block < num_blocks(len); block++)
+            {
+                gather_block<LANES_AVX2>(in, tails, full_blocks, block, w);
+                compress_x8(state, w);
+            }
+
+            alignas(32) uint32_t digest[8][LANES_AVX2];
+            for (int i = 0; i < 8; i++)
+            {
+                _mm256_store_si256(reinterpret_cast<__m256i *>(digest[i]), state[i]);
+            }
+            for (std::size_t lane = 0; lane < LANES_AVX2; lane++)
+            {
+                for (int i = 0; i < 8; i++)
+                {
+                    store_be32(out[lane] + 4 * i, digest[i][lane]);
+                }
+            }
+        }
+
+        // ---- AVX-512, 16 lanes ----
+
+        // GCC's unmasked _mm512_ror_epi32 and _mm512_srli_epi32 merge into an undefined vector,
+        // which trips -Wuninitialized in every includer; the zero-masked forms with all lanes
+        // selected are the same instructions without it.
+        template <int N>
+        __attribute__((target("avx512f"))) static __m512i ror_x16(__m512i x)
+        {
+            return _mm512_maskz_ror_epi32(0xFFFF, x, N);
+        }
+
+        template <int N>
+        __attribute__((target("avx512f"))) static __m512i shr_x16(__m512i x)
+        {
+            return _mm512_maskz_srli_epi32(0xFFFF, x, N);
+        }
+
+        __attribute__((target("avx512f"))) static void compress_x16(__m512i state[8], const uint32_t w_in[16][LANES_AVX512])
+        {
+            __m512i w[16];
+            for (int j = 0; j < 16; j++)
+            {
+                w[j] = _mm512_loadu_si512(w_in[j]);
+            }
+
+            __m512i a = state[0], b = state[1], c = state[2], d = state[3];
+            __m512i e = state[4], f = state[5], g = state[6], h = state[7];
+
+            for (int t = 0; t < 64; t++)
+            {
+                __m512i wt;
+                if (t < 16)
+                {
+                    wt = w[t];
+                }
+                else
+                {
+                    __m512i w15 = w[(t - 15) & 15];
+                    __m512i w2 = w[(t - 2) & 15];
+                    __m512i s0 = _mm512_ternarylogic_epi32(ror_x16<7>(w15), ror_x16<18>(w15),
+                                                           shr_x16<3>(w15), 0x96);
+                    __m512i s1 = _mm512_ternarylogic_epi32(ror_x16<17>(w2), ror_x16<19>(w2),
+                                                           shr_x16<10>(w2), 0x96);
+                    wt = _mm512_add_epi32(_mm512_add_epi32(w[t & 15], s0), _mm512_add_epi32(w[(t - 7) & 15], s1));
+                    w[t & 15] = wt;
+                }
+
+                // 0x96: a ^ b ^ c, 0xCA: a ? b : c (choose), 0xE8: majority
+                __m512i S1 = _mm512_ternarylogic_epi32(ror_x16<6>(e), ror_x16<11>(e),
+                                                       ror_x16<25>(e), 0x96);
+                __m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+                __m512i t1 = _mm512_add_epi32(_mm512_add_epi32(h, S1), _mm512_add_epi32(ch, wt));
+                t1 = _mm512_add_epi32(t1, _mm512_set1_epi32(static_cast<int>(K[t])));
+                __m512i S0 = _mm512_ternarylogic_epi32(ror_x16<2>(a), ror_x16<13>(a),
+                                                       ror_x16<22>(a), 0x96);
+                __m512i maj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+                __m512i t2 = _mm512_add_epi32(S0, maj);
+
+                h = g;
+                g = f;
+                f = e;
+                e = _mm512_add_epi32(d, t1);
+                d = c;
+                c = b;
+                b = a;
+                a = _mm512_add_epi32(t1, t2);
+            }
+
+            state[0] = _mm512_add_epi32(state[0], a);
+            state[1] = _mm512_add_epi32(state[1], b);
+            state[2] = _mm512_add_epi32(state[2], c);
+            state[3] = _mm512_add_epi32(state[3], d);
+            state[4] = _mm512_add_epi32(state[4], e);
+            state[5] = _mm512_add_epi32(state[5], f);
+            state[6] = _mm512_add_epi32(state[6], g);
+            state[7] = _mm512_add_epi32(state[7], h);
+        }
+
+        __attribute__((target("avx512f"))) static void hash_x16_avx512(const uint8_t *const in[LANES_AVX512], std::size_t len,
+                                                                       uint8_t *const out[LANES_AVX512])
+        {
+            Tail tails[LANES_AVX512];
+            std::size_t full_blocks = 0;
+            for (std::size_t lane = 0; lane < LANES_AVX512; lane++)
+            {
+                full_blocks = make_tail(in[lane], len, tails[lane]);
+            }
+
+            __m512i state[8];
+            for (int i = 0; i < 8; i++)
+            {
+                state[i] = _mm512_set1_epi32(static_cast<int>(IV[i]));
+            }
+
+            alignas(64) uint32_t w[16][LANES_AVX512];
+            for (std::size_t block = 0; block < num_blocks(len); block++)
+            {
+                gather_block<LANES_AVX512>(in, tails, full_blocks, block, w);
+                compress_x16(state, w);
+            }
+
+            alignas(64) uint32_t digest[8][LANES_AVX512];
+            for (int i = 0; i < 8; i++)
+            {
+                _mm512_store_si512(digest[i], state[i]);
+            }
+            for (std::size_t lane = 0; lane < LANES_AVX512; lane++)
+            {
+                for (int i = 0; i < 8; i++)
+                {
+                    store_be32(out[lane] + 4 * i, digest[i][lane]);
+                }
+            }
+        }
+#endif
+    };
+
+    inline void MultiLane::hash_x8(const uint8_t *const in[LANES_AVX2], std::size_t len, uint8_t *const out[LANES_AVX2])
+    {
+#ifdef SHA256_MULTI_LANE_X86
+        hash_x8_avx2(in, len, out);
+#else
+        (void)in;
+        (void)len;
+        (void)out;
+#endif
+    }
+
+    inline void MultiLane::hash_x16(const uint8_t *const in[LANES_AVX512], std::size_t len, uint8_t *const out[LANES_AVX512])
+    {
+#ifdef SHA256_MULTI_LANE_X86
+        hash_x16_avx512(in, len, out);
+#else
+        (void)in;
+        (void)len;
+        (void)out;
+#endif
+    }
+}
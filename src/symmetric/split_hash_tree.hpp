@@ -0,0 +1,257 @@
+#pragma once
+
+#include "tweak_hash_tree.hpp"
+#include "merkle_traversal.hpp"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+/// A Merkle tree of depth `depth` held as a top tree plus at most two bottom trees.
+///
+/// The top tree holds the levels from `bottom_height` up, i.e. one node per bottom tree root
+/// and above. Bottom tree b spans the leaves [b * 2^bottom_height, (b + 1) * 2^bottom_height)
+/// and is rebuilt from the leaves by `build` when needed. With bottom_height = depth / 2 both
+/// parts hold about sqrt(2^depth) leaves, so memory grows with the square root of the lifetime.
+///
+/// Epochs are used in increasing order, so the tree keeps the bottom tree of the current epoch
+/// and builds the next one on a background thread as soon as the current one is in use. When
+/// the epochs move on, `path` switches to it and starts on the one after. A co-path inside the
+/// two held bottom trees is a lookup of `depth` nodes; an epoch elsewhere builds its bottom tree
+/// first. All members are safe to call from several threads.
+///
+/// The background builds call the scheme's executor. A `path` from inside a task of a
+/// `WorkStealingScheduler` does not wait for one that is still running, as it may queue
+/// behind the call running the task: it builds the bottom tree, or starts the traversal,
+/// itself, with nested `parallel_for` calls running inline.
+///
+/// Constructed with a `StartTraversal` instead, the tree keeps no bottom trees at all but a
+/// `MerkleTraversal` through the current one, and prepares the traversal of the next one in
+/// the background. The bottom levels then cost O(bottom_height) nodes, and co-paths for
+/// increasing epochs cost at most 2 * bottom_height - 1 leaves each. An epoch before the
+/// traversal's current leaf starts a new traversal, which walks the whole bottom tree once.
+template <TweakableHash_c TH>
+class SplitHashTree {
+public:
+    using TH_domain = typename TH::Domain;
+
+    /// Builds bottom tree `bottom`: a `HashTree` of depth `bottom_height` over its leaves.
+    using BuildBottom = std::function<HashTree<TH>(uint32_t bottom)>;
+
+    /// Starts a traversal of the bottom tree below leaf `position`, at that leaf.
+    using StartTraversal = std::function<MerkleTraversal<TH>(uint32_t position)>;
+
+    /// `top` holds the levels from `bottom_height` up for bottom trees
+    /// [first_bottom, first_bottom + num_bottoms).
+    SplitHashTree(uint _depth_, uint _bottom_height_, uint32_t _first_bottom_, uint32_t _num_bottoms_,
+                  HashTree<TH> _top_, BuildBottom _build_) :
+    depth(_depth_), bottom_height(_bottom_height_), first_bottom(_first_bottom_), num_bottoms(_num_bottoms_),
+    top(std::move(_top_)), build(std::move(_build_)) {}
+
+    SplitHashTree(uint _depth_, uint _bottom_height_, uint32_t _first_bottom_, uint32_t _num_bottoms_,
+                  HashTree<TH> _top_, StartTraversal _traverse_) :
+    depth(_depth_), bottom_height(_bottom_height_), first_bottom(_first_bottom_), num_bottoms(_num_bottoms_),
+    top(std::move(_top_)), traverse(std::move(_traverse_)) {}
+
+    SplitHashTree(const SplitHashTree &) = delete;
+    SplitHashTree &operator=(const SplitHashTree &) = delete;
+
+    const uint depth;
+    const uint bottom_height;
+    const uint32_t first_bottom;
+    const uint32_t num_bottoms;
+
+    TH_domain root() const { return top.root(); }
+
+    /// The co-path of leaf `position`, `depth` nodes long.
+    HashTreeOpening<TH> path(uint32_t position) {
+        const uint32_t bottom = position >> bottom_height;
+        if(bottom < first_bottom || bottom - first_bottom >= num_bottoms) {
+            throw std::invalid_argument("SplitHashTree: position outside the tree's bottom trees");
+        }
+
+        std::vector<TH_domain> co_path = traverse ? traversal_co_path(position, bottom) : bottom_tree_co_path(position, bottom);
+        std::vector<TH_domain> upper = top.path(bottom).co_path;
+        co_path.insert(co_path.end(), upper.begin(), upper.end());
+        return HashTreeOpening<TH>(co_path);
+    }
+
+    /// Starts building bottom tree `bottom`, or its traversal from the first leaf, in the
+    /// background, e.g. the first one right after key generation, unless it is held already.
+    void prepare(uint32_t bottom) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(held(bottom)) {
+            return;
+        }
+        if(traverse) {
+            replace(next_walk, start_walk(bottom << bottom_height));
+        } else {
+            replace(next, start_tree(bottom));
+        }
+    }
+
+    /// Whether bottom tree `bottom`, or a traversal of it, is held or being built.
+    bool holds(uint32_t bottom) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return held(bottom);
+    }
+
+private:
+    HashTree<TH> top;
+    BuildBottom build;
+    StartTraversal traverse;
+
+    /// A traversal is stateful, so it is advanced by one thread at a time.
+    struct Walk {
+        explicit Walk(MerkleTraversal<TH> _traversal_) : traversal(std::move(_traversal_)) {}
+
+        std::mutex mutex;
+        MerkleTraversal<TH> traversal;
+    };
+
+    /// For a walk, `leaf` is the latest leaf it has been handed out for.
+    template <typename T>
+    struct Slot {
+        uint32_t index;
+        std::shared_future<std::shared_ptr<T>> value;
+        uint32_t leaf = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::optional<Slot<const HashTree<TH>>> current;
+    std::optional<Slot<const HashTree<TH>>> next;
+    std::optional<Slot<Walk>> current_walk;
+    std::optional<Slot<Walk>> next_walk;
+
+    /// Background builds that were replaced before they finished. Dropping the last reference
+    /// to a `std::async` result waits for it, so they are kept until they are done.
+    std::vector<std::function<bool()>> retired;
+
+    bool held(uint32_t bottom) const {
+        auto matches = [&](const auto &slot) { return slot && slot->index == bottom; };
+        return matches(current) || matches(next) || matches(current_walk) || matches(next_walk);
+    }
+
+    bool has_bottom(uint64_t bottom) const { return bottom >= first_bottom && bottom - first_bottom < num_bottoms; }
+
+    template <typename T>
+    static bool ready(const std::shared_future<T> &future) {
+        return future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    /// Whether this thread may wait for `future`.
+    template <typename T>
+    static bool may_wait(const std::shared_future<T> &future) {
+        return !WorkStealingScheduler::in_task() || ready(future);
+    }
+
+    /// Sets `slot` to `value`, keeping an unfinished build that was there in `retired`.
+    template <typename T>
+    void replace(std::optional<Slot<T>> &slot, Slot<T> value) {
+        std::erase_if(retired, [](const std::function<bool()> &done) { return done(); });
+        if(slot && !ready(slot->value)) {
+            retired.push_back([future = slot->value] { return ready(future); });
+        }
+        slot = std::move(value);
+    }
+
+    std::vector<TH_domain> bottom_tree_co_path(uint32_t position, uint32_t bottom) {
+        std::shared_future<std::shared_ptr<const HashTree<TH>>> tree;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!current || current->index != bottom) {
+                if(next && next->index == bottom) {
+                    replace(current, std::move(*next));
+                    next.reset();
+                }
+                if(has_bottom(uint64_t{bottom} + 1) && !(next && next->index == bottom + 1)) {
+                    replace(next, start_tree(bottom + 1));
+                }
+            }
+            if(current && current->index == bottom) {
+                tree = current->value;
+            }
+        }
+        if(tree.valid() && may_wait(tree)) {
+            return tree.get()->path(position).co_path;
+        }
+
+        auto built = std::make_shared<const HashTree<TH>>(build(bottom));
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!current || current->index != bottom || !ready(current->value)) {
+                replace(current, Slot<const HashTree<TH>>{bottom, finished(built)});
+            }
+        }
+        return built->path(position).co_path;
+    }
+
+    std::vector<TH_domain> traversal_co_path(uint32_t position, uint32_t bottom) {
+        std::shared_future<std::shared_ptr<Walk>> walk;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto usable = [&](const auto &slot) { return slot && slot->index == bottom && slot->leaf <= position; };
+
+            if(!usable(current_walk)) {
+                if(usable(next_walk)) {
+                    replace(current_walk, std::move(*next_walk));
+                    next_walk.reset();
+                }
+                if(has_bottom(uint64_t{bottom} + 1) && !(next_walk && next_walk->index == bottom + 1)) {
+                    replace(next_walk, start_walk((bottom + 1) << bottom_height));
+                }
+            }
+            if(usable(current_walk)) {
+                current_walk->leaf = position;
+                walk = current_walk->value;
+            }
+        }
+        if(walk.valid() && may_wait(walk)) {
+            Walk &held_walk = *walk.get();
+            std::lock_guard<std::mutex> advancing(held_walk.mutex);
+            // another thread may have taken the walk past `position` in the meantime
+            if(held_walk.traversal.leaf() <= position) {
+                while(held_walk.traversal.leaf() < position) {
+                    held_walk.traversal.next();
+                }
+                return held_walk.traversal.co_path();
+            }
+        }
+
+        auto started = std::make_shared<Walk>(traverse(position));
+        std::vector<TH_domain> co_path = started->traversal.co_path();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!current_walk || current_walk->index != bottom || !ready(current_walk->value)) {
+                replace(current_walk, Slot<Walk>{bottom, finished(started), position});
+            }
+        }
+        return co_path;
+    }
+
+    template <typename T>
+    static std::shared_future<std::shared_ptr<T>> finished(std::shared_ptr<T> value) {
+        std::promise<std::shared_ptr<T>> promise;
+        promise.set_value(std::move(value));
+        return promise.get_future().share();
+    }
+
+    Slot<const HashTree<TH>> start_tree(uint32_t bottom) {
+        BuildBottom fn = build;
+        return {bottom, std::async(std::launch::async, [fn, bottom] {
+            return std::make_shared<const HashTree<TH>>(fn(bottom));
+        }).share()};
+    }
+
+    Slot<Walk> start_walk(uint32_t position) {
+        StartTraversal fn = traverse;
+        return {position >> bottom_height, std::async(std::launch::async, [fn, position] {
+            return std::make_shared<Walk>(fn(position));
+        }).share(), position};
+    }
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "tweak_hash_tree.hpp"
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+/// Streaming construction of a Merkle tree (the treehash algorithm).
+///
+/// Nodes are pushed left to right, as leaves or as roots of complete subtrees, and folded
+/// into a stack of pending subtree roots: a node that is a right child is hashed with the
+/// left sibling on top of the stack, and so on upwards. The stack holds at most one node
+/// per level, so a tree over 2^32 leaves needs 32 nodes of state, however the leaves are
+/// produced. `finish` closes the right edge and returns the node at `top_level`.
+///
+/// Positions are absolute and the tweaks are those of `HashTree::NewHashTree`, so a tree
+/// can be built in parts, e.g. a subtree with `top_level` < depth. As in `NewHashTree`,
+/// a range that does not start at a left child or end at a right child is padded with
+/// random siblings on each level.
+///
+/// With `retain_from`, all nodes of levels `retain_from` to `top_level`, padding included,
+/// are kept as `HashTreeLayer`s, from which `take_layers` builds the upper part of the tree.
+/// An observer set with `observe` sees every node as it is pushed or computed.
+template <TweakableHash_c TH>
+class TreeHash {
+public:
+    using Domain = typename TH::Domain;
+    using Parameter = typename TH::Parameter;
+
+    static constexpr uint RETAIN_NONE = std::numeric_limits<uint>::max();
+
+    TreeHash(uint _top_level_, Parameter _parameter_, TH _th_, uint _retain_from_ = RETAIN_NONE) :
+    top_level(_top_level_), parameter(std::move(_parameter_)), th(std::move(_th_)), retain_from(_retain_from_) {
+        stack.reserve(top_level + 1);
+        if(retain_from <= top_level) {
+            retained.reserve(top_level - retain_from + 1);
+            for(uint level = retain_from; level <= top_level; level++) {
+                retained.emplace_back(0, std::vector<Domain>{});
+            }
+        }
+    }
+
+    /// Pushes the node at `position` of `level`, i.e. a leaf or the root of a complete
+    /// subtree. Nodes must cover consecutive leaves: each one starts where the previous ended.
+    void push(uint level, uint32_t position, const Domain &node) {
+        if(level > top_level) {
+            throw std::invalid_argument("TreeHash: node above the top level");
+        }
+        uint64_t first_leaf = static_cast<uint64_t>(position) << level;
+        if(started && first_leaf != next_leaf) {
+            throw std::invalid_argument("TreeHash: nodes must be pushed left to right without gaps");
+        }
+        if(done()) {
+            throw std::invalid_argument("TreeHash: tree is already complete");
+        }
+        started = true;
+        next_leaf = first_leaf + (uint64_t{1} << level);
+
+        retain(level, position, node);
+        ascend(Node{level, position, node}, false);
+    }
+
+    /// Pushes consecutive leaves, the first one at `first_position`.
+    void push_leaves(uint32_t first_position, std::span<const Domain> leaves) {
+        for(size_t i = 0; i < leaves.size(); i++) {
+            push(0, static_cast<uint32_t>(first_position + i), leaves[i]);
+        }
+    }
+
+    /// Calls `fn(level, position, node)` for every node from now on.
+    void observe(std::function<void(uint level, uint32_t position, const Domain &node)> fn) { observer = std::move(fn); }
+
+    /// Pads the right edge and returns the node at `top_level`.
+    Domain finish() {
+        if(stack.empty()) {
+            throw std::invalid_argument("TreeHash: no nodes pushed");
+        }
+        while(!done()) {
+            Node node = stack.back();
+            stack.pop_back();
+            ascend(node, true);
+        }
+        return stack.back().node;
+    }
+
+    /// The kept layers, from `retain_from` up to `top_level`; call after `finish`.
+    std::vector<HashTreeLayer<TH>> take_layers() { return std::move(retained); }
+
+    /// Number of pending subtree roots.
+    size_t stack_size() const { return stack.size(); }
+
+private:
+    struct Node {
+        uint level;
+        uint32_t position;
+        Domain node;
+    };
+
+    const uint top_level;
+    Parameter parameter;
+    TH th;
+    const uint retain_from;
+
+    std::vector<Node> stack;
+    std::vector<HashTreeLayer<TH>> retained;
+    bool started = false;
+    uint64_t next_leaf = 0;
+    std::function<void(uint level, uint32_t position, const Domain &node)> observer;
+
+    bool done() const { return stack.size() == 1 && stack.back().level == top_level; }
+
+    /// Folds `node` upwards as far as its siblings are known; with `closing`, missing right
+    /// siblings are padding. The highest node reached is left on the stack.
+    void ascend(Node node, bool closing) {
+        while(node.level < top_level) {
+            Domain children[2];
+            if(node.position % 2 == 1) {
+                if(!stack.empty() && stack.back().level == node.level) {
+                    children[0] = stack.back().node;
+                    stack.pop_back();
+                } else {
+                    children[0] = th.rand_domain();
+                    retain(node.level, node.position - 1, children[0]);
+                }
+                children[1] = node.node;
+            } else if(closing) {
+                children[0] = node.node;
+                children[1] = th.rand_domain();
+                retain(node.level, node.position + 1, children[1]);
+            } else {
+                break;
+            }
+
+            node.level++;
+            node.position >>= 1;
+            node.node = th.apply(parameter, th.tree_tweak(static_cast<uint8_t>(node.level), node.position),
+                                 std::span<const Domain>(children));
+            retain(node.level, node.position, node.node);
+        }
+        stack.push_back(std::move(node));
+    }
+
+    void retain(uint level, uint32_t position, const Domain &node) {
+        if(observer) {
+            observer(level, position, node);
+        }
+        if(level < retain_from || level > top_level) {
+            return;
+        }
+        HashTreeLayer<TH> &layer = retained[level - retain_from];
+        if(layer.nodes.empty()) {
+            layer.start_index = position;
+            layer.nodes.push_back(node);
+        } else if(position + 1 == layer.start_index) {
+            // left padding, added after the first node of the layer
+            layer.nodes.insert(layer.nodes.begin(), node);
+            layer.start_index = position;
+        } else {
+            layer.nodes.push_back(node);
+        }
+    }
+};
@@ -2,65 +2,135 @@
 
 #include "../../config.hpp"
 #include "../TweakHash.hpp"
+#include "tweak.hpp"
 #include <../../endian.hpp>
 #include <vector>
+#include <span>
+#include <array>
+#include <algorithm>
 #include <cstdint>
 #include <stdexcept>
 #include <openssl/rand.h>
 
 extern "C" {
 	#include "../Blake/c/blake3.h"
+	#include "../Blake/c/blake3_impl.h"
 }
 
 
-struct BlakeTweak
-{
-    virtual std::vector<uint8_t> to_bytes() = 0;
-};
+using BlakeTweak = EncodedTweak;
 
 struct BlakeTreeTweak : public BlakeTweak {
-    const uint8_t level;
-    const uint32_t pos_in_level;
+    BlakeTreeTweak(uint8_t _level, uint32_t _pos_in_level) : BlakeTweak(BlakeTweak::tree(_level, _pos_in_level)) {}
+};
 
-    BlakeTreeTweak(uint8_t _level, uint32_t _pos_in_level) : level(_level), pos_in_level(_pos_in_level) {}
+struct BlakeChainTweak : public BlakeTweak {
+    BlakeChainTweak(uint32_t _epoch, uint8_t _chain_index, uint8_t _pos_in_chain) 
+        : BlakeTweak(BlakeTweak::chain(_epoch, _chain_index, _pos_in_chain)) {}
+};
 
-    std::vector<uint8_t> to_bytes() override
+/// BLAKE3 of parameter || tweak || messages.
+/// Shared by BlakeTweakHash and BlakeTweakHashFixed, which only differ in how they store
+/// parameters and domain values. Digests are written to caller-provided storage.
+///
+/// The tweakable hash inputs are a few dozen bytes, well within one BLAKE3 chunk. Such
+/// inputs skip `blake3_hasher` and its buffering: the blocks are fed to the compression
+/// function directly, and the chaining value after the root block is the digest.
+struct BlakeTweakDigest
+{
+    template <typename Parameter, typename Domain>
+    static void digest(const Parameter &parameter, const BlakeTweak &tweak, std::span<const Domain> messages,
+                       uint8_t out[BLAKE3_OUT_LEN])
     {
-        std::vector<uint8_t> bytes;
-        bytes.push_back(TWEAK_SEPARATOR_FOR_TREE_HASH);
+        size_t len = parameter.size() + tweak.size();
+        for (const Domain &message : messages)
+        {
+            len += message.size();
+        }
 
-        bytes.push_back(level);
-        std::vector<uint8_t> pos_bytes = endian::to_be_bytes(pos_in_level);
-        bytes.insert(bytes.end(), pos_bytes.begin(), pos_bytes.end());
-        return bytes;
-    }
-};
+        if (len > BLAKE3_CHUNK_LEN)
+        {
+            blake3_hasher blake;
+            blake3_hasher_init(&blake);
 
+            blake3_hasher_update(&blake, parameter.data(), parameter.size());
 
+            blake3_hasher_update(&blake, tweak.data(), tweak.size());
 
-struct BlakeChainTweak : public BlakeTweak {
-    const uint32_t epoch;
-    const uint8_t chain_index;
-    const uint8_t pos_in_chain;
+            for (const Domain &message : messages)
+            {
+                blake3_hasher_update(&blake, message.data(), message.size());
+            }
 
-    BlakeChainTweak(uint32_t _epoch, uint8_t _chain_index, uint8_t _pos_in_chain) 
-        : epoch(_epoch), chain_index(_chain_index), pos_in_chain(_pos_in_chain) {}
+            blake3_hasher_finalize(&blake, out, BLAKE3_OUT_LEN);
+            return;
+        }
 
-    std::vector<uint8_t> to_bytes() override
+        uint8_t input[BLAKE3_CHUNK_LEN];
+        uint8_t *dst = std::copy(parameter.begin(), parameter.end(), input);
+        dst = std::copy(tweak.data(), tweak.data() + tweak.size(), dst);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
+
+        hash_chunk(input, len, out);
+    }
+
+    /// BLAKE3 of an input of at most one chunk (1024 bytes).
+    static void hash_chunk(const uint8_t *input, size_t len, uint8_t out[BLAKE3_OUT_LEN])
     {
-        std::vector<uint8_t> bytes;
-        bytes.push_back(TWEAK_SEPARATOR_FOR_CHAIN_HASH);
+        uint32_t cv[8];
+        std::copy(IV, IV + 8, cv);
+
+        // the empty input is a single empty block
+        const size_t num_blocks = (len == 0) ? 1 : (len + BLAKE3_BLOCK_LEN - 1) / BLAKE3_BLOCK_LEN;
+        for (size_t i = 0; i < num_blocks; i++)
+        {
+            uint8_t flags = (i == 0) ? CHUNK_START : 0;
+            if (i == num_blocks - 1)
+            {
+                flags |= CHUNK_END | ROOT;
+            }
+
+            const size_t block_len = std::min<size_t>(BLAKE3_BLOCK_LEN, len - i * BLAKE3_BLOCK_LEN);
+            if (block_len == BLAKE3_BLOCK_LEN)
+            {
+                blake3_compress_in_place(cv, input + i * BLAKE3_BLOCK_LEN, BLAKE3_BLOCK_LEN, 0, flags);
+            }
+            else
+            {
+                uint8_t block[BLAKE3_BLOCK_LEN] = {0};
+                std::copy(input + i * BLAKE3_BLOCK_LEN, input + len, block);
+                blake3_compress_in_place(cv, block, static_cast<uint8_t>(block_len), 0, flags);
+            }
+        }
 
-        std::vector<uint8_t> epoch_bytes = endian::to_be_bytes(epoch);
-        bytes.insert(bytes.end(), epoch_bytes.begin(), epoch_bytes.end());
+        store_cv(cv, out);
+    }
+
+    /// BLAKE3 of `num_inputs` inputs of `blocks` full blocks each (at most one chunk),
+    /// written to `out` at a stride of BLAKE3_OUT_LEN. BLAKE3 spreads the inputs over
+    /// its SIMD lanes (up to 16 with AVX-512).
+    static void hash_many(const uint8_t *const *inputs, size_t num_inputs, size_t blocks, uint8_t *out)
+    {
+        blake3_hash_many(inputs, num_inputs, blocks, IV, 0, false, 0, CHUNK_START, CHUNK_END | ROOT, out);
+    }
 
-        bytes.push_back(chain_index);
-        bytes.push_back(pos_in_chain);
-        return bytes;
+private:
+    static void store_cv(const uint32_t cv[8], uint8_t out[BLAKE3_OUT_LEN])
+    {
+        for (size_t i = 0; i < 8; i++)
+        {
+            out[4 * i] = static_cast<uint8_t>(cv[i]);
+            out[4 * i + 1] = static_cast<uint8_t>(cv[i] >> 8);
+            out[4 * i + 2] = static_cast<uint8_t>(cv[i] >> 16);
+            out[4 * i + 3] = static_cast<uint8_t>(cv[i] >> 24);
+        }
     }
 };
 
-struct BlakeTweakHash : public TweakableHash<std::vector<uint8_t>, BlakeTweak, std::vector<uint8_t>>
+struct BlakeTweakHash final : public TweakableHash<std::vector<uint8_t>, BlakeTweak, std::vector<uint8_t>>
 {
     typedef unsigned int uint;
 
@@ -92,28 +162,276 @@ struct BlakeTweakHash : public TweakableHash<std::vector<uint8_t>, BlakeTweak, s
     }
 
     BlakeTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
-        return BlakeTreeTweak(level, pos_in_level);
+        return BlakeTweak::tree(level, pos_in_level);
     }
 
     BlakeTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
-        return BlakeChainTweak(epoch, chain_index, pos_in_chain);
+        return BlakeTweak::chain(epoch, chain_index, pos_in_chain);
     }
 
-    Domain apply(Parameter parameter, BlakeTweak &tweak, Domain &message) override
+    Domain apply(Parameter parameter, const BlakeTweak &tweak, Domain &message) override
     {
-        blake3_hasher blake;
-		blake3_hasher_init(&blake);
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
 
-        blake3_hasher_update(&blake, parameter.data(), parameter.size());
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    Domain apply(const Parameter &parameter, const BlakeTweak &tweak, std::span<const Domain> messages)
+    {
+        uint8_t output[BLAKE3_OUT_LEN];
+        BlakeTweakDigest::digest(parameter, tweak, messages, output);
+        return std::vector<uint8_t>(output, output + HASH_LEN);
+    }
 
-        blake3_hasher_update(&blake, tweak.to_bytes().data(), tweak.to_bytes().size());
+    void internal_consistency_check()
+    {
+        if (HASH_LEN > BLAKE3_OUT_LEN)
+        {
+            throw std::invalid_argument("Blake Tweak Hash: Hash Length must be at most 256 bits");
+        }
+    }
+};
+
+/// Variant of BlakeTweakHash with lengths fixed at compile time.
+/// Parameters and domain values live in `std::array`, so hashing along a chain or
+/// up the tree does not touch the heap. The BLAKE3 output is truncated to HASH_LEN bytes.
+template <unsigned int PARAMETER_LEN_t, unsigned int HASH_LEN_t>
+struct BlakeTweakHashFixed final : public TweakableHash<std::array<uint8_t, PARAMETER_LEN_t>, BlakeTweak, std::array<uint8_t, HASH_LEN_t>>
+{
+    using Parameter = std::array<uint8_t, PARAMETER_LEN_t>;
+    using Domain = std::array<uint8_t, HASH_LEN_t>;
+
+    static constexpr unsigned int PARAMETER_LEN = PARAMETER_LEN_t;
+    static constexpr unsigned int HASH_LEN = HASH_LEN_t;
+
+    BlakeTweakHashFixed() {}
+
+    Parameter rand_parameter() override
+    {
+        Parameter parameter;
+        int rc = RAND_bytes(parameter.data(), PARAMETER_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random parameter");
+        }
+        return parameter;
+    }
+
+    Domain rand_domain() override
+    {
+        Domain domain;
+        int rc = RAND_bytes(domain.data(), HASH_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random domain");
+        }
+        return domain;
+    }
+
+    BlakeTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return BlakeTweak::tree(level, pos_in_level);
+    }
 
-		blake3_hasher_update(&blake, message.data(), message.size());
+    BlakeTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return BlakeTweak::chain(epoch, chain_index, pos_in_chain);
+    }
 
-		std::vector<uint8_t> output(BLAKE3_OUT_LEN);
-		blake3_hasher_finalize(&blake, output.data(), BLAKE3_OUT_LEN);
+    Domain apply(Parameter parameter, const BlakeTweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
+
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    Domain apply(const Parameter &parameter, const BlakeTweak &tweak, std::span<const Domain> messages)
+    {
+        uint8_t output[BLAKE3_OUT_LEN];
+        BlakeTweakDigest::digest(parameter, tweak, messages, output);
 
-        return output;
+        Domain result;
+        std::copy(output, output + HASH_LEN, result.begin());
+        return result;
+    }
+
+    void internal_consistency_check()
+    {
+        static_assert(HASH_LEN <= BLAKE3_OUT_LEN, "Blake Tweak Hash: Hash Length must be at most 256 bits");
+    }
+};
+
+/// BLAKE3 tweakable hash with block-aligned inputs:
+///
+///     BLAKE3(parameter || tweak || messages || zero padding to a multiple of 64 bytes)
+///
+/// Every hash consists of whole BLAKE3 blocks, which is the input shape of BLAKE3's
+/// `hash_many`. `apply_many` therefore advances many chains (or hashes many tree nodes)
+/// at once on BLAKE3's SIMD kernels, and `chain_many` and `NewHashTree` pick it up.
+/// The padding is fixed by the input shape, so this stays injective for each shape.
+///
+/// This is an opt-in layout: its hashes differ from BlakeTweakHash / BlakeTweakHashFixed.
+template <unsigned int PARAMETER_LEN_t, unsigned int HASH_LEN_t>
+struct BlakeTweakHashPadded final : public TweakableHash<std::array<uint8_t, PARAMETER_LEN_t>, BlakeTweak, std::array<uint8_t, HASH_LEN_t>>
+{
+    using Parameter = std::array<uint8_t, PARAMETER_LEN_t>;
+    using Domain = std::array<uint8_t, HASH_LEN_t>;
+
+    static constexpr unsigned int PARAMETER_LEN = PARAMETER_LEN_t;
+    static constexpr unsigned int HASH_LEN = HASH_LEN_t;
+
+    BlakeTweakHashPadded() {}
+
+    Parameter rand_parameter() override
+    {
+        Parameter parameter;
+        int rc = RAND_bytes(parameter.data(), PARAMETER_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random parameter");
+        }
+        return parameter;
+    }
+
+    Domain rand_domain() override
+    {
+        Domain domain;
+        int rc = RAND_bytes(domain.data(), HASH_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random domain");
+        }
+        return domain;
+    }
+
+    BlakeTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return BlakeTweak::tree(level, pos_in_level);
+    }
+
+    BlakeTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return BlakeTweak::chain(epoch, chain_index, pos_in_chain);
+    }
+
+    Domain apply(Parameter parameter, const BlakeTweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
+
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    Domain apply(const Parameter &parameter, const BlakeTweak &tweak, std::span<const Domain> messages)
+    {
+        const size_t len = padded_len(tweak, messages);
+
+        uint8_t output[BLAKE3_OUT_LEN];
+        if (len <= BLAKE3_CHUNK_LEN)
+        {
+            uint8_t input[BLAKE3_CHUNK_LEN];
+            serialize(parameter, tweak, messages, input);
+            BlakeTweakDigest::hash_chunk(input, len, output);
+        }
+        else
+        {
+            // longer inputs (leaves over many chain ends) are streamed, padding included
+            static constexpr uint8_t zeros[BLAKE3_BLOCK_LEN] = {0};
+            const size_t unpadded = PARAMETER_LEN + tweak.size() + messages.size() * HASH_LEN;
+
+            blake3_hasher blake;
+            blake3_hasher_init(&blake);
+            blake3_hasher_update(&blake, parameter.data(), PARAMETER_LEN);
+            blake3_hasher_update(&blake, tweak.data(), tweak.size());
+            for (const Domain &message : messages)
+            {
+                blake3_hasher_update(&blake, message.data(), HASH_LEN);
+            }
+            blake3_hasher_update(&blake, zeros, len - unpadded);
+            blake3_hasher_finalize(&blake, output, BLAKE3_OUT_LEN);
+        }
+
+        Domain result;
+        std::copy(output, output + HASH_LEN, result.begin());
+        return result;
+    }
+
+    /// Applies the tweakable hash to many independent inputs under the same parameter.
+    /// Input i is `tweaks[i]` together with the concatenation of `messages[i]`.
+    ///
+    /// Consecutive inputs of the same padded length go to `hash_many` together; inputs
+    /// longer than a chunk fall back to `apply`.
+    std::vector<Domain> apply_many(const Parameter &parameter, const std::vector<BlakeTweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
+    {
+        if (tweaks.size() != messages.size())
+        {
+            throw std::invalid_argument("apply_many: number of tweaks and messages differ");
+        }
+
+        const size_t n = messages.size();
+        std::vector<Domain> results(n);
+
+        std::vector<size_t> lengths(n);
+        size_t stride = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            lengths[i] = padded_len(tweaks[i], messages[i]);
+            stride = std::max(stride, lengths[i]);
+        }
+
+        std::vector<uint8_t> inputs(n * stride);
+        std::vector<const uint8_t *> in(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            in[i] = inputs.data() + i * stride;
+            serialize(parameter, tweaks[i], messages[i], inputs.data() + i * stride);
+        }
+
+        std::vector<uint8_t> outputs(n * BLAKE3_OUT_LEN);
+        size_t begin = 0;
+        while (begin < n)
+        {
+            size_t end = begin + 1;
+            while (end < n && lengths[end] == lengths[begin])
+            {
+                end++;
+            }
+
+            if (lengths[begin] <= BLAKE3_CHUNK_LEN)
+            {
+                BlakeTweakDigest::hash_many(in.data() + begin, end - begin, lengths[begin] / BLAKE3_BLOCK_LEN,
+                                            outputs.data() + begin * BLAKE3_OUT_LEN);
+                for (size_t i = begin; i < end; i++)
+                {
+                    std::copy(outputs.data() + i * BLAKE3_OUT_LEN, outputs.data() + i * BLAKE3_OUT_LEN + HASH_LEN,
+                              results[i].begin());
+                }
+            }
+            else
+            {
+                for (size_t i = begin; i < end; i++)
+                {
+                    results[i] = apply(parameter, tweaks[i], messages[i]);
+                }
+            }
+            begin = end;
+        }
+        return results;
+    }
+
+    void internal_consistency_check()
+    {
+        static_assert(HASH_LEN <= BLAKE3_OUT_LEN, "Blake Tweak Hash: Hash Length must be at most 256 bits");
+    }
+private:
+    static size_t padded_len(const BlakeTweak &tweak, std::span<const Domain> messages)
+    {
+        const size_t len = PARAMETER_LEN + tweak.size() + messages.size() * HASH_LEN;
+        return (len + BLAKE3_BLOCK_LEN - 1) / BLAKE3_BLOCK_LEN * BLAKE3_BLOCK_LEN;
+    }
+
+    /// writes parameter || tweak || messages and the zero padding to `out`
+    static void serialize(const Parameter &parameter, const BlakeTweak &tweak, std::span<const Domain> messages, uint8_t *out)
+    {
+        uint8_t *dst = std::copy(parameter.begin(), parameter.end(), out);
+        dst = std::copy(tweak.data(), tweak.data() + tweak.size(), dst);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
+        std::fill(dst, out + padded_len(tweak, messages), 0);
     }
-	void internal_consistency_check() {}
 };
@@ -0,0 +1,404 @@
+#pragma once
+
+#include "../../config.hpp"
+#include "../TweakHash.hpp"
+#include "../koalabear/field.hpp"
+#include "../koalabear/poseidon2.hpp"
+#include "../dispatch.hpp"
+#include <vector>
+#include <span>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <openssl/rand.h>
+
+/// A tweak of the Poseidon tweakable hash, as two KoalaBear elements.
+///
+/// tree tweak:  level (8 bits) || pos_in_level (32 bits) || TWEAK_SEPARATOR_FOR_TREE_HASH (8 bits)
+/// chain tweak: epoch (32 bits) || chain_index (8 bits) || pos_in_chain (8 bits) || TWEAK_SEPARATOR_FOR_CHAIN_HASH (8 bits)
+///
+/// The integer is below 2^56 < P^2 and is written in base P, least significant element first.
+/// Like `EncodedTweak`, a chain tweak can be moved to another chain or position in place.
+struct PoseidonTweak
+{
+    static constexpr std::size_t LEN = 2;
+
+    uint64_t encoding = 0;
+    std::array<koalabear::Element, LEN> elements{};
+
+    static PoseidonTweak tree(uint8_t level, uint32_t pos_in_level)
+    {
+        PoseidonTweak tweak;
+        tweak.encoding = (static_cast<uint64_t>(level) << 40) | (static_cast<uint64_t>(pos_in_level) << 8) |
+                         TWEAK_SEPARATOR_FOR_TREE_HASH;
+        tweak.split();
+        return tweak;
+    }
+
+    static PoseidonTweak chain(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain)
+    {
+        PoseidonTweak tweak;
+        tweak.encoding = (static_cast<uint64_t>(epoch) << 24) | (static_cast<uint64_t>(chain_index) << 16) |
+                         (static_cast<uint64_t>(pos_in_chain) << 8) | TWEAK_SEPARATOR_FOR_CHAIN_HASH;
+        tweak.split();
+        return tweak;
+    }
+
+    /// Re-targets a chain tweak to another chain of the same epoch.
+    void set_chain_index(uint8_t chain_index)
+    {
+        encoding = (encoding & ~(uint64_t(0xff) << 16)) | (static_cast<uint64_t>(chain_index) << 16);
+        split();
+    }
+
+    /// Re-targets a chain tweak to another position of the same chain.
+    void set_pos_in_chain(uint8_t pos_in_chain)
+    {
+        encoding = (encoding & ~(uint64_t(0xff) << 8)) | (static_cast<uint64_t>(pos_in_chain) << 8);
+        split();
+    }
+
+    std::size_t size() const
+    {
+        return LEN;
+    }
+
+private:
+    void split()
+    {
+        elements[0] = koalabear::Element::from_u64(encoding % koalabear::P);
+        elements[1] = koalabear::Element::from_u64(encoding / koalabear::P);
+    }
+};
+
+/// Poseidon2 hash of a sequence of KoalaBear elements.
+///
+/// Inputs of at most one state (16 elements) are hashed in compression mode: the input is
+/// zero-padded to a state, permuted, and added back to the permutation output (feed-forward).
+/// Chain steps and, for small parameters, tree nodes take a single permutation this way.
+/// Longer inputs, like the leaf hash over all chain ends, go through a sponge with rate 8 and
+/// capacity 8; the capacity starts with the input and output lengths for domain separation.
+struct PoseidonTweakDigest
+{
+    using Element = koalabear::Element;
+    using Poseidon2 = koalabear::Poseidon2;
+
+    static constexpr std::size_t WIDTH = Poseidon2::WIDTH;
+    static constexpr std::size_t RATE = 8;
+
+    static void hash(const Element *input, std::size_t len, Element *out, std::size_t out_len)
+    {
+        Element state[WIDTH] = {};
+
+        if (len <= WIDTH)
+        {
+            std::copy(input, input + len, state);
+            Poseidon2::permute(state);
+            for (std::size_t i = 0; i < out_len; i++)
+            {
+                out[i] = state[i] + (i < len ? input[i] : Element());
+            }
+            return;
+        }
+
+        state[RATE] = Element::from_u64(len);
+        state[RATE + 1] = Element::from_u64(out_len);
+        for (std::size_t offset = 0; offset < len; offset += RATE)
+        {
+            for (std::size_t i = 0; i < RATE && offset + i < len; i++)
+            {
+                state[i] += input[offset + i];
+            }
+            Poseidon2::permute(state);
+        }
+        std::copy(state, state + out_len, out);
+    }
+
+    /// Whether `hash_x8` beats eight calls of `hash` for inputs of `len` elements on this CPU;
+    /// timed once per length by `KernelSelector`.
+    static bool use_x8(std::size_t len, std::size_t out_len)
+    {
+        return KernelSelector::select("poseidon2", len, [len, out_len](KernelSelector::Bench &bench)
+        {
+            std::vector<Element> inputs(8 * len), outputs(8 * out_len);
+            const Element *in[8];
+            Element *out[8];
+            for (std::size_t i = 0; i < inputs.size(); i++)
+            {
+                inputs[i] = Element::from_u64(i * 0x9e3779b9ULL);
+            }
+            for (std::size_t l = 0; l < 8; l++)
+            {
+                in[l] = inputs.data() + l * len;
+                out[l] = outputs.data() + l * out_len;
+            }
+
+            if (koalabear::Packed::has_avx2())
+            {
+                bench.candidate(1, "poseidon2-avx2-x8", 8, [&]
+                                { hash_x8(in, len, out, out_len); });
+            }
+            bench.candidate(0, "poseidon2-scalar", 8, [&]
+            {
+                for (std::size_t l = 0; l < 8; l++)
+                {
+                    hash(in[l], len, out[l], out_len);
+                }
+            });
+        }) == 1;
+    }
+
+    /// Eight inputs of the same length at once, one per AVX2 lane. Callers must check
+    /// `koalabear::Packed::has_avx2()`.
+    static void hash_x8(const Element *const inputs[8], std::size_t len, Element *const outs[8], std::size_t out_len)
+    {
+#ifdef KOALABEAR_PACKED_X86
+        hash_x8_avx2(inputs, len, outs, out_len);
+#else
+        throw std::runtime_error("hash_x8: AVX2 not available");
+#endif
+    }
+
+private:
+#ifdef KOALABEAR_PACKED_X86
+    __attribute__((target("avx2"))) static inline __m256i load(const Element *const inputs[8], std::size_t i)
+    {
+        __m256i x = _mm256_setr_epi32(inputs[0][i].value, inputs[1][i].value, inputs[2][i].value, inputs[3][i].value,
+                                      inputs[4][i].value, inputs[5][i].value, inputs[6][i].value, inputs[7][i].value);
+        return koalabear::Packed::to_monty(x);
+    }
+
+    __attribute__((target("avx2"))) static void hash_x8_avx2(const Element *const inputs[8], std::size_t len,
+                                                             Element *const outs[8], std::size_t out_len)
+    {
+        using koalabear::Packed;
+
+        __m256i state[WIDTH];
+        for (std::size_t i = 0; i < WIDTH; i++)
+        {
+            state[i] = _mm256_setzero_si256();
+        }
+
+        if (len <= WIDTH)
+        {
+            for (std::size_t i = 0; i < len; i++)
+            {
+                state[i] = load(inputs, i);
+            }
+            __m256i feed_forward[WIDTH];
+            std::copy(state, state + WIDTH, feed_forward);
+
+            Poseidon2::permute_x8(state);
+            for (std::size_t i = 0; i < out_len; i++)
+            {
+                state[i] = Packed::add(state[i], feed_forward[i]);
+            }
+        }
+        else
+        {
+            state[RATE] = _mm256_set1_epi32(Packed::monty(Element::from_u64(len).value));
+            state[RATE + 1] = _mm256_set1_epi32(Packed::monty(Element::from_u64(out_len).value));
+            for (std::size_t offset = 0; offset < len; offset += RATE)
+            {
+                for (std::size_t i = 0; i < RATE && offset + i < len; i++)
+                {
+                    state[i] = Packed::add(state[i], load(inputs, offset + i));
+                }
+                Poseidon2::permute_x8(state);
+            }
+        }
+
+        for (std::size_t i = 0; i < out_len; i++)
+        {
+            alignas(32) uint32_t lanes[8];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), Packed::from_monty(state[i]));
+            for (std::size_t l = 0; l < 8; l++)
+            {
+                outs[l][i].value = lanes[l];
+            }
+        }
+    }
+#endif
+};
+
+/// Tweakable hash built on Poseidon2 over KoalaBear:
+///
+///     Poseidon2(parameter || tweak || messages), see `PoseidonTweakDigest`
+///
+/// Parameters and domain values are arrays of field elements, so the hash is cheap to
+/// prove inside an arithmetic circuit, which is what SNARK aggregation of signatures needs.
+/// With PARAMETER_LEN + 2 + HASH_LEN <= 16 every chain step is a single permutation.
+template <unsigned int PARAMETER_LEN_t, unsigned int HASH_LEN_t>
+struct PoseidonTweakHash final : public TweakableHash<std::array<koalabear::Element, PARAMETER_LEN_t>, PoseidonTweak,
+                                                      std::array<koalabear::Element, HASH_LEN_t>>
+{
+    using Element = koalabear::Element;
+    using Parameter = std::array<Element, PARAMETER_LEN_t>;
+    using Domain = std::array<Element, HASH_LEN_t>;
+
+    static constexpr unsigned int PARAMETER_LEN = PARAMETER_LEN_t;
+    static constexpr unsigned int HASH_LEN = HASH_LEN_t;
+
+    PoseidonTweakHash() {}
+
+    Parameter rand_parameter() override
+    {
+        Parameter parameter;
+        rand_elements(parameter.data(), PARAMETER_LEN);
+        return parameter;
+    }
+
+    Domain rand_domain() override
+    {
+        Domain domain;
+        rand_elements(domain.data(), HASH_LEN);
+        return domain;
+    }
+
+    PoseidonTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return PoseidonTweak::tree(level, pos_in_level);
+    }
+
+    PoseidonTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return PoseidonTweak::chain(epoch, chain_index, pos_in_chain);
+    }
+
+    Domain apply(Parameter parameter, const PoseidonTweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
+
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    Domain apply(const Parameter &parameter, const PoseidonTweak &tweak, std::span<const Domain> messages)
+    {
+        const std::size_t len = input_len(messages);
+
+        Element small[2 * PoseidonTweakDigest::WIDTH];
+        std::vector<Element> large;
+        Element *input = small;
+        if (len > std::size(small))
+        {
+            large.resize(len);
+            input = large.data();
+        }
+        serialize(parameter, tweak, messages, input);
+
+        Domain result;
+        PoseidonTweakDigest::hash(input, len, result.data(), HASH_LEN);
+        return result;
+    }
+
+    /// Applies the tweakable hash to many independent inputs under the same parameter.
+    /// Input i is `tweaks[i]` together with the concatenation of `messages[i]`.
+    ///
+    /// Groups of eight inputs of the same length run on the AVX2 permutation; groups that
+    /// mix lengths, and everything on CPUs where `PoseidonTweakDigest::use_x8` finds that
+    /// slower, are hashed one by one.
+    std::vector<Domain> apply_many(const Parameter &parameter, const std::vector<PoseidonTweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
+    {
+        if (tweaks.size() != messages.size())
+        {
+            throw std::invalid_argument("apply_many: number of tweaks and messages differ");
+        }
+
+        const std::size_t n = messages.size();
+        std::vector<Domain> results(n);
+
+        if (n == 0 || !PoseidonTweakDigest::use_x8(input_len(messages[0]), HASH_LEN))
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                results[i] = apply(parameter, tweaks[i], messages[i]);
+            }
+            return results;
+        }
+
+        constexpr std::size_t lanes = koalabear::Packed::LANES;
+
+        std::vector<std::size_t> lengths(n);
+        std::size_t stride = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            lengths[i] = input_len(messages[i]);
+            stride = std::max(stride, lengths[i]);
+        }
+
+        std::vector<Element> inputs(n * stride);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            serialize(parameter, tweaks[i], messages[i], inputs.data() + i * stride);
+        }
+
+        for (std::size_t group = 0; group < n; group += lanes)
+        {
+            const std::size_t used = std::min(lanes, n - group);
+            const std::size_t len = lengths[group];
+
+            bool same_len = true;
+            for (std::size_t l = 1; l < used; l++)
+            {
+                same_len = same_len && (lengths[group + l] == len);
+            }
+
+            if (!same_len || used < lanes / 4)
+            {
+                for (std::size_t l = 0; l < used; l++)
+                {
+                    PoseidonTweakDigest::hash(inputs.data() + (group + l) * stride, lengths[group + l], results[group + l].data(), HASH_LEN);
+                }
+                continue;
+            }
+
+            // unused lanes recompute the last input, their output is dropped
+            Domain spare;
+            const Element *in[lanes];
+            Element *out[lanes];
+            for (std::size_t l = 0; l < lanes; l++)
+            {
+                in[l] = inputs.data() + (group + std::min(l, used - 1)) * stride;
+                out[l] = (l < used) ? results[group + l].data() : spare.data();
+            }
+            PoseidonTweakDigest::hash_x8(in, len, out, HASH_LEN);
+        }
+        return results;
+    }
+
+    void internal_consistency_check()
+    {
+        static_assert(HASH_LEN <= PoseidonTweakDigest::RATE, "Poseidon Tweak Hash: Hash Length must be at most the sponge rate");
+        static_assert(PARAMETER_LEN + PoseidonTweak::LEN + HASH_LEN <= PoseidonTweakDigest::WIDTH,
+                      "Poseidon Tweak Hash: a chain step must fit into one permutation");
+    }
+private:
+    static std::size_t input_len(std::span<const Domain> messages)
+    {
+        return PARAMETER_LEN + PoseidonTweak::LEN + messages.size() * HASH_LEN;
+    }
+
+    static void serialize(const Parameter &parameter, const PoseidonTweak &tweak, std::span<const Domain> messages, Element *out)
+    {
+        Element *dst = std::copy(parameter.begin(), parameter.end(), out);
+        dst = std::copy(tweak.elements.begin(), tweak.elements.end(), dst);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
+    }
+
+    static void rand_elements(Element *out, std::size_t len)
+    {
+        // 64 random bits per element, so reducing mod P leaves a bias below 2^-32
+        std::vector<uint64_t> words(len);
+        int rc = RAND_bytes(reinterpret_cast<uint8_t *>(words.data()), static_cast<int>(len * sizeof(uint64_t)));
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random field elements");
+        }
+        for (std::size_t i = 0; i < len; i++)
+        {
+            out[i] = Element::from_u64(words[i]);
+        }
+    }
+};
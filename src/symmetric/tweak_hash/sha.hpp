@@ -2,61 +2,176 @@
 
 #include "../../config.hpp"
 #include "../TweakHash.hpp"
+#include "../sha256/multi_lane.hpp"
+#include "../sha256/compress.hpp"
+#include "../sha256/dispatch.hpp"
+#include "tweak.hpp"
 #include <../../endian.hpp>
 #include <vector>
+#include <span>
+#include <array>
+#include <algorithm>
 #include <cstdint>
 #include <stdexcept>
 #include <openssl/rand.h>
 #include <openssl/evp.h>
 
-struct ShaTweak
-{
-    virtual std::vector<uint8_t> to_bytes() = 0;
-};
+using ShaTweak = EncodedTweak;
 
 struct ShaTreeTweak : public ShaTweak {
-    const uint8_t level;
-    const uint32_t pos_in_level;
+    ShaTreeTweak(uint8_t _level, uint32_t _pos_in_level) : ShaTweak(ShaTweak::tree(_level, _pos_in_level)) {}
+};
 
-    ShaTreeTweak(uint8_t _level, uint32_t _pos_in_level) : level(_level), pos_in_level(_pos_in_level) {}
+struct ShaChainTweak : public ShaTweak {
+    ShaChainTweak(uint32_t _epoch, uint8_t _chain_index, uint8_t _pos_in_chain) 
+        : ShaTweak(ShaTweak::chain(_epoch, _chain_index, _pos_in_chain)) {}
+};
 
-    std::vector<uint8_t> to_bytes() override
+/// SHA-256 of parameter || tweak || messages.
+/// Shared by ShaTweakHash and ShaTweakHashFixed, which only differ in how they store
+/// parameters and domain values. Digests are written to caller-provided storage.
+///
+/// The SHA-256 implementation (OpenSSL, in-tree, or multi-lane for batches) is picked per
+/// input length by `sha256::Dispatch`.
+struct ShaTweakDigest
+{
+    template <typename Parameter, typename Domain>
+    static void digest(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages,
+                       uint8_t out[sha256::DIGEST_LEN])
     {
-        std::vector<uint8_t> bytes;
-        bytes.push_back(TWEAK_SEPARATOR_FOR_TREE_HASH);
+        const size_t len = input_len(parameter, tweak, messages);
 
-        bytes.push_back(level);
-        std::vector<uint8_t> pos_bytes = endian::to_be_bytes(pos_in_level);
-        bytes.insert(bytes.end(), pos_bytes.begin(), pos_bytes.end());
-        return bytes;
+        uint8_t small[4 * sha256::BLOCK_LEN];
+        std::vector<uint8_t> large;
+        uint8_t *input = small;
+        if (len > sizeof(small))
+        {
+            large.resize(len);
+            input = large.data();
+        }
+        serialize(parameter, tweak, messages, input);
+
+        sha256::Dispatch::hash(input, len, out);
     }
-};
 
+    /// Hashes input i = (parameter_at(i), tweaks[i], concatenation of messages[i]) for every i
+    /// and calls `store(i, digest)` with its 32-byte digest.
+    ///
+    /// Inputs are hashed 16 (AVX-512) or 8 (AVX2) at a time with the multi-lane SHA-256
+    /// kernels when `sha256::Dispatch::lanes` finds that faster than hashing them one by
+    /// one. A group of lanes needs inputs of identical length, so every run of consecutive
+    /// inputs of one length is split into groups of the lane count chosen for that length.
+    template <typename ParameterAt, typename Domain, typename Store>
+    static void digest_many(ParameterAt parameter_at, const std::vector<ShaTweak> &tweaks,
+                            std::vector<std::span<const Domain>> &messages, Store store)
+    {
+        if (tweaks.size() != messages.size())
+        {
+            throw std::invalid_argument("apply_many: number of tweaks and messages differ");
+        }
 
+        const size_t n = messages.size();
+        if (n == 0)
+        {
+            return;
+        }
+        uint8_t digests[sha256::MultiLane::LANES_AVX512][sha256::DIGEST_LEN];
 
-struct ShaChainTweak : public ShaTweak {
-    const uint32_t epoch;
-    const uint8_t chain_index;
-    const uint8_t pos_in_chain;
+        // serialize every input as parameter || tweak || message into one buffer
+        std::vector<size_t> lengths(n);
+        size_t stride = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            lengths[i] = input_len(parameter_at(i), tweaks[i], messages[i]);
+            stride = std::max(stride, lengths[i]);
+        }
 
-    ShaChainTweak(uint32_t _epoch, uint8_t _chain_index, uint8_t _pos_in_chain) 
-        : epoch(_epoch), chain_index(_chain_index), pos_in_chain(_pos_in_chain) {}
+        std::vector<uint8_t> inputs(n * stride);
+        for (size_t i = 0; i < n; i++)
+        {
+            serialize(parameter_at(i), tweaks[i], messages[i], inputs.data() + i * stride);
+        }
 
-    std::vector<uint8_t> to_bytes() override
-    {
-        std::vector<uint8_t> bytes;
-        bytes.push_back(TWEAK_SEPARATOR_FOR_CHAIN_HASH);
+        // runs of equal length, e.g. the chain steps and the nodes of one batch, each on the
+        // lane count selected for their length
+        size_t begin = 0;
+        while (begin < n)
+        {
+            const size_t len = lengths[begin];
+            size_t end = begin + 1;
+            while (end < n && lengths[end] == len)
+            {
+                end++;
+            }
+
+            const size_t lanes = sha256::Dispatch::lanes(len);
+            for (size_t group = begin; group < end; group += std::max<size_t>(lanes, 1))
+            {
+                const size_t used = std::min(std::max<size_t>(lanes, 1), end - group);
 
-        std::vector<uint8_t> epoch_bytes = endian::to_be_bytes(epoch);
-        bytes.insert(bytes.end(), epoch_bytes.begin(), epoch_bytes.end());
+                // no multi-lane kernel pays off, or a mostly empty group is cheaper one by one
+                if (lanes == 0 || used < lanes / 4)
+                {
+                    for (size_t l = 0; l < used; l++)
+                    {
+                        sha256::Dispatch::hash(inputs.data() + (group + l) * stride, len, digests[0]);
+                        store(group + l, digests[0]);
+                    }
+                    continue;
+                }
 
-        bytes.push_back(chain_index);
-        bytes.push_back(pos_in_chain);
-        return bytes;
+                // unused lanes recompute the last input, their output is dropped
+                const uint8_t *in[sha256::MultiLane::LANES_AVX512];
+                uint8_t *out[sha256::MultiLane::LANES_AVX512];
+                for (size_t l = 0; l < lanes; l++)
+                {
+                    in[l] = inputs.data() + (group + std::min(l, used - 1)) * stride;
+                    out[l] = digests[l];
+                }
+
+                if (lanes == sha256::MultiLane::LANES_AVX512)
+                {
+                    sha256::MultiLane::hash_x16(in, len, out);
+                }
+                else
+                {
+                    sha256::MultiLane::hash_x8(in, len, out);
+                }
+
+                for (size_t l = 0; l < used; l++)
+                {
+                    store(group + l, digests[l]);
+                }
+            }
+            begin = end;
+        }
+    }
+
+private:
+    template <typename Parameter, typename Domain>
+    static size_t input_len(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages)
+    {
+        size_t len = parameter.size() + tweak.size();
+        for (const Domain &message : messages)
+        {
+            len += message.size();
+        }
+        return len;
+    }
+
+    template <typename Parameter, typename Domain>
+    static void serialize(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages, uint8_t *out)
+    {
+        uint8_t *dst = std::copy(parameter.begin(), parameter.end(), out);
+        dst = std::copy(tweak.data(), tweak.data() + tweak.size(), dst);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
     }
 };
 
-struct ShaTweakHash : public TweakableHash<std::vector<uint8_t>, ShaTweak, std::vector<uint8_t>>
+struct ShaTweakHash final : public TweakableHash<std::vector<uint8_t>, ShaTweak, std::vector<uint8_t>>
 {
     typedef unsigned int uint;
 
@@ -87,59 +202,193 @@ struct ShaTweakHash : public TweakableHash<std::vector<uint8_t>, ShaTweak, std::
         return domain;
     }
 
-    std::unique_ptr<ShaTweak> tree_tweak(uint8_t level, uint32_t pos_in_level) override {
-        return std::make_unique<ShaTreeTweak>(level, pos_in_level);
+    ShaTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return ShaTweak::tree(level, pos_in_level);
+    }
+
+    ShaTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return ShaTweak::chain(epoch, chain_index, pos_in_chain);
+    }
+
+    Domain apply(Parameter parameter, const ShaTweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
     }
 
-    std::unique_ptr<ShaTweak> chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
-        return std::make_unique<ShaChainTweak>(epoch, chain_index, pos_in_chain);
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    /// This is how tree nodes (two children) and leafs (all chain ends of an epoch) are hashed.
+    Domain apply(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages)
+    {
+        uint8_t digest[sha256::DIGEST_LEN];
+        ShaTweakDigest::digest(parameter, tweak, messages, digest);
+        return std::vector<uint8_t>(digest, digest + HASH_LEN);
     }
 
-    Domain apply(Parameter parameter, ShaTweak &tweak, Domain &message) override
+    /// Applies the tweakable hash to many independent inputs under the same parameter.
+    /// Input i is `tweaks[i]` together with the concatenation of `messages[i]`.
+    /// See `ShaTweakDigest::digest_many` for how the inputs are spread over SIMD lanes.
+    std::vector<Domain> apply_many(const Parameter &parameter, const std::vector<ShaTweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
     {
-        unsigned char *digest;
-        unsigned int digest_len;
+        std::vector<Domain> results(messages.size());
+        ShaTweakDigest::digest_many([&](size_t) -> const Parameter & { return parameter; }, tweaks, messages,
+                                    [&](size_t i, const uint8_t *digest)
+                                    { results[i] = std::vector<uint8_t>(digest, digest + HASH_LEN); });
+        return results;
+    }
 
-        EVP_MD_CTX *mdctx;
-        if ((mdctx = EVP_MD_CTX_new()) == NULL)
+    /// Like `apply_many`, input i under `*parameters[i]`.
+    std::vector<Domain> apply_many(const std::vector<const Parameter *> &parameters, const std::vector<ShaTweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
+    {
+        if (parameters.size() != messages.size())
         {
-            throw std::runtime_error("Failed to create EVP_MD_CTX");
+            throw std::invalid_argument("apply_many: number of parameters and messages differ");
         }
+        std::vector<Domain> results(messages.size());
+        ShaTweakDigest::digest_many([&](size_t i) -> const Parameter & { return *parameters[i]; }, tweaks, messages,
+                                    [&](size_t i, const uint8_t *digest)
+                                    { results[i] = std::vector<uint8_t>(digest, digest + HASH_LEN); });
+        return results;
+    }
 
-        if (1 != EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL))
+    void internal_consistency_check() {}
+};
+
+/// Variant of ShaTweakHash with lengths fixed at compile time.
+/// Parameters and domain values live in `std::array`, so hashing along a chain or
+/// up the tree does not touch the heap. Hashes are identical to ShaTweakHash with the same lengths.
+template <unsigned int PARAMETER_LEN_t, unsigned int HASH_LEN_t>
+struct ShaTweakHashFixed final : public TweakableHash<std::array<uint8_t, PARAMETER_LEN_t>, ShaTweak, std::array<uint8_t, HASH_LEN_t>>
+{
+    using Parameter = std::array<uint8_t, PARAMETER_LEN_t>;
+    using Domain = std::array<uint8_t, HASH_LEN_t>;
+
+    static constexpr unsigned int PARAMETER_LEN = PARAMETER_LEN_t;
+    static constexpr unsigned int HASH_LEN = HASH_LEN_t;
+
+    ShaTweakHashFixed() {}
+
+    Parameter rand_parameter() override
+    {
+        Parameter parameter;
+        int rc = RAND_bytes(parameter.data(), PARAMETER_LEN);
+        if (rc != 1)
         {
-            throw std::runtime_error("Failed to initialize digest");
+            throw std::runtime_error("Failed to generate random parameter");
         }
+        return parameter;
+    }
 
-        if (1 != EVP_DigestUpdate(mdctx, parameter.data(), parameter.size()))
+    Domain rand_domain() override
+    {
+        Domain domain;
+        int rc = RAND_bytes(domain.data(), HASH_LEN);
+        if (rc != 1)
         {
-            throw std::runtime_error("Failed to update digest with parameter");
+            throw std::runtime_error("Failed to generate random domain");
         }
+        return domain;
+    }
+
+    ShaTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return ShaTweak::tree(level, pos_in_level);
+    }
+
+    ShaTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return ShaTweak::chain(epoch, chain_index, pos_in_chain);
+    }
 
-        if (1 != EVP_DigestUpdate(mdctx, tweak.to_bytes().data(), tweak.to_bytes().size()))
+    Domain apply(Parameter parameter, const ShaTweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
+
+    /// Input lengths of a chain step and of an inner tree node.
+    static constexpr std::size_t CHAIN_INPUT_LEN = PARAMETER_LEN + ShaTweak::CHAIN_LEN + HASH_LEN;
+    static constexpr std::size_t NODE_INPUT_LEN = PARAMETER_LEN + ShaTweak::TREE_LEN + 2 * HASH_LEN;
+
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    /// Chain steps and inner tree nodes have lengths known at compile time and run the
+    /// in-tree compression function directly, unless `sha256::Dispatch` found OpenSSL
+    /// faster for that length; everything else goes through `ShaTweakDigest`.
+    Domain apply(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages)
+    {
+        if (messages.size() == 1 && tweak.size() == ShaTweak::CHAIN_LEN)
         {
-            throw std::runtime_error("Failed to update digest with tweak");
+            return apply_fixed<CHAIN_INPUT_LEN>(parameter, tweak, messages);
         }
-
-        if (1 != EVP_DigestUpdate(mdctx, message.data(), message.size()))
+        if (messages.size() == 2 && tweak.size() == ShaTweak::TREE_LEN)
         {
-            throw std::runtime_error("Failed to update digest with message");
+            return apply_fixed<NODE_INPUT_LEN>(parameter, tweak, messages);
         }
 
-        if ((digest = (unsigned char *)OPENSSL_malloc(EVP_MD_size(EVP_sha256()))) == NULL)
+        uint8_t digest[sha256::DIGEST_LEN];
+        ShaTweakDigest::digest(parameter, tweak, messages, digest);
+
+        Domain result;
+        std::copy(digest, digest + HASH_LEN, result.begin());
+        return result;
+    }
+
+    /// Applies the tweakable hash to many independent inputs under the same parameter.
+    std::vector<Domain> apply_many(const Parameter &parameter, const std::vector<ShaTweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
+    {
+        std::vector<Domain> results(messages.size());
+        ShaTweakDigest::digest_many([&](size_t) -> const Parameter & { return parameter; }, tweaks, messages,
+                                    [&](size_t i, const uint8_t *digest)
+                                    { std::copy(digest, digest + HASH_LEN, results[i].begin()); });
+        return results;
+    }
+
+    /// Like `apply_many`, input i under `*parameters[i]`.
+    std::vector<Domain> apply_many(const std::vector<const Parameter *> &parameters, const std::vector<ShaTweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
+    {
+        if (parameters.size() != messages.size())
         {
-            throw std::runtime_error("Failed to allocate memory for digest");
+            throw std::invalid_argument("apply_many: number of parameters and messages differ");
         }
+        std::vector<Domain> results(messages.size());
+        ShaTweakDigest::digest_many([&](size_t i) -> const Parameter & { return *parameters[i]; }, tweaks, messages,
+                                    [&](size_t i, const uint8_t *digest)
+                                    { std::copy(digest, digest + HASH_LEN, results[i].begin()); });
+        return results;
+    }
 
-        if (1 != EVP_DigestFinal_ex(mdctx, digest, &digest_len))
+    void internal_consistency_check()
+    {
+        static_assert(HASH_LEN <= sha256::DIGEST_LEN, "SHA Tweak Hash: Hash Length must be at most 256 bits");
+    }
+private:
+    /// parameter || tweak || messages laid out in a pre-padded block of compile-time length LEN
+    template <std::size_t LEN>
+    static Domain apply_fixed(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages)
+    {
+        static const bool in_tree = sha256::Dispatch::single(LEN) == sha256::Dispatch::IN_TREE;
+        if (!in_tree)
         {
-            throw std::runtime_error("Failed to finalize digest");
+            uint8_t digest[sha256::DIGEST_LEN];
+            ShaTweakDigest::digest(parameter, tweak, messages, digest);
+
+            Domain result;
+            std::copy(digest, digest + HASH_LEN, result.begin());
+            return result;
         }
 
-        EVP_MD_CTX_free(mdctx);
+        typename sha256::FixedInput<LEN>::Block block;
 
-        return std::vector<uint8_t>(digest, digest + HASH_LEN);
-    }
+        uint8_t *dst = std::copy(parameter.begin(), parameter.end(), block);
+        dst = std::copy(tweak.data(), tweak.data() + tweak.size(), dst);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
+        sha256::FixedInput<LEN>::pad(block);
 
-    void internal_consistency_check() {}
+        Domain result;
+        sha256::FixedInput<LEN>::hash(block, result.data(), HASH_LEN);
+        return result;
+    }
 };
\ No newline at end of file
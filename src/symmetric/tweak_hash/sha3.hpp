@@ -0,0 +1,192 @@
+#pragma once
+
+#include "../../config.hpp"
+#include "../TweakHash.hpp"
+#include "../keccak/keccak.hpp"
+#include "tweak.hpp"
+#include <vector>
+#include <span>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <openssl/rand.h>
+
+using Sha3Tweak = EncodedTweak;
+
+/// Tweakable hash from the SHA-3 family: V(parameter || tweak || messages), truncated to
+/// HASH_LEN bytes, where V is `keccak::Sha3_256` or `keccak::Shake128`.
+///
+/// Parameters and domain values live in `std::array`. Single hashes run the in-tree scalar
+/// Keccak; `apply_many` runs groups of four equal-length inputs on the 4-lane AVX2 Keccak,
+/// so `chain_many` and `NewHashTree` pick it up.
+template <typename V, unsigned int PARAMETER_LEN_t, unsigned int HASH_LEN_t>
+struct KeccakTweakHash final : public TweakableHash<std::array<uint8_t, PARAMETER_LEN_t>, Sha3Tweak, std::array<uint8_t, HASH_LEN_t>>
+{
+    using Parameter = std::array<uint8_t, PARAMETER_LEN_t>;
+    using Domain = std::array<uint8_t, HASH_LEN_t>;
+    using Sponge = keccak::Sponge<V>;
+
+    static constexpr unsigned int PARAMETER_LEN = PARAMETER_LEN_t;
+    static constexpr unsigned int HASH_LEN = HASH_LEN_t;
+
+    KeccakTweakHash() {}
+
+    Parameter rand_parameter() override
+    {
+        Parameter parameter;
+        int rc = RAND_bytes(parameter.data(), PARAMETER_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random parameter");
+        }
+        return parameter;
+    }
+
+    Domain rand_domain() override
+    {
+        Domain domain;
+        int rc = RAND_bytes(domain.data(), HASH_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random domain");
+        }
+        return domain;
+    }
+
+    Sha3Tweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return Sha3Tweak::tree(level, pos_in_level);
+    }
+
+    Sha3Tweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return Sha3Tweak::chain(epoch, chain_index, pos_in_chain);
+    }
+
+    Domain apply(Parameter parameter, const Sha3Tweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
+
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`.
+    Domain apply(const Parameter &parameter, const Sha3Tweak &tweak, std::span<const Domain> messages)
+    {
+        const std::size_t len = input_len(tweak, messages);
+
+        uint8_t small[2 * Sponge::RATE];
+        std::vector<uint8_t> large;
+        uint8_t *input = small;
+        if (len > sizeof(small))
+        {
+            large.resize(len);
+            input = large.data();
+        }
+        serialize(parameter, tweak, messages, input);
+
+        Domain result;
+        Sponge::hash(input, len, result.data(), HASH_LEN);
+        return result;
+    }
+
+    /// Applies the tweakable hash to many independent inputs under the same parameter.
+    /// Input i is `tweaks[i]` together with the concatenation of `messages[i]`.
+    ///
+    /// Groups of four inputs of the same length run on the 4-lane Keccak; groups that mix
+    /// lengths, and everything on CPUs where `Sponge::use_x4` finds that slower, are hashed
+    /// one by one.
+    std::vector<Domain> apply_many(const Parameter &parameter, const std::vector<Sha3Tweak> &tweaks,
+                                   std::vector<std::span<const Domain>> &messages)
+    {
+        if (tweaks.size() != messages.size())
+        {
+            throw std::invalid_argument("apply_many: number of tweaks and messages differ");
+        }
+
+        const std::size_t n = messages.size();
+        std::vector<Domain> results(n);
+
+        if (n == 0 || !Sponge::use_x4(input_len(tweaks[0], messages[0])))
+        {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                results[i] = apply(parameter, tweaks[i], messages[i]);
+            }
+            return results;
+        }
+
+        constexpr std::size_t lanes = keccak::Keccak::LANES;
+
+        std::vector<std::size_t> lengths(n);
+        std::size_t stride = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            lengths[i] = input_len(tweaks[i], messages[i]);
+            stride = std::max(stride, lengths[i]);
+        }
+
+        std::vector<uint8_t> inputs(n * stride);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            serialize(parameter, tweaks[i], messages[i], inputs.data() + i * stride);
+        }
+
+        for (std::size_t group = 0; group < n; group += lanes)
+        {
+            const std::size_t used = std::min(lanes, n - group);
+            const std::size_t len = lengths[group];
+
+            bool same_len = true;
+            for (std::size_t l = 1; l < used; l++)
+            {
+                same_len = same_len && (lengths[group + l] == len);
+            }
+
+            if (!same_len || used < 2)
+            {
+                for (std::size_t l = 0; l < used; l++)
+                {
+                    Sponge::hash(inputs.data() + (group + l) * stride, lengths[group + l], results[group + l].data(), HASH_LEN);
+                }
+                continue;
+            }
+
+            // unused lanes recompute the last input, their output is dropped
+            Domain spare;
+            const uint8_t *in[lanes];
+            uint8_t *out[lanes];
+            for (std::size_t l = 0; l < lanes; l++)
+            {
+                in[l] = inputs.data() + (group + std::min(l, used - 1)) * stride;
+                out[l] = (l < used) ? results[group + l].data() : spare.data();
+            }
+            Sponge::hash_x4(in, len, out, HASH_LEN);
+        }
+        return results;
+    }
+
+    void internal_consistency_check()
+    {
+        static_assert(HASH_LEN <= V::OUT_LEN || V::SUFFIX == keccak::Shake128::SUFFIX,
+                      "SHA3 Tweak Hash: Hash Length must be at most 256 bits");
+    }
+private:
+    static std::size_t input_len(const Sha3Tweak &tweak, std::span<const Domain> messages)
+    {
+        return PARAMETER_LEN + tweak.size() + messages.size() * HASH_LEN;
+    }
+
+    static void serialize(const Parameter &parameter, const Sha3Tweak &tweak, std::span<const Domain> messages, uint8_t *out)
+    {
+        uint8_t *dst = std::copy(parameter.begin(), parameter.end(), out);
+        dst = std::copy(tweak.data(), tweak.data() + tweak.size(), dst);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
+    }
+};
+
+template <unsigned int PARAMETER_LEN, unsigned int HASH_LEN>
+using Sha3TweakHash = KeccakTweakHash<keccak::Sha3_256, PARAMETER_LEN, HASH_LEN>;
+
+template <unsigned int PARAMETER_LEN, unsigned int HASH_LEN>
+using ShakeTweakHash = KeccakTweakHash<keccak::Shake128, PARAMETER_LEN, HASH_LEN>;
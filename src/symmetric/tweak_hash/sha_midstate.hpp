@@ -0,0 +1,162 @@
+#pragma once
+
+#include "../TweakHash.hpp"
+#include "../sha256/compress.hpp"
+#include "sha.hpp"
+#include <vector>
+#include <span>
+#include <array>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <openssl/rand.h>
+
+/// Public parameter of ShaTweakHashMidstate.
+///
+/// Next to the parameter bytes it keeps the SHA-256 state after compressing the parameter
+/// block, i.e. the parameter zero-padded to 64 bytes. The state is computed once when the
+/// parameter is created, so public and secret keys, which store the parameter, carry it along.
+template <unsigned int PARAMETER_LEN>
+struct ShaMidstateParameter
+{
+    static_assert(PARAMETER_LEN <= sha256::BLOCK_LEN, "SHA Midstate Parameter: parameter must fit into one block");
+
+    std::array<uint8_t, PARAMETER_LEN> bytes{};
+    std::array<uint32_t, 8> midstate{};
+
+    ShaMidstateParameter() : ShaMidstateParameter(std::array<uint8_t, PARAMETER_LEN>{}) {}
+
+    explicit ShaMidstateParameter(const std::array<uint8_t, PARAMETER_LEN> &_bytes_) : bytes(_bytes_)
+    {
+        uint8_t block[sha256::BLOCK_LEN] = {0};
+        std::copy(bytes.begin(), bytes.end(), block);
+
+        std::copy(sha256::IV, sha256::IV + 8, midstate.begin());
+        sha256::Compress::compress(midstate.data(), block);
+    }
+
+    const uint8_t *data() const { return bytes.data(); }
+    std::size_t size() const { return bytes.size(); }
+    auto begin() const { return bytes.begin(); }
+    auto end() const { return bytes.end(); }
+
+    explicit operator std::vector<uint8_t>() const
+    {
+        return std::vector<uint8_t>(bytes.begin(), bytes.end());
+    }
+
+    bool operator==(const ShaMidstateParameter &other) const
+    {
+        return bytes == other.bytes;
+    }
+};
+
+/// SHA-256 tweakable hash with the parameter in its own block:
+///
+///     SHA-256(parameter || zero padding to 64 bytes || tweak || messages)
+///
+/// The first block is the same for every hash under a key, so each hash starts from the
+/// midstate cached in `ShaMidstateParameter` and only compresses tweak || messages.
+/// A tree node then takes one compression instead of two, as does a chain step whenever
+/// parameter || tweak || domain value would not fit into a single block.
+///
+/// This is an opt-in layout: its hashes differ from ShaTweakHash / ShaTweakHashFixed.
+template <unsigned int PARAMETER_LEN_t, unsigned int HASH_LEN_t>
+struct ShaTweakHashMidstate final : public TweakableHash<ShaMidstateParameter<PARAMETER_LEN_t>, ShaTweak, std::array<uint8_t, HASH_LEN_t>>
+{
+    using Parameter = ShaMidstateParameter<PARAMETER_LEN_t>;
+    using Domain = std::array<uint8_t, HASH_LEN_t>;
+
+    static constexpr unsigned int PARAMETER_LEN = PARAMETER_LEN_t;
+    static constexpr unsigned int HASH_LEN = HASH_LEN_t;
+
+    /// Input lengths after the parameter block of a chain step and of an inner tree node.
+    static constexpr std::size_t CHAIN_INPUT_LEN = ShaTweak::CHAIN_LEN + HASH_LEN;
+    static constexpr std::size_t NODE_INPUT_LEN = ShaTweak::TREE_LEN + 2 * HASH_LEN;
+
+    ShaTweakHashMidstate() {}
+
+    Parameter rand_parameter() override
+    {
+        std::array<uint8_t, PARAMETER_LEN> bytes;
+        int rc = RAND_bytes(bytes.data(), PARAMETER_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random parameter");
+        }
+        return Parameter(bytes);
+    }
+
+    Domain rand_domain() override
+    {
+        Domain domain;
+        int rc = RAND_bytes(domain.data(), HASH_LEN);
+        if (rc != 1)
+        {
+            throw std::runtime_error("Failed to generate random domain");
+        }
+        return domain;
+    }
+
+    ShaTweak tree_tweak(uint8_t level, uint32_t pos_in_level) override {
+        return ShaTweak::tree(level, pos_in_level);
+    }
+
+    ShaTweak chain_tweak(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain) override {
+        return ShaTweak::chain(epoch, chain_index, pos_in_chain);
+    }
+
+    Domain apply(Parameter parameter, const ShaTweak &tweak, Domain &message) override
+    {
+        return apply(parameter, tweak, std::span<const Domain>(&message, 1));
+    }
+
+    /// Applies the tweakable hash to parameter, tweak, and the concatenation of `messages`,
+    /// continuing from the midstate of the parameter block.
+    Domain apply(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages)
+    {
+        if (messages.size() == 1 && tweak.size() == ShaTweak::CHAIN_LEN)
+        {
+            return apply_fixed<CHAIN_INPUT_LEN>(parameter, tweak, messages);
+        }
+        if (messages.size() == 2 && tweak.size() == ShaTweak::TREE_LEN)
+        {
+            return apply_fixed<NODE_INPUT_LEN>(parameter, tweak, messages);
+        }
+
+        std::vector<uint8_t> input(tweak.data(), tweak.data() + tweak.size());
+        input.reserve(tweak.size() + messages.size() * HASH_LEN);
+        for (const Domain &message : messages)
+        {
+            input.insert(input.end(), message.begin(), message.end());
+        }
+
+        Domain result;
+        sha256::hash_from(parameter.midstate.data(), 1, input.data(), input.size(), result.data(), HASH_LEN);
+        return result;
+    }
+
+    void internal_consistency_check()
+    {
+        static_assert(HASH_LEN <= sha256::DIGEST_LEN, "SHA Tweak Hash: Hash Length must be at most 256 bits");
+    }
+private:
+    /// tweak || messages laid out in a pre-padded block of compile-time length LEN
+    template <std::size_t LEN>
+    static Domain apply_fixed(const Parameter &parameter, const ShaTweak &tweak, std::span<const Domain> messages)
+    {
+        using Input = sha256::FixedInput<LEN, 1>;
+        typename Input::Block block;
+
+        uint8_t *dst = std::copy(tweak.data(), tweak.data() + tweak.size(), block);
+        for (const Domain &message : messages)
+        {
+            dst = std::copy(message.begin(), message.end(), dst);
+        }
+        Input::pad(block);
+
+        Domain result;
+        Input::hash_from(parameter.midstate.data(), block, result.data(), HASH_LEN);
+        return result;
+    }
+};
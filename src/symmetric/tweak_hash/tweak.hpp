@@ -0,0 +1,89 @@
+#pragma once
+
+#include "../../config.hpp"
+#include <array>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstddef>
+
+/// A tweak of the SHA and BLAKE3 tweakable hashes, encoded once into an inline buffer.
+///
+/// tree tweak:  TWEAK_SEPARATOR_FOR_TREE_HASH  || level || pos_in_level (4 bytes, big-endian)
+/// chain tweak: TWEAK_SEPARATOR_FOR_CHAIN_HASH || epoch (4 bytes, big-endian) || chain_index || pos_in_chain
+///
+/// The tweak is a plain value: creating and hashing it involves no heap allocation and
+/// no virtual call. A chain tweak for one epoch works as a template for all chains and
+/// positions of that epoch: moving to the next step only patches the last byte.
+struct EncodedTweak
+{
+    static constexpr std::size_t TREE_LEN = 6;
+    static constexpr std::size_t CHAIN_LEN = 7;
+    static constexpr std::size_t MAX_LEN = CHAIN_LEN;
+
+    std::array<uint8_t, MAX_LEN> encoding{};
+    uint8_t len = 0;
+
+    static EncodedTweak tree(uint8_t level, uint32_t pos_in_level)
+    {
+        EncodedTweak tweak;
+        tweak.encoding[0] = TWEAK_SEPARATOR_FOR_TREE_HASH;
+        tweak.encoding[1] = level;
+        store_be32(&tweak.encoding[2], pos_in_level);
+        tweak.len = TREE_LEN;
+        return tweak;
+    }
+
+    static EncodedTweak chain(uint32_t epoch, uint8_t chain_index, uint8_t pos_in_chain)
+    {
+        EncodedTweak tweak;
+        tweak.encoding[0] = TWEAK_SEPARATOR_FOR_CHAIN_HASH;
+        store_be32(&tweak.encoding[1], epoch);
+        tweak.encoding[5] = chain_index;
+        tweak.encoding[6] = pos_in_chain;
+        tweak.len = CHAIN_LEN;
+        return tweak;
+    }
+
+    /// Re-targets a chain tweak to another chain of the same epoch.
+    void set_chain_index(uint8_t chain_index)
+    {
+        encoding[CHAIN_LEN - 2] = chain_index;
+    }
+
+    /// Re-targets a chain tweak to another position of the same chain.
+    void set_pos_in_chain(uint8_t pos_in_chain)
+    {
+        encoding[CHAIN_LEN - 1] = pos_in_chain;
+    }
+
+    const uint8_t *data() const
+    {
+        return encoding.data();
+    }
+
+    std::size_t size() const
+    {
+        return len;
+    }
+
+    std::span<const uint8_t> bytes() const
+    {
+        return std::span<const uint8_t>(encoding.data(), len);
+    }
+
+    /// Copy of the encoding; allocates, so keep it off the hashing path.
+    std::vector<uint8_t> to_bytes() const
+    {
+        return std::vector<uint8_t>(encoding.begin(), encoding.begin() + len);
+    }
+
+private:
+    static void store_be32(uint8_t *out, uint32_t value)
+    {
+        out[0] = static_cast<uint8_t>(value >> 24);
+        out[1] = static_cast<uint8_t>(value >> 16);
+        out[2] = static_cast<uint8_t>(value >> 8);
+        out[3] = static_cast<uint8_t>(value);
+    }
+};
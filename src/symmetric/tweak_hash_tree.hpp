@@ -2,8 +2,14 @@
 
 
 #include "TweakHash.hpp"
+#include "../work_stealing.hpp"
+#include "chain_states.hpp"
+#include <algorithm>
+#include <iterator>
+#include <memory>
 #include <cstdint>
 #include <vector>
+#include <span>
 #include <stdexcept>
 #include <openssl/rand.h>
 #include <concepts>
@@ -25,168 +31,444 @@ struct HashTreeLayer {
         : start_index(_start_index), nodes(std::move(_nodes)) {}
 };
 
-template <TweakableHash_c TH>
+/// Bits of a child's index among the children of a node of an ARITY-ary tree, or 0 for an
+/// arity that is not supported. A tree of depth D has ARITY^D = 2^(D * bits) leaves.
+template <uint ARITY>
+inline constexpr uint TREE_ARITY_BITS = ARITY == 2 ? 1 : ARITY == 4 ? 2 : ARITY == 8 ? 3 : 0;
+
+/// The tweak of the node at `position` of `level` >= 1 of an ARITY-ary tree, which hashes its
+/// children in the order of their child index. The binary tree uses the plain level; other
+/// arities put TREE_ARITY_BITS - 1 into the top two bits of the level byte, so that trees of
+/// different arity never share a tweak.
+template <uint ARITY, typename TH>
+typename TH::Tweak tree_node_tweak(TH &th, uint level, uint32_t position) {
+    return th.tree_tweak(static_cast<uint8_t>(level | ((TREE_ARITY_BITS<ARITY> - 1) << 6)), position);
+}
+
+template <TweakableHash_c TH, uint ARITY = 2>
 struct HashTreeOpening {
     /// The co-path needed to verify
-    /// If the tree has depth h, i.e, 2^h leafs
-    /// the co-path should have size D
+    /// If the tree has depth h, i.e, ARITY^h leafs
+    /// the co-path should have size h * (ARITY - 1): per level, the siblings of the node
+    /// on the path in the order of their position
     std::vector<typename TH::Domain> co_path;
 
     HashTreeOpening(std::vector<typename TH::Domain> _co_path) : co_path(std::move(_co_path)) {}
 };
 
-# if defined(_OPENMP) && defined(VERBOSE)
-    printf_s("Compiled by an OpenMP-compliant implementation.\n");
-# endif
-
-template <TweakableHash_c TH>
+/// A sparse Hash-Tree whose nodes live in one contiguous arena.
+///
+/// The layers are stored one after the other, leaf layer first, each padded to start at a
+/// left child and end at a right child. `layer(l)` locates layer l by its start index and
+/// its offset in the arena. With fixed-size domains the arena is a single cache-line aligned
+/// allocation with a stride of sizeof(Domain), so the tree costs no per-node allocations and
+/// its nodes can be written out or mapped as they are. Copies of a tree share its nodes.
+///
+/// `to_tiled` copies the tree into a layout of subtree tiles instead: the levels are cut into
+/// bands of `tile_height` levels, and a tile holds the nodes of one band below one node of the
+/// level above the band. The co-path nodes of a band all lie in one tile, so `path` reads
+/// depth / tile_height contiguous tiles rather than one node in each of `depth` layers, and
+/// a mapped tree of 2^32 leaves is served from a handful of pages per signature.
+///
+/// With ARITY 4 or 8, a node is the hash of its ARITY children, the layers are padded to whole
+/// groups of siblings, and a co-path holds ARITY - 1 siblings per level. The tree over the same
+/// leaves is then a half or a third as deep, and its hashes take longer inputs.
+template <TweakableHash_c TH, uint ARITY = 2>
 class HashTree {
     using TH_parameter = typename TH::Parameter;
     using TH_domain = typename TH::Domain;
     using TH_tweak = typename TH::Tweak;
 
-    const uint depth;
-    std::vector<HashTreeLayer<TH>> layers;
+    static_assert(TREE_ARITY_BITS<ARITY> != 0, "Hash-Tree: arity must be 2, 4 or 8");
+    static constexpr uint BITS = TREE_ARITY_BITS<ARITY>;
 
 public:
-    HashTree(uint _depth, std::vector<HashTreeLayer<TH>> _layers) : depth(_depth), layers(std::move(_layers)) {}
+    /// The nodes of one layer; `offset` locates them in the layered arena.
+    struct LayerRange {
+        uint start_index;
+        size_t offset;
+        size_t size;
+    };
+
+    /// Flattens `_layers`, e.g. the layers kept by a `TreeHash`.
+    HashTree(uint _depth, std::vector<HashTreeLayer<TH>> _layers) : depth(_depth) {
+        size_t total = 0;
+        for(const HashTreeLayer<TH> &layer : _layers) {
+            total += layer.nodes.size();
+        }
+        Arena arena;
+        arena.reserve(total);
+        ranges.reserve(_layers.size());
+        for(HashTreeLayer<TH> &layer : _layers) {
+            ranges.push_back(LayerRange{layer.start_index, arena.size(), layer.nodes.size()});
+            std::move(layer.nodes.begin(), layer.nodes.end(), std::back_inserter(arena));
+        }
+        adopt(std::move(arena));
+    }
+
+    /// A tree over nodes stored elsewhere, e.g. in a mapped key file, in the layered layout or,
+    /// with `_tile_height` > 0, the tiled one. `storage` keeps them alive and is shared by
+    /// copies of the tree. Throws `std::invalid_argument` if `_nodes` is too short.
+    HashTree(uint _depth, std::vector<LayerRange> _ranges, std::span<const TH_domain> _nodes,
+             std::shared_ptr<const void> _storage, uint _tile_height = 0) :
+    depth(_depth), tile_height(_tile_height), ranges(std::move(_ranges)),
+    bands(tile_bands(ranges, _tile_height)), storage(std::move(_storage)), nodes(_nodes) {
+        if(nodes.size() < arena_size(ranges, bands)) {
+            throw std::invalid_argument("Hash-Tree: fewer nodes than the layers need");
+        }
+    }
+
+    /// Number of nodes the arena of a tree with these layers holds in the layout of
+    /// `_tile_height`, 0 being the layered one.
+    static size_t arena_size(const std::vector<LayerRange> &_ranges, uint _tile_height) {
+        return arena_size(_ranges, tile_bands(_ranges, _tile_height));
+    }
+
+    /// A copy of the tree in the tiled layout with bands of `_tile_height` > 0 levels.
+    HashTree to_tiled(uint _tile_height) const {
+        assert(_tile_height > 0 && (_tile_height + 1) * BITS < 64 && "Hash-Tree tiles: need at least one level per tile");
+
+        HashTree tiled(depth);
+        tiled.tile_height = _tile_height;
+        tiled.ranges = ranges;
+        tiled.bands = tile_bands(ranges, _tile_height);
+        Arena arena(arena_size(ranges, tiled.bands));
+        for(uint l = 0; l < ranges.size(); l++) {
+            for(size_t i = 0; i < ranges[l].size; i++) {
+                const uint32_t position = static_cast<uint32_t>(ranges[l].start_index + i);
+                arena[tiled.index(l, position)] = node(l, position);
+            }
+        }
+        tiled.adopt(std::move(arena));
+        return tiled;
+    }
+
+    /// Number of parents of a layer that `NewHashTree` computes in one executor task, and
+    /// hands to `apply_many` at once.
+    static constexpr size_t TREE_PARENTS_PER_TASK = 512;
 
-    static HashTree NewHashTree(uint depth, uint start_index, TH::Parameter _parameter, vector<typename TH::Domain> leafs_hashes, TH th) {
+    /// Height of the subtrees that `NewHashTree` builds in one task each; the about 2^11 nodes
+    /// of one stay in a worker's L2 cache. Smaller trees use lower subtrees, so that there are
+    /// at least `SUBTREES_PER_WORKER` of them per executor worker.
+    static constexpr uint SUBTREE_HEIGHT = 10 / BITS;
+    static constexpr size_t SUBTREES_PER_WORKER = 4;
+
+    /// Builds the tree over `leafs_hashes`, placed at `start_index`, computing each layer on
+    /// `executor`.
+    static HashTree NewHashTree(uint depth, uint start_index, TH::Parameter _parameter, std::vector<typename TH::Domain> leafs_hashes, TH th,
+                                Executor &executor = *default_executor()) {
         
         // check that number of leafs is a power of two
         assert(
-            (start_index + leafs_hashes.size()) <= (1 << depth) &&
+            (start_index + leafs_hashes.size()) <= (uint64_t{1} << (depth * BITS)) &&
             "Hash-Tree new: Not enough space for leafs. Consider changing start_index or number of leaf hashes"
         );
 
         // we build the tree from the leaf layer to the root,
         // while building the tree, we ensure that the following two invariants hold via appropriate padding:
-        // 1. the layer starts at an even index, i.e., a left child
-        // 2. the layer ends at an odd index, i.e., a right child (does not hold for the root layer)
-        // In this way, we can ensure that we can always hash two siblings to get their parent
-        // The padding is ensured using the helper function `get_padded_layer`.
-        std::vector<HashTreeLayer<TH>> layers(depth + 1);
-
-        // start with the leaf layer, padded accordingly
-        layers.push_back(get_padded_layer(leafs_hashes, start_index));
-
-        for (int level = 0; level < depth; ++level) {
-            vector<vector<TH_domain>> par_chunks;
-            for(int idx = 0; idx < layers[level].nodes.size(); idx += 2) {
-                if (idx + 1 < layers[level].nodes.size()) {
-                    par_chunks.push_back({layers[level].nodes[idx], layers[level].nodes[idx + 1]});
-                } else {
-                    par_chunks.push_back({layers[level].nodes[idx], th.rand_domain()});
+        // 1. the layer starts at a multiple of ARITY, i.e., a first child
+        // 2. the layer ends at a last child (does not hold for the root layer)
+        // In this way, we can ensure that we can always hash ARITY siblings to get their parent
+        // The layout of all layers is known up front, so the arena is allocated once and
+        // every layer is written in place; `padded_range` adds the padding.
+        HashTree tree(depth);
+        tree.ranges.reserve(depth + 1);
+        size_t total = 0;
+        uint layer_start = start_index;
+        size_t layer_size = leafs_hashes.size();
+        for(uint level = 0; level <= depth; ++level) {
+            LayerRange range = padded_range(layer_start, layer_size, total);
+            tree.ranges.push_back(range);
+            total += range.size;
+            layer_start = range.start_index / ARITY;
+            layer_size = range.size / ARITY;
+        }
+        Arena arena(total);
+
+        // start with the leaf layer. The padding of every layer is random and its place is
+        // known from the layout, so it is filled right away; a computed node then only
+        // depends on its children, consecutive in the layer below
+        TH_domain *leaves = tree.layer_begin(arena, 0, start_index);
+        tree.fill_layer(th, arena, 0, leaves, std::move(leafs_hashes.begin(), leafs_hashes.end(), leaves));
+        for (uint level = 0; level < depth; ++level) {
+            TH_domain *parents = tree.layer_begin(arena, level + 1, tree.ranges[level].start_index / ARITY);
+            tree.fill_layer(th, arena, level + 1, parents, parents + tree.ranges[level].size / ARITY);
+        }
+
+        // the lower `split` levels are cut into subtrees of ARITY^split leaves, one task each, that
+        // build all their levels while their nodes are in the worker's cache. The levels above
+        // are built level by level in groups of TREE_PARENTS_PER_TASK parents
+        const LayerRange &leaf_range = tree.ranges[0];
+        uint split = std::min(SUBTREE_HEIGHT, depth);
+        auto num_subtrees = [&](uint height) {
+            return ((leaf_range.start_index + leaf_range.size - 1) >> (height * BITS)) - (leaf_range.start_index >> (height * BITS)) + 1;
+        };
+        while(split > 0 && num_subtrees(split) < SUBTREES_PER_WORKER * size_t{executor.concurrency()}) {
+            split--;
+        }
+
+        if(split > 0) {
+            const uint64_t first_subtree = leaf_range.start_index >> (split * BITS);
+            executor.parallel_for(num_subtrees(split), [&](size_t task, unsigned) {
+                const uint64_t subtree = first_subtree + task;
+                for(uint level = 0; level < split; ++level) {
+                    const uint shift = (split - level - 1) * BITS;
+                    const uint64_t first = tree.ranges[level].start_index / ARITY;
+                    const uint64_t last = first + tree.ranges[level].size / ARITY;
+                    const uint64_t begin = std::max(first, subtree << shift);
+                    const uint64_t end = std::min(last, (subtree + 1) << shift);
+                    if(begin < end) {
+                        tree.hash_parents(th, _parameter, arena, level, begin - first, end - first);
+                    }
                 }
-            }
+            });
+        }
 
-            // build layer `level + 1` from layer `level`
-            // for that, we first build the parents of the previous layer and then
-            // add a padding if needed. We build the parents in parallel.
-            // assert!(layers[level].nodes.len()% 2 == 0);
-            vector<TH_domain> parents(par_chunks.size());
-            #pragma omp parallel for
-            for(int i = 0; i < par_chunks.size(); ++i) {
-                auto& children = par_chunks[i];
-
-                assert(
-                    children.len() == 2 &&
-                    "Unpaired children, padding logic broken"
-                );
-
-                uint position_of_left_child = layers[level].start_index + (2 * i);
-                uint parent_pos = position_of_left_child / 2;
-                TH_tweak tweak = th.tree_tweak((uint8_t)(level + 1), (uint32_t)parent_pos);
-                parents[i] = th.apply(_parameter, tweak, children);
-            }
-            start_index = layers[level].start_index / 2;
-            layers.push_back(get_padded_layer(parents, start_index));
-        }   
-        return HashTree(depth, layers);
+        for (uint level = split; level < depth; ++level) {
+            const size_t num_parents = tree.ranges[level].size / ARITY;
+            const size_t num_tasks = (num_parents + TREE_PARENTS_PER_TASK - 1) / TREE_PARENTS_PER_TASK;
+            executor.parallel_for(num_tasks, [&](size_t task, unsigned) {
+                const size_t begin = task * TREE_PARENTS_PER_TASK;
+                tree.hash_parents(th, _parameter, arena, level, begin, std::min(begin + TREE_PARENTS_PER_TASK, num_parents));
+            });
+        }
+        tree.adopt(std::move(arena));
+        return tree;
     }
 
     /// Function to get a root from a tree. The tree must have at least one layer.
     /// A root is just an output of the tweakable hash.
     TH_domain root() const {
         assert(
-            !layers.empty() &&
+            !ranges.empty() &&
             "Hash-Tree path: Need at least one layer"
         );
 
-        return layers.back().nodes[0];
+        return node(static_cast<uint>(ranges.size() - 1), ranges.back().start_index);
     }
 
-    HashTreeOpening<TH> path(uint32_t position) const {
+    HashTreeOpening<TH, ARITY> path(uint32_t position) const {
         assert(
-            !layers.empty() &&
+            !ranges.empty() &&
             "Hash-Tree path: Need at least one layer"
         );
 
         assert(
-            ((uint64_t)position >= (uint64_t)layers[0].start_index) &&
+            ((uint64_t)position >= (uint64_t)ranges[0].start_index) &&
             "Hash-Tree path: Invalid position, position before start index"
         );
 
         assert(
-            (uint64_t)position < ((uint64_t)layers[0].start_index + (uint64_t)layers[0].nodes.len()) &&
+            (uint64_t)position < ((uint64_t)ranges[0].start_index + (uint64_t)ranges[0].size) &&
             "Hash-Tree path: Invalid position, position too large"
         );
 
-        std::vector<TH_domain> co_path(this->depth);
+        std::vector<TH_domain> co_path;
+        co_path.reserve(this->depth * (ARITY - 1));
         uint32_t current_position = position;
 
-        for(int l = 0; l < this->depth; l++) {
-            // position of the sibling that we want to include
-            auto sibling_position = current_position ^ 0x01;
+        for(uint l = 0; l < this->depth; l++) {
+            // positions of the siblings that we want to include
+            const uint32_t first_sibling = current_position & ~uint32_t{ARITY - 1};
 
-            auto sibling_position_in_vec = sibling_position - (uint32_t)this->layers[l].start_index;
+            // add to the co-path; counting from the first sibling, as first_sibling + ARITY
+            // wraps around for the last leaves of a 2^32 tree
+            for(uint32_t c = 0; c < ARITY; c++) {
+                if(first_sibling + c != current_position) {
+                    co_path.push_back(node(l, first_sibling + c));
+                }
+            }
 
-            // add to the co-path
-            auto sibling = this->layers[l].nodes[(uint)sibling_position_in_vec];
-            co_path.push_back(sibling);
+            // position of the parent in the next layer
+            current_position >>= BITS;
         }
-        return HashTreeOpening<TH>(co_path);
+        return HashTreeOpening<TH, ARITY>(co_path);
     }
 
+    uint tree_depth() const { return depth; }
+
+    /// Levels per tile, or 0 for the layered layout.
+    uint tree_tile_height() const { return tile_height; }
+
+    size_t num_layers() const { return ranges.size(); }
+
+    const LayerRange &layer(uint l) const { return ranges[l]; }
+
+    /// All nodes, layer after layer or tile after tile.
+    std::span<const TH_domain> arena() const { return nodes; }
+
+    /// The node at `position` of layer `level`, which must lie in the layer.
+    const TH_domain &node(uint level, uint32_t position) const { return nodes[index(level, position)]; }
+
 private:
-    HashTreeLayer<TH> get_padded_layer(std::vector<TH_domain> nodes, uint start_index) {
-        uint end_index = start_index + nodes.size() - 1;
+    using Arena = std::vector<TH_domain, CacheAlignedAllocator<TH_domain>>;
+
+    /// Levels [base, top) of the tiled layout. The tiles are those below the nodes
+    /// [first_tile, first_tile + num_tiles) of level `top`, and hold ARITY^(top - l) slots of
+    /// each level l, lowest level first.
+    struct TileBand {
+        uint base;
+        uint top;
+        uint64_t first_tile;
+        uint64_t num_tiles;
+        size_t offset;
+        size_t tile_size;
+    };
+
+    const uint depth;
+    uint tile_height = 0;
+    std::vector<LayerRange> ranges;
+    std::vector<TileBand> bands;
+    /// Owns `nodes`: the tree's own arena or a mapping. Copies of the tree share it.
+    std::shared_ptr<const void> storage;
+    std::span<const TH_domain> nodes;
+
+    explicit HashTree(uint _depth) : depth(_depth) {}
+
+    size_t index(uint level, uint32_t position) const {
+        if(tile_height == 0) {
+            const LayerRange &range = ranges[level];
+            return range.offset + (position - range.start_index);
+        }
+        const TileBand &band = bands[level / tile_height];
+        const uint shift = (band.top - level) * BITS;
+        const uint64_t tile = (uint64_t{position} >> shift) - band.first_tile;
+        const uint64_t level_offset = tile_slots(band.top - band.base) - tile_slots(band.top - level);
+        return band.offset + tile * band.tile_size + level_offset + (position & ((uint64_t{1} << shift) - 1));
+    }
+
+    /// Slots of the levels top - 1 down to top - levels in one tile, ARITY + ... + ARITY^levels.
+    static uint64_t tile_slots(uint levels) {
+        return ((uint64_t{1} << ((levels + 1) * BITS)) - ARITY) / (ARITY - 1);
+    }
 
-        std::vector<TH_domain> nodes_with_padding;
+    /// The bands of the tiled layout; the highest band has the root level as its last level
+    /// and `top` one above it.
+    static std::vector<TileBand> tile_bands(const std::vector<LayerRange> &_ranges, uint _tile_height) {
+        std::vector<TileBand> result;
+        if(_tile_height == 0) {
+            return result;
+        }
+        const uint num_levels = static_cast<uint>(_ranges.size());
+        size_t offset = 0;
+        for(uint base = 0; base < num_levels; base += _tile_height) {
+            TileBand band{base, base + std::min(_tile_height, num_levels - base), UINT64_MAX, 0, offset, 0};
+            uint64_t last_tile = 0;
+            for(uint l = band.base; l < band.top; l++) {
+                const uint shift = (band.top - l) * BITS;
+                band.first_tile = std::min<uint64_t>(band.first_tile, _ranges[l].start_index >> shift);
+                last_tile = std::max<uint64_t>(last_tile, (_ranges[l].start_index + _ranges[l].size - 1) >> shift);
+            }
+            band.num_tiles = last_tile - band.first_tile + 1;
+            band.tile_size = tile_slots(band.top - band.base);
+            offset += band.num_tiles * band.tile_size;
+            result.push_back(band);
+        }
+        return result;
+    }
 
-        if(start_index % 2 == 1) {
-            nodes_with_padding.push_back(TH::rand_domain());
+    static size_t arena_size(const std::vector<LayerRange> &_ranges, const std::vector<TileBand> &_bands) {
+        if(!_bands.empty()) {
+            return _bands.back().offset + _bands.back().num_tiles * _bands.back().tile_size;
         }
-        uint actual_start_index = start_index - (start_index % 2);
+        size_t total = 0;
+        for(const LayerRange &range : _ranges) {
+            total = std::max(total, range.offset + range.size);
+        }
+        return total;
+    }
+
+    void adopt(Arena arena) {
+        auto owned = std::make_shared<const Arena>(std::move(arena));
+        nodes = std::span<const TH_domain>(*owned);
+        storage = std::move(owned);
+    }
 
-        nodes_with_padding.insert(nodes_with_padding.end(), nodes.begin(), nodes.end());
+    /// The range of a layer of `size` nodes from `start_index`, padded to start at a first
+    /// child and end at a last child.
+    static LayerRange padded_range(uint start_index, size_t size, size_t offset) {
+        uint end_index = start_index + size - 1;
+        size_t padded = size + (start_index % ARITY) + (ARITY - 1 - end_index % ARITY);
+        return LayerRange{start_index - (start_index % ARITY), offset, padded};
+    }
+
+    /// Where the node at `start_index` of layer `l` goes, after the left padding.
+    TH_domain *layer_begin(Arena &arena, uint l, uint start_index) const {
+        return arena.data() + ranges[l].offset + (start_index - ranges[l].start_index);
+    }
 
-        if (end_index % 2 == 0) {
-            nodes_with_padding.push_back(TH::rand_domain());
+    /// Computes the parents [begin, end) of layer `level`'s nodes, counted from the parent of
+    /// its first ARITY nodes, into layer `level + 1`. If the hash supports it, they are handed
+    /// to `apply_many` in groups of TREE_PARENTS_PER_TASK, which hashes them in SIMD lanes.
+    void hash_parents(TH &th, const TH_parameter &parameter, Arena &arena, uint level, size_t begin, size_t end) const {
+        const LayerRange &children_range = ranges[level];
+        const TH_domain *children = arena.data() + children_range.offset;
+        TH_domain *parents = layer_begin(arena, level + 1, children_range.start_index / ARITY);
+        const uint32_t first_parent = children_range.start_index / ARITY;
+
+        if constexpr (BatchTweakableHash_c<TH>) {
+            std::vector<TH_tweak> tweaks;
+            std::vector<std::span<const TH_domain>> pairs;
+            for(size_t group = begin; group < end; group += TREE_PARENTS_PER_TASK) {
+                const size_t group_end = std::min(group + TREE_PARENTS_PER_TASK, end);
+                tweaks.clear();
+                pairs.clear();
+                for(size_t i = group; i < group_end; ++i) {
+                    tweaks.push_back(tree_node_tweak<ARITY>(th, level + 1, (uint32_t)(first_parent + i)));
+                    pairs.push_back(std::span<const TH_domain>(children + ARITY * i, ARITY));
+                }
+                std::vector<TH_domain> hashed = th.apply_many(parameter, tweaks, pairs);
+                std::move(hashed.begin(), hashed.end(), parents + group);
+            }
+        } else {
+            for(size_t i = begin; i < end; ++i) {
+                TH_tweak tweak = tree_node_tweak<ARITY>(th, level + 1, (uint32_t)(first_parent + i));
+                parents[i] = th.apply(parameter, tweak, std::span<const TH_domain>(children + ARITY * i, ARITY));
+            }
         }
+    }
 
-        return HashTreeLayer<TH>(actual_start_index, nodes_with_padding);
+    /// Fills the padding of layer `l` with random nodes, i.e. every node outside the
+    /// computed ones in [first, last).
+    void fill_layer(TH &th, Arena &arena, uint l, TH_domain *first, TH_domain *last) const {
+        TH_domain *begin = arena.data() + ranges[l].offset;
+        TH_domain *end = begin + ranges[l].size;
+        for(TH_domain *node = begin; node != first; ++node) {
+            *node = th.rand_domain();
+        }
+        for(TH_domain *node = last; node != end; ++node) {
+            *node = th.rand_domain();
+        }
     }
 };
 
-template <TweakableHash_c TH>
+/// Checks that `leaf` is at `position` of the ARITY-ary tree with root `root`, the tree's
+/// depth being the number of levels in `opening`.
+template <TweakableHash_c TH, uint ARITY = 2>
 bool hash_tree_verify(
-    typename TH::Parameter &parameter, 
-    typename TH::Domain &root,
+    const typename TH::Parameter &parameter, 
+    const typename TH::Domain &root,
     uint32_t position,
-    std::vector<typename TH::Domain> &leaf,
-    HashTreeOpening<TH> &opening,
+    std::span<const typename TH::Domain> leaf,
+    const HashTreeOpening<TH, ARITY> &opening,
     TH th
 ) {
     using TH_tweak = typename TH::Tweak;
     using TH_domain = typename TH::Domain;
+    constexpr uint BITS = TREE_ARITY_BITS<ARITY>;
+    static_assert(BITS != 0, "Hash-Tree verify: arity must be 2, 4 or 8");
+
+    assert(
+        opening.co_path.size() % (ARITY - 1) == 0 &&
+        "Hash-Tree verify: co-path does not hold whole levels"
+    );
 
-    int depth = opening.co_path.size();
-    uint64_t num_leafs = 1 << depth;
+    const uint depth = static_cast<uint>(opening.co_path.size() / (ARITY - 1));
+    uint64_t num_leafs = uint64_t{1} << (depth * BITS);
 
     assert(
-        depth <= 32 &&
-        "Hash-Tree verify: Tree depth must be at most 32"
+        depth * BITS <= 32 &&
+        "Hash-Tree verify: Tree depth must be at most 32 / log2(ARITY)"
     );
 
     assert(
@@ -199,23 +481,21 @@ bool hash_tree_verify(
 
     uint32_t current_position = position;
 
-    for(uint64_t l = 0; l < depth; l++) {
-        TH_domain children[2];
-
-        if(current_position % 2 == 0) {
-            children[0] = current_node;
-            children[1] = opening.co_path[l];
-        } else {
-            children[0] = opening.co_path[l];
-            children[1] = current_node;
+    for(uint l = 0; l < depth; l++) {
+        // the node goes to the slot of its child index, its siblings around it in order
+        TH_domain children[ARITY];
+        const uint child_index = current_position % ARITY;
+        const TH_domain *siblings = opening.co_path.data() + l * (ARITY - 1);
+        for(uint c = 0; c < ARITY; c++) {
+            children[c] = c < child_index ? siblings[c] : c == child_index ? current_node : siblings[c - 1];
         }
 
-        current_position >>= 1;
+        current_position >>= BITS;
 
-        TH_tweak tweak_ = th.tree_tweak(static_cast<uint8_t>(l + 1), current_position);
+        TH_tweak tweak_ = tree_node_tweak<ARITY>(th, l + 1, current_position);
         
-        current_node = th.apply(parameter, tweak, children);
+        current_node = th.apply(parameter, tweak_, std::span<const TH_domain>(children));
     }
 
     return current_node == root;
-}
\ No newline at end of file
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include "executor.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A thread pool that runs a flat range of independent tasks with work stealing.
+///
+/// Every worker owns a deque of task indices, seeded with a contiguous share of the range.
+/// A worker takes tasks from the front of its own deque, so it walks its share in order and
+/// keeps its working set small. When its deque is empty it steals the back half of another
+/// worker's deque. Tasks do not create new tasks, so a worker stops once every deque is empty.
+///
+/// The deques hold contiguous index ranges, which makes taking and stealing O(1) under a
+/// short per-worker lock.
+///
+/// The threads are started once and sleep between calls; the calling thread works as worker 0.
+/// Calls from several threads are run one after the other, and a `parallel_for` issued from
+/// inside a task runs inline on that worker.
+class WorkStealingScheduler final : public Executor {
+public:
+    /// `num_threads` = 0 uses one thread per hardware thread.
+    explicit WorkStealingScheduler(unsigned num_threads = 0) :
+    threads(num_threads > 0 ? num_threads : std::max(1u, std::thread::hardware_concurrency())),
+    deques(threads) {
+        pool.reserve(threads - 1);
+        for (unsigned w = 1; w < threads; w++) {
+            pool.emplace_back([this, w] { worker_loop(w); });
+        }
+    }
+
+    WorkStealingScheduler(const WorkStealingScheduler &) = delete;
+    WorkStealingScheduler &operator=(const WorkStealingScheduler &) = delete;
+
+    ~WorkStealingScheduler() override {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &t : pool) {
+            t.join();
+        }
+    }
+
+    unsigned num_threads() const { return threads; }
+
+    unsigned concurrency() const override { return threads; }
+
+    /// If a task throws, the remaining tasks are skipped and the first exception is rethrown.
+    void parallel_for(size_t num_tasks, const Task &fn) override {
+        if (num_tasks == 0) {
+            return;
+        }
+        if (current == this) {
+            for (size_t task = 0; task < num_tasks; task++) {
+                fn(task, current_worker);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> serial(run_mutex);
+
+        for (unsigned w = 0; w < threads; w++) {
+            deques[w].begin = num_tasks * w / threads;
+            deques[w].end = num_tasks * (w + 1) / threads;
+        }
+        failed = false;
+        error = nullptr;
+        job = &fn;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+            busy = threads - 1;
+        }
+        wake.notify_all();
+
+        work(0);
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [&] { return busy == 0; });
+        }
+        job = nullptr;
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /// Runs `fn(task, worker)` for every task, see `parallel_for`.
+    template <typename Fn>
+    void run(size_t num_tasks, Fn fn) {
+        parallel_for(num_tasks, Task(std::move(fn)));
+    }
+
+    /// Whether the calling thread is running a task of some pool. Such a thread must not wait
+    /// for a `parallel_for` issued by another thread: that call may queue behind the one
+    /// running the task.
+    static bool in_task() { return current != nullptr; }
+
+private:
+    unsigned threads;
+
+    /// the tasks [begin, end) still owned by one worker
+    struct alignas(64) Deque {
+        std::mutex mutex;
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    std::vector<Deque> deques;
+    std::vector<std::thread> pool;
+
+    /// serializes `parallel_for` calls
+    std::mutex run_mutex;
+
+    /// protects generation, busy and stopping
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint64_t generation = 0;
+    unsigned busy = 0;
+    bool stopping = false;
+
+    const Task *job = nullptr;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    /// the pool and worker index of the calling thread while it runs a task
+    static inline thread_local WorkStealingScheduler *current = nullptr;
+    static inline thread_local unsigned current_worker = 0;
+
+    void worker_loop(unsigned w) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+
+            work(w);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    void work(unsigned w) {
+        WorkStealingScheduler *outer = current;
+        unsigned outer_worker = current_worker;
+        current = this;
+        current_worker = w;
+        try {
+            size_t task;
+            while (!failed.load(std::memory_order_relaxed) && next(w, task)) {
+                (*job)(task, w);
+            }
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+            failed = true;
+        }
+        current = outer;
+        current_worker = outer_worker;
+    }
+
+    /// Takes the next task of worker `w`, stealing if its own deque is empty.
+    bool next(unsigned w, size_t &task) {
+        {
+            Deque &own = deques[w];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (own.begin < own.end) {
+                task = own.begin++;
+                return true;
+            }
+        }
+
+        for (unsigned i = 1; i < threads; i++) {
+            Deque &victim = deques[(w + i) % threads];
+            size_t begin, end;
+            {
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                size_t left = victim.end - victim.begin;
+                if (left == 0) {
+                    continue;
+                }
+                // take the back half, or the last task
+                end = victim.end;
+                begin = end - (left + 1) / 2;
+                victim.end = begin;
+            }
+
+            Deque &own = deques[w];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            own.begin = begin + 1;
+            own.end = end;
+            task = begin;
+            return true;
+        }
+        return false;
+    }
+};
+
+/// The work-stealing pool shared by everything that is not given an executor, with one thread
+/// per hardware thread, started on first use.
+inline std::shared_ptr<Executor> default_executor() {
+    static std::shared_ptr<Executor> pool = std::make_shared<WorkStealingScheduler>();
+    return pool;
+}
+
+/// A second process-wide work-stealing pool for short, latency-critical calls such as a parallel
+/// `SignatureScheme::verify`. `parallel_for` calls on one pool run one after the other, so
+/// sharing `default_executor()` would queue such a call behind a whole key generation or
+/// bottom tree build; on this pool it only waits for other short calls.
+inline std::shared_ptr<Executor> latency_executor() {
+    static std::shared_ptr<Executor> pool = std::make_shared<WorkStealingScheduler>();
+    return pool;
+}
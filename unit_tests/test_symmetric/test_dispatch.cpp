@@ -0,0 +1,130 @@
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <openssl/sha.h>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/dispatch.hpp"
+#include "../../src/symmetric/sha256/dispatch.hpp"
+#include "../../src/symmetric/keccak/keccak.hpp"
+#include "../../src/random2.hpp"
+
+static const KernelSelection *find_selection(const std::vector<KernelSelection> &report, const std::string &backend, std::size_t len)
+{
+      auto it = std::find_if(report.begin(), report.end(), [&](const KernelSelection &s)
+                             { return s.backend == backend && s.input_len == len; });
+      return it == report.end() ? nullptr : &*it;
+}
+
+TEST_CASE("sha256::Dispatch: every length hashes like OpenSSL")
+{
+      for (std::size_t len : {0, 39, 55, 56, 64, 70, 119, 200})
+      {
+            std::vector<uint8_t> input = Random::generate_vector<uint8_t>(len);
+
+            uint8_t digest[32], expected[32];
+            sha256::Dispatch::hash(input.data(), len, digest);
+            SHA256(input.data(), len, expected);
+            REQUIRE(std::memcmp(digest, expected, 32) == 0);
+
+            std::size_t lanes = sha256::Dispatch::lanes(len);
+            REQUIRE((lanes == 0 || lanes == sha256::MultiLane::LANES_AVX2 || lanes == sha256::MultiLane::LANES_AVX512));
+            if (lanes == sha256::MultiLane::LANES_AVX512)
+            {
+                  REQUIRE(sha256::MultiLane::has_avx512());
+            }
+            if (lanes == sha256::MultiLane::LANES_AVX2)
+            {
+                  REQUIRE(sha256::MultiLane::has_avx2());
+            }
+      }
+}
+
+TEST_CASE("KernelSelector: one report entry per backend and length")
+{
+      sha256::Dispatch::single(47);
+      sha256::Dispatch::single(47);
+      sha256::Dispatch::lanes(47);
+
+      auto report = KernelSelector::report();
+      REQUIRE(std::count_if(report.begin(), report.end(), [](const KernelSelection &s)
+                            { return s.backend == "sha256" && s.input_len == 47; }) == 1);
+
+      const KernelSelection *batch = find_selection(report, "sha256-batch", 47);
+      REQUIRE(batch != nullptr);
+      REQUIRE_FALSE(batch->forced);
+      REQUIRE(batch->ns_per_hash > 0);
+
+      std::ostringstream printed;
+      KernelSelector::print_report(printed);
+      REQUIRE(printed.str().find("sha256-batch (47 input units)") != std::string::npos);
+}
+
+TEST_CASE("KernelSelector: threads alternating lengths agree on one choice per length")
+{
+      const std::vector<std::size_t> lengths = {301, 302, 303};
+      std::vector<std::vector<std::size_t>> lanes(4);
+      std::vector<std::thread> threads;
+      for (std::size_t t = 0; t < lanes.size(); t++)
+      {
+            threads.emplace_back([&, t]
+            {
+                  for (int round = 0; round < 50; round++)
+                  {
+                        for (std::size_t len : lengths)
+                        {
+                              lanes[t].push_back(sha256::Dispatch::lanes(len));
+                        }
+                  }
+            });
+      }
+      for (std::thread &thread : threads)
+      {
+            thread.join();
+      }
+
+      for (std::size_t t = 1; t < lanes.size(); t++)
+      {
+            REQUIRE(lanes[t] == lanes[0]);
+      }
+      auto report = KernelSelector::report();
+      for (std::size_t len : lengths)
+      {
+            REQUIRE(std::count_if(report.begin(), report.end(), [&](const KernelSelection &s)
+                                  { return s.backend == "sha256-batch" && s.input_len == len; }) == 1);
+      }
+}
+
+TEST_CASE("KernelSelector: XMSS_KERNEL forces a kernel")
+{
+      setenv("XMSS_KERNEL", "keccak-scalar,sha256-openssl", 1);
+      auto single = sha256::Dispatch::single(1001);
+      bool x4 = keccak::Sponge<keccak::Sha3_256>::use_x4(1001);
+      unsetenv("XMSS_KERNEL");
+
+      REQUIRE(single == sha256::Dispatch::OPENSSL);
+      REQUIRE_FALSE(x4);
+
+      auto report = KernelSelector::report();
+      const KernelSelection *sha = find_selection(report, "sha256", 1001);
+      REQUIRE(sha != nullptr);
+      REQUIRE(sha->forced);
+      REQUIRE(sha->kernel == "sha256-openssl");
+
+      const KernelSelection *sha3 = find_selection(report, "sha3-256", 1001);
+      REQUIRE(sha3 != nullptr);
+      REQUIRE(sha3->kernel == "keccak-scalar");
+}
+
+TEST_CASE("KernelSelector: multi-lane kernels are only picked when supported")
+{
+      bool x4 = keccak::Sponge<keccak::Shake128>::use_x4(51);
+      if (x4)
+      {
+            REQUIRE(keccak::Keccak::has_avx2());
+      }
+      REQUIRE_FALSE(CpuFeatures::get().to_string().empty());
+}
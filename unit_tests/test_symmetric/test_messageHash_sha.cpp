@@ -2,7 +2,7 @@
 #include <cstdint>
 #include <iostream>
 #include "../../src/symmetric/message_hash/sha.hpp"
-// #include "../../src/random2.hpp"
+#include "../../src/random2.hpp"
 #include "../../src/config.hpp"
 
 // Example Instantiations
@@ -88,4 +88,35 @@ TEST_CASE("ShaMessageHash192x3")
             std::cout << static_cast<int>(result[i]) << ' ';
       }
       std::cout << std::endl;
-}
\ No newline at end of file
+}
+TEST_CASE("ShaMessageHash: SHA-256 of randomness || parameter || separator || epoch || message")
+{
+      constexpr uint8_t PARAM_LEN = 16;
+      constexpr uint8_t RAND_LEN = 16;
+      ShaMessageHash<PARAM_LEN, RAND_LEN, 32, 8> hash;
+
+      auto parameter = Random::generate_array<uint8_t, PARAM_LEN>();
+      auto randomness = hash.rand();
+      const uint32_t epoch = 0x01020304;
+
+      // empty, short, and longer than the stack buffer of the in-tree kernel
+      for (size_t message_len : {0, 32, 200, 1000})
+      {
+            auto message = Random::generate_vector<uint8_t>(message_len);
+
+            std::vector<uint8_t> input(randomness.begin(), randomness.end());
+            input.insert(input.end(), parameter.begin(), parameter.end());
+            input.push_back(TWEAK_SEPARATOR_FOR_MESSAGE_HASH);
+            const uint32_t encoded_epoch = endian::to_le(epoch);
+            const uint8_t *epoch_bytes = reinterpret_cast<const uint8_t *>(&encoded_epoch);
+            input.insert(input.end(), epoch_bytes, epoch_bytes + sizeof(encoded_epoch));
+            input.insert(input.end(), message.begin(), message.end());
+
+            std::vector<uint8_t> expected(EVP_MAX_MD_SIZE);
+            unsigned int expected_len = 0;
+            REQUIRE(EVP_Digest(input.data(), input.size(), expected.data(), &expected_len, EVP_sha256(), NULL) == 1);
+            expected.resize(expected_len);
+
+            REQUIRE(hash.apply(parameter, epoch, randomness, message) == expected);
+      }
+}
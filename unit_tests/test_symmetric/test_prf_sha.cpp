@@ -3,6 +3,8 @@
 #include "../../src/random2.hpp"
 #include <cstdint>
 #include <iostream>
+#include <thread>
+#include <openssl/sha.h>
 
 TEST_CASE("Test prf keys are not all same")
 {
@@ -27,4 +29,46 @@ TEST_CASE("Test prf keys are not all same")
       }
 
       REQUIRE(all_same_count < K);
-}
\ No newline at end of file
+}
+TEST_CASE("Test prf matches SHA-256 and is stable across threads")
+{
+      const unsigned int OUTPUT_LEN = 24;
+
+      SHA256PRF prf = SHA256PRF(OUTPUT_LEN);
+      auto key = prf.key_gen();
+
+      // key || epoch (big-endian) || index (big-endian)
+      std::vector<uint8_t> input(key.begin(), key.end());
+      uint8_t epoch_be[4] = {0, 0, 0, 5};
+      uint8_t index_be[8] = {0, 0, 0, 0, 0, 0, 0, 9};
+      input.insert(input.end(), epoch_be, epoch_be + 4);
+      input.insert(input.end(), index_be, index_be + 8);
+
+      uint8_t expected[32];
+      SHA256(input.data(), input.size(), expected);
+
+      auto output = prf.apply(key, 5, 9);
+      REQUIRE(output == std::vector<uint8_t>(expected, expected + OUTPUT_LEN));
+
+      // every thread gets its own cached context, the output must not depend on it
+      std::vector<std::vector<uint8_t>> outputs(4);
+      std::vector<std::thread> threads;
+      for (int t = 0; t < 4; t++)
+      {
+            threads.emplace_back([&, t]()
+                                 {
+                  for (int i = 0; i < 100; i++)
+                  {
+                        outputs[t] = prf.apply(key, 5, 9);
+                  } });
+      }
+      for (auto &thread : threads)
+      {
+            thread.join();
+      }
+
+      for (auto &out : outputs)
+      {
+            REQUIRE(out == output);
+      }
+}
@@ -0,0 +1,59 @@
+#include <iostream>
+#include <vector>
+#include <cstring>
+#include <openssl/sha.h>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/sha256/compress.hpp"
+#include "../../src/random2.hpp"
+
+template <std::size_t LEN>
+void check_fixed_input()
+{
+      std::vector<uint8_t> input = Random::generate_vector<uint8_t>(LEN);
+
+      typename sha256::FixedInput<LEN>::Block block;
+      std::memcpy(block, input.data(), LEN);
+      sha256::FixedInput<LEN>::pad(block);
+
+      uint8_t digest[32];
+      sha256::FixedInput<LEN>::hash(block, digest);
+
+      uint8_t expected[32];
+      SHA256(input.data(), LEN, expected);
+
+      REQUIRE(std::memcmp(digest, expected, 32) == 0);
+}
+
+TEST_CASE("FixedInput: digests match OpenSSL SHA-256")
+{
+      // chain inputs of the usual instantiations, and the one/two block boundary
+      check_fixed_input<16 + 7 + 16>();
+      check_fixed_input<16 + 7 + 24>();
+      check_fixed_input<24 + 7 + 24>();
+      check_fixed_input<55>();
+      check_fixed_input<56>();
+      check_fixed_input<16 + 6 + 2 * 24>();
+      check_fixed_input<0>();
+}
+
+TEST_CASE("Compress: SHA-NI and portable agree")
+{
+      if (!sha256::Compress::has_sha_ni())
+      {
+            SKIP("CPU does not support the SHA extensions");
+      }
+
+      for (int i = 0; i < 100; i++)
+      {
+            auto block = Random::generate_array<uint8_t, 64>();
+            uint32_t portable[8];
+            uint32_t sha_ni[8];
+            std::memcpy(portable, sha256::IV, sizeof(portable));
+            std::memcpy(sha_ni, sha256::IV, sizeof(sha_ni));
+
+            sha256::Compress::compress_portable(portable, block.data());
+            sha256::Compress::compress_sha_ni(sha_ni, block.data());
+
+            REQUIRE(std::memcmp(portable, sha_ni, sizeof(portable)) == 0);
+      }
+}
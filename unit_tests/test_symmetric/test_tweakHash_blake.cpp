@@ -0,0 +1,154 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <span>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/tweak_hash/blake.hpp"
+#include "../../src/symmetric/TweakHash.hpp"
+#include "../../src/random2.hpp"
+
+// BLAKE3 through the incremental hasher
+static std::vector<uint8_t> reference(const std::vector<uint8_t> &input, size_t hash_len)
+{
+      blake3_hasher blake;
+      blake3_hasher_init(&blake);
+      blake3_hasher_update(&blake, input.data(), input.size());
+
+      std::vector<uint8_t> output(BLAKE3_OUT_LEN);
+      blake3_hasher_finalize(&blake, output.data(), BLAKE3_OUT_LEN);
+      output.resize(hash_len);
+      return output;
+}
+
+TEST_CASE("BlakeTweakDigest: single-chunk compression matches the hasher")
+{
+      // lengths around the block boundaries up to a full chunk
+      for (size_t len : {0, 1, 39, 63, 64, 65, 127, 128, 500, 1023, 1024})
+      {
+            auto input = Random::generate_vector<uint8_t>(len);
+
+            uint8_t output[BLAKE3_OUT_LEN];
+            BlakeTweakDigest::hash_chunk(input.data(), len, output);
+
+            REQUIRE(std::vector<uint8_t>(output, output + BLAKE3_OUT_LEN) == reference(input, BLAKE3_OUT_LEN));
+      }
+}
+
+TEST_CASE("test_apply: BlakeTweakHash returns HASH_LEN bytes of BLAKE3")
+{
+      BlakeTweakHash BlakeTweak128192 = BlakeTweakHash(16, 24);
+
+      auto parameter = BlakeTweak128192.rand_parameter();
+      auto message = BlakeTweak128192.rand_domain();
+      auto tweak = BlakeTweak128192.chain_tweak(2, 3, 4);
+
+      auto result = BlakeTweak128192.apply(parameter, tweak, message);
+
+      std::vector<uint8_t> input = parameter;
+      input.insert(input.end(), tweak.data(), tweak.data() + tweak.size());
+      input.insert(input.end(), message.begin(), message.end());
+
+      REQUIRE(result.size() == 24);
+      REQUIRE(result == reference(input, 24));
+}
+
+TEST_CASE("test_apply_many: BlakeTweakHashPadded batches match apply")
+{
+      using TH = BlakeTweakHashPadded<16, 24>;
+      TH BlakeTweakPadded128192;
+      BlakeTweakPadded128192.internal_consistency_check();
+
+      auto parameter = BlakeTweakPadded128192.rand_parameter();
+
+      // chain steps followed by tree nodes, so there are two runs of different lengths
+      const size_t n = 37;
+      std::vector<TH::Domain> domains(2 * n);
+      std::vector<BlakeTweak> tweaks;
+      std::vector<std::span<const TH::Domain>> messages;
+      for (size_t i = 0; i < 2 * n; i++)
+      {
+            domains[i] = BlakeTweakPadded128192.rand_domain();
+      }
+      for (size_t i = 0; i < n; i++)
+      {
+            tweaks.push_back(BlakeTweakPadded128192.chain_tweak(7, static_cast<uint8_t>(i), 3));
+            messages.emplace_back(&domains[i], 1);
+      }
+      for (size_t i = 0; i + 1 < n; i += 2)
+      {
+            tweaks.push_back(BlakeTweakPadded128192.tree_tweak(1, static_cast<uint32_t>(i)));
+            messages.emplace_back(&domains[n + i], 2);
+      }
+
+      auto results = BlakeTweakPadded128192.apply_many(parameter, tweaks, messages);
+
+      REQUIRE(results.size() == tweaks.size());
+      for (size_t i = 0; i < tweaks.size(); i++)
+      {
+            REQUIRE(results[i] == BlakeTweakPadded128192.apply(parameter, tweaks[i], messages[i]));
+
+            // BLAKE3 of the zero-padded input
+            std::vector<uint8_t> input(parameter.begin(), parameter.end());
+            input.insert(input.end(), tweaks[i].data(), tweaks[i].data() + tweaks[i].size());
+            for (const auto &message : messages[i])
+            {
+                  input.insert(input.end(), message.begin(), message.end());
+            }
+            input.resize((input.size() + 63) / 64 * 64, 0);
+            REQUIRE(std::vector<uint8_t>(results[i].begin(), results[i].end()) == reference(input, 24));
+      }
+}
+
+TEST_CASE("test_apply: BlakeTweakHashPadded streams inputs longer than a chunk")
+{
+      using TH = BlakeTweakHashPadded<16, 24>;
+      TH BlakeTweakPadded128192;
+
+      auto parameter = BlakeTweakPadded128192.rand_parameter();
+      auto tweak = BlakeTweakPadded128192.tree_tweak(0, 5);
+
+      // a leaf over 64 chain ends is 1556 bytes, two chunks once padded
+      std::vector<TH::Domain> ends(64);
+      for (auto &end : ends)
+      {
+            end = BlakeTweakPadded128192.rand_domain();
+      }
+      auto result = BlakeTweakPadded128192.apply(parameter, tweak, std::span<const TH::Domain>(ends));
+
+      std::vector<uint8_t> input(parameter.begin(), parameter.end());
+      input.insert(input.end(), tweak.data(), tweak.data() + tweak.size());
+      for (const auto &end : ends)
+      {
+            input.insert(input.end(), end.begin(), end.end());
+      }
+      input.resize((input.size() + 63) / 64 * 64, 0);
+      REQUIRE(input.size() > BLAKE3_CHUNK_LEN);
+      REQUIRE(std::vector<uint8_t>(result.begin(), result.end()) == reference(input, 24));
+}
+
+TEST_CASE("test_chain_many: BlakeTweakHashPadded matches chain for every chain")
+{
+      BlakeTweakHashPadded<16, 16> BlakeTweakPadded128128;
+
+      auto parameter = BlakeTweakPadded128128.rand_parameter();
+      const size_t num_chains = 20;
+
+      std::vector<uint8_t> chain_indices(num_chains);
+      std::vector<uint8_t> start_pos(num_chains);
+      std::vector<uint> steps(num_chains);
+      std::vector<BlakeTweakHashPadded<16, 16>::Domain> starts(num_chains);
+      for (size_t i = 0; i < num_chains; i++)
+      {
+            chain_indices[i] = static_cast<uint8_t>(i);
+            start_pos[i] = static_cast<uint8_t>(i % 5);
+            steps[i] = static_cast<uint>((3 * i) % 11);
+            starts[i] = BlakeTweakPadded128128.rand_domain();
+      }
+
+      auto ends = chain_many(BlakeTweakPadded128128, parameter, 9, chain_indices, start_pos, steps, starts);
+
+      for (size_t i = 0; i < num_chains; i++)
+      {
+            REQUIRE(ends[i] == chain(BlakeTweakPadded128128, parameter, 9, chain_indices[i], start_pos[i], steps[i], starts[i]));
+      }
+}
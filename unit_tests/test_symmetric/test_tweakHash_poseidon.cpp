@@ -0,0 +1,210 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <span>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/tweak_hash/poseidon.hpp"
+#include "../../src/symmetric/TweakHash.hpp"
+#include "../../src/random2.hpp"
+
+using koalabear::Element;
+
+static Element rand_element()
+{
+      return Element::from_u64(Random::generate<uint64_t>());
+}
+
+TEST_CASE("KoalaBear: field arithmetic")
+{
+      for (int i = 0; i < 1000; i++)
+      {
+            Element a = rand_element(), b = rand_element();
+            uint64_t x = a.value, y = b.value;
+
+            REQUIRE((a + b).value == (x + y) % koalabear::P);
+            REQUIRE((a - b).value == (x + koalabear::P - y) % koalabear::P);
+            REQUIRE((a * b).value == (x * y) % koalabear::P);
+            if (a.value != 0)
+            {
+                  REQUIRE((a * a.inverse()).value == 1);
+            }
+      }
+}
+
+__attribute__((target("avx2"))) static void packed_ops(const std::array<Element, 8> &a, const std::array<Element, 8> &b,
+                                                      std::array<Element, 8> &sum, std::array<Element, 8> &diff,
+                                                      std::array<Element, 8> &prod)
+{
+      using koalabear::Packed;
+
+      __m256i va = Packed::to_monty(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a.data())));
+      __m256i vb = Packed::to_monty(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b.data())));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(sum.data()), Packed::from_monty(Packed::add(va, vb)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(diff.data()), Packed::from_monty(Packed::sub(va, vb)));
+      _mm256_storeu_si256(reinterpret_cast<__m256i *>(prod.data()), Packed::from_monty(Packed::mul(va, vb)));
+}
+
+TEST_CASE("KoalaBear: packed arithmetic matches scalar")
+{
+      if (!koalabear::Packed::has_avx2())
+      {
+            SKIP("CPU does not support AVX2");
+      }
+
+      for (int i = 0; i < 100; i++)
+      {
+            std::array<Element, 8> a, b;
+            for (size_t l = 0; l < 8; l++)
+            {
+                  a[l] = rand_element();
+                  b[l] = rand_element();
+            }
+            // include the extremes
+            if (i == 0)
+            {
+                  a.fill(Element::from_u64(koalabear::P - 1));
+                  b.fill(Element::from_u64(koalabear::P - 1));
+            }
+
+            std::array<Element, 8> sum, diff, prod;
+            packed_ops(a, b, sum, diff, prod);
+
+            for (size_t l = 0; l < 8; l++)
+            {
+                  REQUIRE(sum[l] == a[l] + b[l]);
+                  REQUIRE(diff[l] == a[l] - b[l]);
+                  REQUIRE(prod[l] == a[l] * b[l]);
+            }
+      }
+}
+
+TEST_CASE("Poseidon2: eight-lane permutation matches the scalar permutation")
+{
+      if (!koalabear::Packed::has_avx2())
+      {
+            SKIP("CPU does not support AVX2");
+      }
+
+      // compression mode and sponge mode
+      for (size_t len : {1, 9, 16, 17, 40})
+      {
+            std::vector<std::vector<Element>> inputs(8, std::vector<Element>(len));
+            std::vector<std::array<Element, 8>> outputs(8);
+            const Element *in[8];
+            Element *out[8];
+            for (size_t l = 0; l < 8; l++)
+            {
+                  for (auto &e : inputs[l])
+                  {
+                        e = rand_element();
+                  }
+                  in[l] = inputs[l].data();
+                  out[l] = outputs[l].data();
+            }
+
+            PoseidonTweakDigest::hash_x8(in, len, out, 8);
+
+            for (size_t l = 0; l < 8; l++)
+            {
+                  std::array<Element, 8> expected;
+                  PoseidonTweakDigest::hash(inputs[l].data(), len, expected.data(), 8);
+                  REQUIRE(outputs[l] == expected);
+            }
+      }
+}
+
+TEST_CASE("test_apply_many: PoseidonTweakHash batches match apply")
+{
+      using TH = PoseidonTweakHash<5, 7>;
+      TH PoseidonTweak57;
+      PoseidonTweak57.internal_consistency_check();
+
+      auto parameter = PoseidonTweak57.rand_parameter();
+
+      const size_t n = 37;
+      std::vector<TH::Domain> domains(2 * n);
+      std::vector<PoseidonTweak> tweaks;
+      std::vector<std::span<const TH::Domain>> messages;
+      for (auto &domain : domains)
+      {
+            domain = PoseidonTweak57.rand_domain();
+      }
+      for (size_t i = 0; i < n; i++)
+      {
+            tweaks.push_back(PoseidonTweak57.chain_tweak(7, static_cast<uint8_t>(i), 3));
+            messages.emplace_back(&domains[i], 1);
+      }
+      for (size_t i = 0; i + 1 < n; i += 2)
+      {
+            tweaks.push_back(PoseidonTweak57.tree_tweak(1, static_cast<uint32_t>(i)));
+            messages.emplace_back(&domains[n + i], 2);
+      }
+
+      auto results = PoseidonTweak57.apply_many(parameter, tweaks, messages);
+
+      REQUIRE(results.size() == tweaks.size());
+      for (size_t i = 0; i < tweaks.size(); i++)
+      {
+            REQUIRE(results[i] == PoseidonTweak57.apply(parameter, tweaks[i], messages[i]));
+      }
+}
+
+TEST_CASE("test_chain: PoseidonTweakHash chain and chain_many agree")
+{
+      PoseidonTweakHash<5, 7> PoseidonTweak57;
+
+      auto parameter = PoseidonTweak57.rand_parameter();
+      auto start = PoseidonTweak57.rand_domain();
+
+      auto end = chain(PoseidonTweak57, parameter, 4, 1, 0, 5, start);
+      auto middle = chain(PoseidonTweak57, parameter, 4, 1, 0, 2, start);
+      REQUIRE(chain(PoseidonTweak57, parameter, 4, 1, 2, 3, middle) == end);
+
+      std::vector<PoseidonTweakHash<5, 7>::Domain> starts = {start, middle};
+      auto ends = chain_many(PoseidonTweak57, parameter, 4, {1, 1}, {0, 2}, {5, 3}, starts);
+      REQUIRE(ends[0] == end);
+      REQUIRE(ends[1] == end);
+}
+
+TEST_CASE("Test Poseidon tweaks: patched template equals fresh encoding, tree and chain differ")
+{
+      for (int i = 0; i < 1000; i++)
+      {
+            uint32_t epoch = Random::generate<uint32_t>();
+            uint8_t chain_index = Random::generate<uint8_t>();
+            uint8_t pos_in_chain = Random::generate<uint8_t>();
+
+            PoseidonTweak tweak = PoseidonTweak::chain(epoch, 0, 0);
+            tweak.set_chain_index(chain_index);
+            tweak.set_pos_in_chain(pos_in_chain);
+
+            PoseidonTweak expected = PoseidonTweak::chain(epoch, chain_index, pos_in_chain);
+            REQUIRE(tweak.elements == expected.elements);
+            REQUIRE(tweak.elements != PoseidonTweak::tree(static_cast<uint8_t>(epoch), epoch).elements);
+      }
+}
+
+TEST_CASE("domain_from_bytes: field domains take 8 bytes per element and reject shorter PRF outputs")
+{
+      using Domain = PoseidonTweakHash<5, 7>::Domain;
+
+      std::vector<uint8_t> bytes(8 * 7);
+      for (size_t i = 0; i < bytes.size(); i++)
+      {
+            bytes[i] = static_cast<uint8_t>(i + 1);
+      }
+      Domain domain = domain_from_bytes<Domain>(bytes);
+      for (size_t i = 0; i < domain.size(); i++)
+      {
+            uint64_t value = 0;
+            for (size_t b = 0; b < 8; b++)
+            {
+                  value |= static_cast<uint64_t>(bytes[8 * i + b]) << (8 * b);
+            }
+            REQUIRE(domain[i] == Element::from_u64(value));
+      }
+
+      // a 32-byte SHA-256 PRF output covers only 4 of the 7 elements
+      REQUIRE_THROWS_AS(domain_from_bytes<Domain>(std::vector<uint8_t>(32, 1)), std::invalid_argument);
+      REQUIRE_THROWS_AS(domain_from_bytes<Domain>(std::vector<uint8_t>(8 * 7 - 1, 1)), std::invalid_argument);
+}
@@ -35,7 +35,7 @@ TEST_CASE("test_apply: ShaTweak128128 tree tweak")
       messages.insert(messages.end(), message_1.begin(), message_1.end());
       messages.insert(messages.end(), message_2.begin(), message_2.end());
 
-      ShaTweak128128.apply(parameter, *tree_tweak, messages);
+      ShaTweak128128.apply(parameter, tree_tweak, messages);
 }
 
 TEST_CASE("test_apply: ShaTweak128128 chain tweak")
@@ -53,7 +53,7 @@ TEST_CASE("test_apply: ShaTweak128128 chain tweak")
       messages.insert(messages.end(), message_1.begin(), message_1.end());
       messages.insert(messages.end(), message_2.begin(), message_2.end());
 
-      ShaTweak128128.apply(parameter, *chain_tweak, messages);
+      ShaTweak128128.apply(parameter, chain_tweak, messages);
 }
 
 TEST_CASE("test_apply: ShaTweak128192 tree tweak")
@@ -71,7 +71,7 @@ TEST_CASE("test_apply: ShaTweak128192 tree tweak")
       messages.insert(messages.end(), message_1.begin(), message_1.end());
       messages.insert(messages.end(), message_2.begin(), message_2.end());
 
-      ShaTweak128192.apply(parameter, *tree_tweak, messages);
+      ShaTweak128192.apply(parameter, tree_tweak, messages);
 }
 
 TEST_CASE("test_apply: ShaTweak128192 chain tweak")
@@ -89,7 +89,7 @@ TEST_CASE("test_apply: ShaTweak128192 chain tweak")
       messages.insert(messages.end(), message_1.begin(), message_1.end());
       messages.insert(messages.end(), message_2.begin(), message_2.end());
 
-      std::vector<uint8_t> result = ShaTweak128192.apply(parameter, *chain_tweak, messages);
+      std::vector<uint8_t> result = ShaTweak128192.apply(parameter, chain_tweak, messages);
 }
 
 TEST_CASE("test_apply: ShaTweak192192 tree tweak")
@@ -107,7 +107,7 @@ TEST_CASE("test_apply: ShaTweak192192 tree tweak")
       messages.insert(messages.end(), message_1.begin(), message_1.end());
       messages.insert(messages.end(), message_2.begin(), message_2.end());
 
-      ShaTweak192192.apply(parameter, *tree_tweak, messages);
+      ShaTweak192192.apply(parameter, tree_tweak, messages);
 }
 
 TEST_CASE("test_apply: ShaTweak192192 chain tweak")
@@ -125,7 +125,7 @@ TEST_CASE("test_apply: ShaTweak192192 chain tweak")
       messages.insert(messages.end(), message_1.begin(), message_1.end());
       messages.insert(messages.end(), message_2.begin(), message_2.end());
 
-      ShaTweak192192.apply(parameter, *chain_tweak, messages);
+      ShaTweak192192.apply(parameter, chain_tweak, messages);
 }
 
 TEST_CASE("Test tree tweak injective")
@@ -137,8 +137,8 @@ TEST_CASE("Test tree tweak injective")
             uint8_t level1 = Random::generate<uint8_t>();
             uint32_t pos_in_level1 = Random::generate<uint32_t>();
 
-            std::unique_ptr<ShaTweak> tweak1 = std::make_unique<ShaTreeTweak>(level1, pos_in_level1);
-            std::vector<uint8_t> tweak_encoding1 = tweak1->to_bytes();
+            ShaTreeTweak tweak1(level1, pos_in_level1);
+            std::vector<uint8_t> tweak_encoding1 = tweak1.to_bytes();
 
             std::unordered_map<std::vector<uint8_t>, std::pair<uint8_t, uint32_t>, VectorHasher> map;
             auto it1 = map.find(tweak_encoding1);
@@ -175,8 +175,8 @@ TEST_CASE("Test tree tweak injective")
             for (int i = 0; i < 1000; i++)
             {
                   uint32_t pos_in_level2 = Random::generate<uint32_t>();
-                  std::unique_ptr<ShaTweak> tweak2 = std::make_unique<ShaTreeTweak>(level2, pos_in_level2);
-                  std::vector<uint8_t> tweak_encoding2 = tweak2->to_bytes();
+                  ShaTreeTweak tweak2(level2, pos_in_level2);
+                  std::vector<uint8_t> tweak_encoding2 = tweak2.to_bytes();
                   auto [it2, inserted] = map2.emplace(tweak_encoding2, std::make_pair(level2, pos_in_level2));
 
                   if (!inserted)
@@ -207,8 +207,8 @@ TEST_CASE("Test tree tweak injective")
             for (int i = 0; i < 1000; i++)
             {
                   uint8_t level3 = Random::generate<uint8_t>();
-                  std::unique_ptr<ShaTweak> tweak3 = std::make_unique<ShaTreeTweak>(level3, pos_in_level3);
-                  std::vector<uint8_t> tweak_encoding3 = tweak3->to_bytes();
+                  ShaTreeTweak tweak3(level3, pos_in_level3);
+                  std::vector<uint8_t> tweak_encoding3 = tweak3.to_bytes();
                   auto [it3, inserted3] = map3.emplace(tweak_encoding3, level3);
                   if (!inserted3)
                   {
@@ -244,8 +244,8 @@ TEST_CASE("Test chain tweak hash: injective")
 
             std::tuple<uint32_t, uint8_t, uint8_t> input1(epoch1, chain_index1, pos_in_chain1);
 
-            std::unique_ptr<ShaTweak> tweak1 = std::make_unique<ShaChainTweak>(epoch1, chain_index1, pos_in_chain1);
-            std::vector<uint8_t> tweak_encoding1 = tweak1->to_bytes();
+            ShaChainTweak tweak1(epoch1, chain_index1, pos_in_chain1);
+            std::vector<uint8_t> tweak_encoding1 = tweak1.to_bytes();
 
             auto [it1, inserted1] = map1.emplace(tweak_encoding1, input1);
             if (!inserted1)
@@ -270,8 +270,8 @@ TEST_CASE("Test chain tweak hash: injective")
 
             std::tuple<uint32_t, uint8_t, uint8_t> input2(epoch2, chain_index2, pos_in_chain2);
 
-            std::unique_ptr<ShaTweak> tweak2 = std::make_unique<ShaChainTweak>(epoch2, chain_index2, pos_in_chain2);
-            std::vector<uint8_t> tweak_encoding2 = tweak2->to_bytes();
+            ShaChainTweak tweak2(epoch2, chain_index2, pos_in_chain2);
+            std::vector<uint8_t> tweak_encoding2 = tweak2.to_bytes();
 
             auto [it2, inserted2] = map2.emplace(tweak_encoding2, input2);
             if (!inserted2)
@@ -297,8 +297,8 @@ TEST_CASE("Test chain tweak hash: injective")
 
             std::tuple<uint32_t, uint8_t, uint8_t> input3(epoch3, chain_index3, pos_in_chain3);
 
-            std::unique_ptr<ShaTweak> tweak3 = std::make_unique<ShaChainTweak>(epoch3, chain_index2, pos_in_chain3);
-            std::vector<uint8_t> tweak_encoding3 = tweak3->to_bytes();
+            ShaChainTweak tweak3(epoch3, chain_index2, pos_in_chain3);
+            std::vector<uint8_t> tweak_encoding3 = tweak3.to_bytes();
 
             auto [it3, inserted3] = map3.emplace(tweak_encoding3, input3);
             if (!inserted3)
@@ -317,8 +317,8 @@ TEST_CASE("Test chain tweak hash: injective")
                   uint8_t level1 = Random::generate<uint8_t>();
                   uint32_t pos_in_level1 = Random::generate<uint32_t>();
 
-                  std::unique_ptr<ShaTweak> tweak1 = std::make_unique<ShaTreeTweak>(level1, pos_in_level1);
-                  std::vector<uint8_t> tweak_encoding1 = tweak1->to_bytes();
+                  ShaTreeTweak tweak1(level1, pos_in_level1);
+                  std::vector<uint8_t> tweak_encoding1 = tweak1.to_bytes();
 
                   std::unordered_map<std::vector<uint8_t>, std::pair<uint8_t, uint32_t>, VectorHasher> map;
                   auto it1 = map.find(tweak_encoding1);
@@ -355,8 +355,8 @@ TEST_CASE("Test chain tweak hash: injective")
                   for (int i = 0; i < 1000; i++)
                   {
                         uint32_t pos_in_level2 = Random::generate<uint32_t>();
-                        std::unique_ptr<ShaTweak> tweak2 = std::make_unique<ShaTreeTweak>(level2, pos_in_level2);
-                        std::vector<uint8_t> tweak_encoding2 = tweak2->to_bytes();
+                        ShaTreeTweak tweak2(level2, pos_in_level2);
+                        std::vector<uint8_t> tweak_encoding2 = tweak2.to_bytes();
                         auto [it2, inserted] = map2.emplace(tweak_encoding2, std::make_pair(level2, pos_in_level2));
 
                         if (!inserted)
@@ -387,8 +387,8 @@ TEST_CASE("Test chain tweak hash: injective")
                   for (int i = 0; i < 1000; i++)
                   {
                         uint8_t level3 = Random::generate<uint8_t>();
-                        std::unique_ptr<ShaTweak> tweak3 = std::make_unique<ShaTreeTweak>(level3, pos_in_level3);
-                        std::vector<uint8_t> tweak_encoding3 = tweak3->to_bytes();
+                        ShaTreeTweak tweak3(level3, pos_in_level3);
+                        std::vector<uint8_t> tweak_encoding3 = tweak3.to_bytes();
                         auto [it3, inserted3] = map3.emplace(tweak_encoding3, level3);
                         if (!inserted3)
                         {
@@ -426,8 +426,8 @@ TEST_CASE("Test chain tweak hash: injective")
 
             std::tuple<uint32_t, uint8_t, uint8_t> input1(epoch1, chain_index1, pos_in_chain1);
 
-            std::unique_ptr<ShaTweak> tweak1 = std::make_unique<ShaChainTweak>(epoch1, chain_index1, pos_in_chain1);
-            std::vector<uint8_t> tweak_encoding1 = tweak1->to_bytes();
+            ShaChainTweak tweak1(epoch1, chain_index1, pos_in_chain1);
+            std::vector<uint8_t> tweak_encoding1 = tweak1.to_bytes();
 
             auto [it1, inserted1] = map1.emplace(tweak_encoding1, input1);
             if (!inserted1)
@@ -452,8 +452,8 @@ TEST_CASE("Test chain tweak hash: injective")
 
             std::tuple<uint32_t, uint8_t, uint8_t> input2(epoch2, chain_index2, pos_in_chain2);
 
-            std::unique_ptr<ShaTweak> tweak2 = std::make_unique<ShaChainTweak>(epoch2, chain_index2, pos_in_chain2);
-            std::vector<uint8_t> tweak_encoding2 = tweak2->to_bytes();
+            ShaChainTweak tweak2(epoch2, chain_index2, pos_in_chain2);
+            std::vector<uint8_t> tweak_encoding2 = tweak2.to_bytes();
 
             auto [it2, inserted2] = map2.emplace(tweak_encoding2, input2);
             if (!inserted2)
@@ -479,8 +479,8 @@ TEST_CASE("Test chain tweak hash: injective")
 
             std::tuple<uint32_t, uint8_t, uint8_t> input3(epoch3, chain_index3, pos_in_chain3);
 
-            std::unique_ptr<ShaTweak> tweak3 = std::make_unique<ShaChainTweak>(epoch3, chain_index2, pos_in_chain3);
-            std::vector<uint8_t> tweak_encoding3 = tweak3->to_bytes();
+            ShaChainTweak tweak3(epoch3, chain_index2, pos_in_chain3);
+            std::vector<uint8_t> tweak_encoding3 = tweak3.to_bytes();
 
             auto [it3, inserted3] = map3.emplace(tweak_encoding3, input3);
             if (!inserted3)
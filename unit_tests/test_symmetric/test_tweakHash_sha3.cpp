@@ -0,0 +1,168 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <span>
+#include <openssl/evp.h>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/tweak_hash/sha3.hpp"
+#include "../../src/symmetric/message_hash/sha3.hpp"
+#include "../../src/symmetric/TweakHash.hpp"
+#include "../../src/random2.hpp"
+
+static std::vector<uint8_t> openssl_digest(const EVP_MD *md, const std::vector<uint8_t> &input, size_t out_len)
+{
+      std::vector<uint8_t> output(out_len);
+      EVP_MD_CTX *ctx = EVP_MD_CTX_new();
+      EVP_DigestInit_ex(ctx, md, nullptr);
+      EVP_DigestUpdate(ctx, input.data(), input.size());
+      if (EVP_MD_flags(md) & EVP_MD_FLAG_XOF)
+      {
+            EVP_DigestFinalXOF(ctx, output.data(), out_len);
+      }
+      else
+      {
+            std::vector<uint8_t> digest(EVP_MAX_MD_SIZE);
+            EVP_DigestFinal_ex(ctx, digest.data(), nullptr);
+            std::copy_n(digest.begin(), out_len, output.begin());
+      }
+      EVP_MD_CTX_free(ctx);
+      return output;
+}
+
+TEST_CASE("Keccak: sponges match OpenSSL SHA3-256 and SHAKE128, one and four lanes")
+{
+      // lengths around the rate boundaries of both variants
+      for (size_t len : {0, 1, 39, 135, 136, 137, 167, 168, 169, 300})
+      {
+            std::vector<std::vector<uint8_t>> inputs(4);
+            const uint8_t *in[4];
+            for (size_t l = 0; l < 4; l++)
+            {
+                  inputs[l] = Random::generate_vector<uint8_t>(len);
+                  in[l] = inputs[l].data();
+            }
+
+            std::vector<std::vector<uint8_t>> sha3_out(4, std::vector<uint8_t>(32)), shake_out(4, std::vector<uint8_t>(200));
+            uint8_t *out_sha3[4], *out_shake[4];
+            for (size_t l = 0; l < 4; l++)
+            {
+                  out_sha3[l] = sha3_out[l].data();
+                  out_shake[l] = shake_out[l].data();
+            }
+            keccak::Sponge<keccak::Sha3_256>::hash_x4(in, len, out_sha3, 32);
+            keccak::Sponge<keccak::Shake128>::hash_x4(in, len, out_shake, 200);
+
+            for (size_t l = 0; l < 4; l++)
+            {
+                  std::vector<uint8_t> sha3(32), shake(200);
+                  keccak::Sponge<keccak::Sha3_256>::hash(inputs[l].data(), len, sha3.data(), 32);
+                  keccak::Sponge<keccak::Shake128>::hash(inputs[l].data(), len, shake.data(), 200);
+
+                  REQUIRE(sha3 == openssl_digest(EVP_sha3_256(), inputs[l], 32));
+                  REQUIRE(shake == openssl_digest(EVP_shake128(), inputs[l], 200));
+                  REQUIRE(sha3_out[l] == sha3);
+                  REQUIRE(shake_out[l] == shake);
+            }
+      }
+}
+
+TEST_CASE("test_apply_many: Sha3TweakHash and ShakeTweakHash batches match apply")
+{
+      Sha3TweakHash<16, 24> Sha3Tweak128192;
+      ShakeTweakHash<16, 24> ShakeTweak128192;
+      Sha3Tweak128192.internal_consistency_check();
+
+      auto parameter = Sha3Tweak128192.rand_parameter();
+
+      // chain steps followed by tree nodes, so one group mixes lengths
+      const size_t n = 11;
+      std::vector<Sha3TweakHash<16, 24>::Domain> domains(2 * n);
+      std::vector<Sha3Tweak> tweaks;
+      std::vector<std::span<const Sha3TweakHash<16, 24>::Domain>> messages;
+      for (auto &domain : domains)
+      {
+            domain = Sha3Tweak128192.rand_domain();
+      }
+      for (size_t i = 0; i < n; i++)
+      {
+            tweaks.push_back(Sha3Tweak128192.chain_tweak(7, static_cast<uint8_t>(i), 3));
+            messages.emplace_back(&domains[i], 1);
+      }
+      for (size_t i = 0; i + 1 < n; i += 2)
+      {
+            tweaks.push_back(Sha3Tweak128192.tree_tweak(1, static_cast<uint32_t>(i)));
+            messages.emplace_back(&domains[n + i], 2);
+      }
+
+      auto sha3_results = Sha3Tweak128192.apply_many(parameter, tweaks, messages);
+      auto shake_results = ShakeTweak128192.apply_many(parameter, tweaks, messages);
+
+      for (size_t i = 0; i < tweaks.size(); i++)
+      {
+            REQUIRE(sha3_results[i] == Sha3Tweak128192.apply(parameter, tweaks[i], messages[i]));
+            REQUIRE(shake_results[i] == ShakeTweak128192.apply(parameter, tweaks[i], messages[i]));
+
+            std::vector<uint8_t> input(parameter.begin(), parameter.end());
+            input.insert(input.end(), tweaks[i].data(), tweaks[i].data() + tweaks[i].size());
+            for (const auto &message : messages[i])
+            {
+                  input.insert(input.end(), message.begin(), message.end());
+            }
+            REQUIRE(std::vector<uint8_t>(sha3_results[i].begin(), sha3_results[i].end()) == openssl_digest(EVP_sha3_256(), input, 24));
+      }
+}
+
+TEST_CASE("test_chain_many: Sha3TweakHash matches chain for every chain")
+{
+      Sha3TweakHash<16, 16> Sha3Tweak128128;
+
+      auto parameter = Sha3Tweak128128.rand_parameter();
+      const size_t num_chains = 10;
+
+      std::vector<uint8_t> chain_indices(num_chains);
+      std::vector<uint8_t> start_pos(num_chains);
+      std::vector<uint> steps(num_chains);
+      std::vector<Sha3TweakHash<16, 16>::Domain> starts(num_chains);
+      for (size_t i = 0; i < num_chains; i++)
+      {
+            chain_indices[i] = static_cast<uint8_t>(i);
+            start_pos[i] = static_cast<uint8_t>(i % 5);
+            steps[i] = static_cast<uint>((3 * i) % 11);
+            starts[i] = Sha3Tweak128128.rand_domain();
+      }
+
+      auto ends = chain_many(Sha3Tweak128128, parameter, 9, chain_indices, start_pos, steps, starts);
+
+      for (size_t i = 0; i < num_chains; i++)
+      {
+            REQUIRE(ends[i] == chain(Sha3Tweak128128, parameter, 9, chain_indices[i], start_pos[i], steps[i], starts[i]));
+      }
+}
+
+TEST_CASE("Sha3MessageHash: apply_many matches apply")
+{
+      ShakeMessageHash<16, 16, 64, 4> ShakeMessageHash128;
+      ShakeMessageHash128.internal_consistency_check();
+
+      std::array<uint8_t, 16> parameter = Random::generate_array<uint8_t, 16>();
+
+      const size_t n = 6;
+      std::vector<uint32_t> epochs(n);
+      std::vector<std::array<uint8_t, 16>> randomness(n);
+      std::vector<std::vector<uint8_t>> messages(n);
+      for (size_t i = 0; i < n; i++)
+      {
+            epochs[i] = static_cast<uint32_t>(13 + i);
+            randomness[i] = ShakeMessageHash128.rand();
+            messages[i] = Random::generate_vector<uint8_t>(MESSAGE_LENGTH);
+      }
+
+      auto results = ShakeMessageHash128.apply_many(parameter, epochs, randomness, messages);
+
+      for (size_t i = 0; i < n; i++)
+      {
+            auto expected = ShakeMessageHash128.apply(parameter, epochs[i], randomness[i], messages[i]);
+            REQUIRE(expected.size() == 64);
+            REQUIRE(results[i] == expected);
+      }
+}
@@ -0,0 +1,102 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <span>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/tweak_hash/sha.hpp"
+#include "../../src/symmetric/TweakHash.hpp"
+#include "../../src/random2.hpp"
+
+TEST_CASE("test_apply: ShaTweakHashFixed matches ShaTweakHash")
+{
+      ShaTweakHash ShaTweak128192 = ShaTweakHash(16, 24);
+      ShaTweakHashFixed<16, 24> ShaTweakFixed128192;
+      ShaTweakFixed128192.internal_consistency_check();
+
+      auto parameter = ShaTweakFixed128192.rand_parameter();
+      auto message = ShaTweakFixed128192.rand_domain();
+
+      std::vector<uint8_t> parameter_vec(parameter.begin(), parameter.end());
+      std::vector<uint8_t> message_vec(message.begin(), message.end());
+
+      auto chain_tweak = ShaTweakFixed128192.chain_tweak(2, 3, 4);
+      auto result = ShaTweakFixed128192.apply(parameter, chain_tweak, message);
+      auto expected = ShaTweak128192.apply(parameter_vec, chain_tweak, message_vec);
+
+      REQUIRE(std::vector<uint8_t>(result.begin(), result.end()) == expected);
+}
+
+TEST_CASE("test_apply: ShaTweakHashFixed tree tweak over two children")
+{
+      ShaTweakHash ShaTweak128128 = ShaTweakHash(16, 16);
+      ShaTweakHashFixed<16, 16> ShaTweakFixed128128;
+
+      auto parameter = ShaTweakFixed128128.rand_parameter();
+      std::array<ShaTweakHashFixed<16, 16>::Domain, 2> children = {ShaTweakFixed128128.rand_domain(),
+                                                                    ShaTweakFixed128128.rand_domain()};
+
+      auto tree_tweak = ShaTweakFixed128128.tree_tweak(1, 3);
+      auto result = ShaTweakFixed128128.apply(parameter, tree_tweak, std::span<const ShaTweakHashFixed<16, 16>::Domain>(children));
+
+      std::vector<uint8_t> parameter_vec(parameter.begin(), parameter.end());
+      std::vector<uint8_t> concatenated(children[0].begin(), children[0].end());
+      concatenated.insert(concatenated.end(), children[1].begin(), children[1].end());
+      auto expected = ShaTweak128128.apply(parameter_vec, tree_tweak, concatenated);
+
+      REQUIRE(std::vector<uint8_t>(result.begin(), result.end()) == expected);
+}
+
+TEST_CASE("test_chain: ShaTweakHashFixed chain and chain_many agree")
+{
+      ShaTweakHashFixed<24, 24> ShaTweakFixed192192;
+
+      auto parameter = ShaTweakFixed192192.rand_parameter();
+      auto start = ShaTweakFixed192192.rand_domain();
+
+      // walking 5 steps at once is the same as walking 2 and then 3
+      auto end = chain(ShaTweakFixed192192, parameter, 4, 1, 0, 5, start);
+      auto middle = chain(ShaTweakFixed192192, parameter, 4, 1, 0, 2, start);
+      REQUIRE(chain(ShaTweakFixed192192, parameter, 4, 1, 2, 3, middle) == end);
+
+      std::vector<ShaTweakHashFixed<24, 24>::Domain> starts = {start, middle};
+      auto ends = chain_many(ShaTweakFixed192192, parameter, 4, {1, 1}, {0, 2}, {5, 3}, starts);
+      REQUIRE(ends[0] == end);
+      REQUIRE(ends[1] == end);
+}
+
+TEST_CASE("Test chain tweak: patched template equals fresh encoding")
+{
+      for (int i = 0; i < 1000; i++)
+      {
+            uint32_t epoch = Random::generate<uint32_t>();
+            uint8_t chain_index = Random::generate<uint8_t>();
+            uint8_t pos_in_chain = Random::generate<uint8_t>();
+
+            ShaTweak tweak = ShaTweak::chain(epoch, 0, 0);
+            tweak.set_chain_index(chain_index);
+            tweak.set_pos_in_chain(pos_in_chain);
+
+            ShaChainTweak expected(epoch, chain_index, pos_in_chain);
+            REQUIRE(tweak.to_bytes() == expected.to_bytes());
+            REQUIRE(tweak.size() == ShaTweak::CHAIN_LEN);
+      }
+
+      REQUIRE(ShaTreeTweak(3, 7).size() == ShaTweak::TREE_LEN);
+}
+
+TEST_CASE("domain_from_bytes: fixed-size domains take the first bytes and reject shorter PRF outputs")
+{
+      using Domain = ShaTweakHashFixed<16, 32>::Domain;
+
+      std::vector<uint8_t> bytes(40);
+      for (size_t i = 0; i < bytes.size(); i++)
+      {
+            bytes[i] = static_cast<uint8_t>(i + 1);
+      }
+      Domain domain = domain_from_bytes<Domain>(bytes);
+      REQUIRE(std::vector<uint8_t>(domain.begin(), domain.end()) == std::vector<uint8_t>(bytes.begin(), bytes.begin() + 32));
+
+      // e.g. a 24-byte PRF output for a 32-byte domain
+      REQUIRE_THROWS_AS(domain_from_bytes<Domain>(std::vector<uint8_t>(24, 1)), std::invalid_argument);
+      REQUIRE_THROWS_AS(domain_from_bytes<Domain>(std::vector<uint8_t>(31, 1)), std::invalid_argument);
+}
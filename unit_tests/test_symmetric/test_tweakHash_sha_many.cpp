@@ -0,0 +1,312 @@
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <span>
+#include <openssl/sha.h>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/tweak_hash/sha.hpp"
+#include "../../src/symmetric/TweakHash.hpp"
+#include "../../src/random2.hpp"
+
+TEST_CASE("MultiLane: digests match OpenSSL SHA-256")
+{
+      const size_t lanes = sha256::MultiLane::lanes();
+      if (lanes == 0)
+      {
+            SKIP("CPU supports neither AVX2 nor AVX-512");
+      }
+
+      // lengths around the one and two block padding boundaries
+      for (size_t len : {0, 1, 31, 55, 56, 63, 64, 65, 119, 120, 200})
+      {
+            std::vector<std::vector<uint8_t>> inputs(sha256::MultiLane::LANES_AVX512);
+            std::vector<std::vector<uint8_t>> outputs(sha256::MultiLane::LANES_AVX512, std::vector<uint8_t>(32));
+            const uint8_t *in[sha256::MultiLane::LANES_AVX512];
+            uint8_t *out[sha256::MultiLane::LANES_AVX512];
+
+            for (size_t l = 0; l < sha256::MultiLane::LANES_AVX512; l++)
+            {
+                  inputs[l] = Random::generate_vector<uint8_t>(len);
+                  in[l] = inputs[l].data();
+                  out[l] = outputs[l].data();
+            }
+
+            if (sha256::MultiLane::has_avx2())
+            {
+                  sha256::MultiLane::hash_x8(in, len, out);
+                  for (size_t l = 0; l < sha256::MultiLane::LANES_AVX2; l++)
+                  {
+                        uint8_t expected[32];
+                        SHA256(inputs[l].data(), len, expected);
+                        REQUIRE(std::equal(expected, expected + 32, outputs[l].begin()));
+                  }
+            }
+
+            if (sha256::MultiLane::has_avx512())
+            {
+                  sha256::MultiLane::hash_x16(in, len, out);
+                  for (size_t l = 0; l < sha256::MultiLane::LANES_AVX512; l++)
+                  {
+                        uint8_t expected[32];
+                        SHA256(inputs[l].data(), len, expected);
+                        REQUIRE(std::equal(expected, expected + 32, outputs[l].begin()));
+                  }
+            }
+      }
+}
+
+TEST_CASE("test_apply_many: chain tweaks match apply")
+{
+      ShaTweakHash ShaTweak128192 = ShaTweakHash(16, 24);
+
+      auto parameter = ShaTweak128192.rand_parameter();
+
+      // not a multiple of the lane count, so the last group is partially filled
+      const size_t n = 37;
+      std::vector<ShaTweakHash::Domain> domains(n);
+      std::vector<ShaTweak> tweaks;
+      std::vector<std::span<const ShaTweakHash::Domain>> messages;
+      for (size_t i = 0; i < n; i++)
+      {
+            domains[i] = ShaTweak128192.rand_domain();
+            tweaks.push_back(ShaTweak128192.chain_tweak(7, static_cast<uint8_t>(i), 3));
+            messages.emplace_back(&domains[i], 1);
+      }
+
+      auto results = ShaTweak128192.apply_many(parameter, tweaks, messages);
+
+      REQUIRE(results.size() == n);
+      for (size_t i = 0; i < n; i++)
+      {
+            REQUIRE(results[i] == ShaTweak128192.apply(parameter, tweaks[i], domains[i]));
+      }
+}
+
+TEST_CASE("test_apply_many: tree tweaks with two children match apply")
+{
+      ShaTweakHash ShaTweak128128 = ShaTweakHash(16, 16);
+
+      auto parameter = ShaTweak128128.rand_parameter();
+
+      const size_t n = 16;
+      std::vector<ShaTweakHash::Domain> nodes(2 * n);
+      std::vector<ShaTweak> tweaks;
+      std::vector<std::span<const ShaTweakHash::Domain>> messages;
+      for (size_t i = 0; i < 2 * n; i++)
+      {
+            nodes[i] = ShaTweak128128.rand_domain();
+      }
+      for (size_t i = 0; i < n; i++)
+      {
+            tweaks.push_back(ShaTweak128128.tree_tweak(1, static_cast<uint32_t>(i)));
+            messages.emplace_back(&nodes[2 * i], 2);
+      }
+
+      auto results = ShaTweak128128.apply_many(parameter, tweaks, messages);
+
+      for (size_t i = 0; i < n; i++)
+      {
+            auto tweak = ShaTweak128128.tree_tweak(1, static_cast<uint32_t>(i));
+            std::vector<uint8_t> concatenated = nodes[2 * i];
+            concatenated.insert(concatenated.end(), nodes[2 * i + 1].begin(), nodes[2 * i + 1].end());
+
+            REQUIRE(results[i] == ShaTweak128128.apply(parameter, tweak, concatenated));
+      }
+}
+
+TEST_CASE("test_apply_many: a batch of mixed lengths picks the lanes for every length")
+{
+      // lengths no other test uses, so their kernels are selected here
+      using TH = ShaTweakHashFixed<20, 20>;
+      TH ShaTweakFixed160160;
+
+      auto parameter = ShaTweakFixed160160.rand_parameter();
+
+      // a leaf over five chain ends followed by nodes over two children
+      const size_t n = 33;
+      std::vector<TH::Domain> domains(5 + 2 * n);
+      std::vector<ShaTweak> tweaks;
+      std::vector<std::span<const TH::Domain>> messages;
+      for (auto &domain : domains)
+      {
+            domain = ShaTweakFixed160160.rand_domain();
+      }
+      tweaks.push_back(ShaTweakFixed160160.tree_tweak(0, 3));
+      messages.emplace_back(&domains[0], 5);
+      for (size_t i = 0; i < n; i++)
+      {
+            tweaks.push_back(ShaTweakFixed160160.tree_tweak(1, static_cast<uint32_t>(i)));
+            messages.emplace_back(&domains[5 + 2 * i], 2);
+      }
+
+      auto results = ShaTweakFixed160160.apply_many(parameter, tweaks, messages);
+
+      REQUIRE(results.size() == tweaks.size());
+      for (size_t i = 0; i < tweaks.size(); i++)
+      {
+            REQUIRE(results[i] == ShaTweakFixed160160.apply(parameter, tweaks[i], messages[i]));
+      }
+
+      const size_t leaf_len = 20 + tweaks[0].size() + 5 * 20;
+      const size_t node_len = 20 + tweaks[1].size() + 2 * 20;
+      auto batch_selected = [](size_t len)
+      {
+            for (const auto &selection : KernelSelector::report())
+            {
+                  if (selection.backend == "sha256-batch" && selection.input_len == len)
+                  {
+                        return true;
+                  }
+            }
+            return false;
+      };
+      REQUIRE(batch_selected(leaf_len));
+      REQUIRE(batch_selected(node_len));
+}
+
+TEST_CASE("test_chain_many: matches chain for every chain")
+{
+      ShaTweakHash ShaTweak128128 = ShaTweakHash(16, 16);
+
+      auto parameter = ShaTweak128128.rand_parameter();
+      const uint32_t epoch = 9;
+      const size_t num_chains = 20;
+
+      std::vector<uint8_t> chain_indices(num_chains);
+      std::vector<uint8_t> start_pos(num_chains);
+      std::vector<uint> steps(num_chains);
+      std::vector<ShaTweakHash::Domain> starts(num_chains);
+      for (size_t i = 0; i < num_chains; i++)
+      {
+            chain_indices[i] = static_cast<uint8_t>(i);
+            start_pos[i] = static_cast<uint8_t>(i % 5);
+            steps[i] = static_cast<uint>((3 * i) % 11);
+            starts[i] = ShaTweak128128.rand_domain();
+      }
+
+      auto ends = chain_many(ShaTweak128128, parameter, epoch, chain_indices, start_pos, steps, starts);
+
+      for (size_t i = 0; i < num_chains; i++)
+      {
+            auto expected = chain(ShaTweak128128, parameter, epoch, chain_indices[i], start_pos[i], steps[i], starts[i]);
+            REQUIRE(ends[i] == expected);
+      }
+}
+
+TEST_CASE("test_walk_chains: chains of several epochs match chain")
+{
+      using TH = ShaTweakHashFixed<16, 24>;
+      TH ShaTweakFixed128192;
+
+      auto parameter = ShaTweakFixed128192.rand_parameter();
+
+      // four epochs of 13 chains, every chain with its own start and length
+      std::vector<ChainJob> jobs;
+      std::vector<TH::Domain> starts;
+      for (uint32_t epoch = 30; epoch < 34; epoch++)
+      {
+            for (uint8_t chain_index = 0; chain_index < 13; chain_index++)
+            {
+                  uint8_t start_pos = static_cast<uint8_t>((epoch + chain_index) % 4);
+                  uint steps = static_cast<uint>((7 * chain_index + epoch) % 12);
+                  jobs.push_back({epoch, chain_index, start_pos, steps});
+                  starts.push_back(ShaTweakFixed128192.rand_domain());
+            }
+      }
+
+      ChainStates<TH> states{std::span<const TH::Domain>(starts)};
+      REQUIRE(reinterpret_cast<uintptr_t>(states.data()) % 64 == 0);
+      walk_chains(ShaTweakFixed128192, parameter, jobs, states);
+
+      for (size_t i = 0; i < jobs.size(); i++)
+      {
+            auto &job = jobs[i];
+            auto expected = chain(ShaTweakFixed128192, parameter, job.epoch, job.chain_index, job.start_pos_in_chain, job.steps, starts[i]);
+            REQUIRE(states[i] == expected);
+      }
+}
+
+TEST_CASE("test_apply_many: one parameter per input matches apply")
+{
+      ShaTweakHash ShaTweak128192 = ShaTweakHash(16, 24);
+      using TH = ShaTweakHashFixed<16, 24>;
+      TH ShaTweakFixed128192;
+
+      std::vector<ShaTweakHash::Parameter> parameters;
+      std::vector<TH::Parameter> fixed_parameters;
+      for (int k = 0; k < 3; k++)
+      {
+            parameters.push_back(ShaTweak128192.rand_parameter());
+            fixed_parameters.push_back(ShaTweakFixed128192.rand_parameter());
+      }
+
+      const size_t n = 37;
+      std::vector<ShaTweakHash::Domain> domains(n);
+      std::vector<TH::Domain> fixed_domains(n);
+      std::vector<const ShaTweakHash::Parameter *> input_parameters;
+      std::vector<const TH::Parameter *> fixed_input_parameters;
+      std::vector<ShaTweak> tweaks;
+      std::vector<std::span<const ShaTweakHash::Domain>> messages;
+      std::vector<std::span<const TH::Domain>> fixed_messages;
+      for (size_t i = 0; i < n; i++)
+      {
+            domains[i] = ShaTweak128192.rand_domain();
+            fixed_domains[i] = ShaTweakFixed128192.rand_domain();
+            input_parameters.push_back(&parameters[(5 * i) % 3]);
+            fixed_input_parameters.push_back(&fixed_parameters[(5 * i) % 3]);
+            tweaks.push_back(ShaTweak128192.chain_tweak(7, static_cast<uint8_t>(i), 3));
+            messages.emplace_back(&domains[i], 1);
+            fixed_messages.emplace_back(&fixed_domains[i], 1);
+      }
+
+      auto results = ShaTweak128192.apply_many(input_parameters, tweaks, messages);
+      auto fixed_results = apply_many_keys(ShaTweakFixed128192, fixed_input_parameters, tweaks, fixed_messages);
+
+      REQUIRE(results.size() == n);
+      REQUIRE(fixed_results.size() == n);
+      for (size_t i = 0; i < n; i++)
+      {
+            REQUIRE(results[i] == ShaTweak128192.apply(*input_parameters[i], tweaks[i], domains[i]));
+            REQUIRE(fixed_results[i] == ShaTweakFixed128192.apply(*fixed_input_parameters[i], tweaks[i], fixed_messages[i]));
+      }
+
+      input_parameters.pop_back();
+      REQUIRE_THROWS_AS(ShaTweak128192.apply_many(input_parameters, tweaks, messages), std::invalid_argument);
+}
+
+TEST_CASE("test_walk_chains: chains under several parameters match chain")
+{
+      using TH = ShaTweakHashFixed<16, 24>;
+      TH ShaTweakFixed128192;
+
+      std::vector<TH::Parameter> parameters;
+      for (int k = 0; k < 4; k++)
+      {
+            parameters.push_back(ShaTweakFixed128192.rand_parameter());
+      }
+
+      std::vector<ChainJob> jobs;
+      std::vector<const TH::Parameter *> job_parameters;
+      std::vector<TH::Domain> starts;
+      for (uint32_t epoch = 30; epoch < 34; epoch++)
+      {
+            for (uint8_t chain_index = 0; chain_index < 13; chain_index++)
+            {
+                  uint8_t start_pos = static_cast<uint8_t>((epoch + chain_index) % 4);
+                  uint steps = static_cast<uint>((7 * chain_index + epoch) % 12);
+                  jobs.push_back({epoch, chain_index, start_pos, steps});
+                  job_parameters.push_back(&parameters[(epoch + chain_index) % 4]);
+                  starts.push_back(ShaTweakFixed128192.rand_domain());
+            }
+      }
+
+      ChainStates<TH> states{std::span<const TH::Domain>(starts)};
+      walk_chains(ShaTweakFixed128192, job_parameters, jobs, states);
+
+      for (size_t i = 0; i < jobs.size(); i++)
+      {
+            auto &job = jobs[i];
+            auto expected = chain(ShaTweakFixed128192, *job_parameters[i], job.epoch, job.chain_index, job.start_pos_in_chain, job.steps, starts[i]);
+            REQUIRE(states[i] == expected);
+      }
+}
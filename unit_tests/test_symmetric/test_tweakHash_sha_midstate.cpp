@@ -0,0 +1,83 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <span>
+#include <openssl/sha.h>
+#include "../catch_amalgamated.hpp"
+#include "../../src/symmetric/tweak_hash/sha_midstate.hpp"
+#include "../../src/symmetric/TweakHash.hpp"
+#include "../../src/random2.hpp"
+
+// SHA-256 of parameter || zero padding to 64 bytes || tweak || messages
+template <typename Parameter, typename Domain>
+static std::vector<uint8_t> reference(const Parameter &parameter, const ShaTweak &tweak, const std::vector<Domain> &messages, size_t hash_len)
+{
+      std::vector<uint8_t> input(parameter.begin(), parameter.end());
+      input.resize(64, 0);
+      input.insert(input.end(), tweak.data(), tweak.data() + tweak.size());
+      for (const Domain &message : messages)
+      {
+            input.insert(input.end(), message.begin(), message.end());
+      }
+
+      uint8_t digest[32];
+      SHA256(input.data(), input.size(), digest);
+      return std::vector<uint8_t>(digest, digest + hash_len);
+}
+
+TEST_CASE("test_apply: ShaTweakHashMidstate chain step matches the padded layout")
+{
+      ShaTweakHashMidstate<24, 32> ShaTweakMidstate192256;
+      ShaTweakMidstate192256.internal_consistency_check();
+
+      auto parameter = ShaTweakMidstate192256.rand_parameter();
+      auto message = ShaTweakMidstate192256.rand_domain();
+
+      auto tweak = ShaTweakMidstate192256.chain_tweak(2, 3, 4);
+      auto result = ShaTweakMidstate192256.apply(parameter, tweak, message);
+
+      REQUIRE(std::vector<uint8_t>(result.begin(), result.end()) == reference(parameter, tweak, std::vector{message}, 32));
+}
+
+TEST_CASE("test_apply: ShaTweakHashMidstate tree node and leaf match the padded layout")
+{
+      using TH = ShaTweakHashMidstate<16, 24>;
+      TH ShaTweakMidstate128192;
+
+      auto parameter = ShaTweakMidstate128192.rand_parameter();
+      std::vector<TH::Domain> children = {ShaTweakMidstate128192.rand_domain(), ShaTweakMidstate128192.rand_domain()};
+
+      auto tree_tweak = ShaTweakMidstate128192.tree_tweak(1, 3);
+      auto node = ShaTweakMidstate128192.apply(parameter, tree_tweak, std::span<const TH::Domain>(children));
+      REQUIRE(std::vector<uint8_t>(node.begin(), node.end()) == reference(parameter, tree_tweak, children, 24));
+
+      // leaf hash over many chain ends takes the runtime-length path
+      for (size_t num_chains : {1, 3, 20, 64})
+      {
+            std::vector<TH::Domain> chain_ends(num_chains);
+            for (auto &end : chain_ends)
+            {
+                  end = ShaTweakMidstate128192.rand_domain();
+            }
+
+            auto leaf_tweak = ShaTweakMidstate128192.tree_tweak(0, 7);
+            auto leaf = ShaTweakMidstate128192.apply(parameter, leaf_tweak, std::span<const TH::Domain>(chain_ends));
+            REQUIRE(std::vector<uint8_t>(leaf.begin(), leaf.end()) == reference(parameter, leaf_tweak, chain_ends, 24));
+      }
+}
+
+TEST_CASE("test_chain: ShaTweakHashMidstate chains from a copied parameter")
+{
+      ShaTweakHashMidstate<16, 16> ShaTweakMidstate128128;
+
+      auto parameter = ShaTweakMidstate128128.rand_parameter();
+      auto start = ShaTweakMidstate128128.rand_domain();
+
+      // a parameter rebuilt from its bytes has the same midstate
+      ShaTweakHashMidstate<16, 16>::Parameter restored(parameter.bytes);
+      REQUIRE(restored.midstate == parameter.midstate);
+
+      auto end = chain(ShaTweakMidstate128128, parameter, 4, 1, 0, 5, start);
+      auto middle = chain(ShaTweakMidstate128128, restored, 4, 1, 0, 2, start);
+      REQUIRE(chain(ShaTweakMidstate128128, parameter, 4, 1, 2, 3, middle) == end);
+}